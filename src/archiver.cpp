@@ -2,9 +2,249 @@
 #include "encode.hpp"
 #include "decode.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <memory>
 #include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+size_t ParseNumberOption(const CLIParsedArguments& parsed_arguments, const std::string& name, size_t min_value,
+                         size_t max_value) {
+    const auto& value = parsed_arguments.GetValue(name);
+    size_t parsed_length = 0;
+    size_t number = 0;
+    try {
+        number = std::stoul(value, &parsed_length);
+    } catch (const std::logic_error& exception) {
+        parsed_length = 0;
+    }
+
+    if (parsed_length == 0 || parsed_length != value.size() || number < min_value || number > max_value) {
+        throw CLIArgumentParser::ArgumentParsingException("Option --" + name + " must be a number from " +
+                                                          std::to_string(min_value) + " to " +
+                                                          std::to_string(max_value) + ".");
+    }
+    return number;
+}
+
+const char* GetMethodName(EncodingMethod method) {
+    switch (method) {
+        case EncodingMethod::HUFFMAN:
+            return "huffman";
+        case EncodingMethod::CONTEXT_HUFFMAN:
+            return "order1";
+        case EncodingMethod::LZ77:
+            return "lz77";
+        case EncodingMethod::TANS:
+            return "tans";
+        case EncodingMethod::CONTEXT_MIXING:
+            return "cm";
+        case EncodingMethod::BWT:
+            return "bwt";
+        case EncodingMethod::STORED:
+            return "stored";
+        case EncodingMethod::RAW:
+            return "raw";
+        case EncodingMethod::AUTO:
+            return "auto";
+    }
+    return "unknown";
+}
+
+void PrintSelection(std::string_view filename, const SampleEstimate& estimate, EncodingMethod method) {
+    std::cerr << "  " << filename << ": " << GetMethodName(method) << std::fixed << std::setprecision(2)
+              << " (entropy " << estimate.entropy << ", huffman " << estimate.huffman_bits << " bits/byte, matches "
+              << 100 * estimate.match_density << "%, sampled " << estimate.sampled_size << " of "
+              << estimate.content_size << " bytes)" << std::defaultfloat << std::endl;
+}
+
+HuffmanModel LoadModel(const std::string& model_name) {
+    if (model_name == "builtin") {
+        return HuffmanModel::Default();
+    }
+
+    auto model_stream = std::make_unique<std::ifstream>();
+    try {
+        model_stream->exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        model_stream->open(model_name, std::ios::binary);
+        model_stream->exceptions(std::ifstream::badbit);
+        BitReaderStream bitstream(std::move(model_stream));
+        return HuffmanModel::Read(bitstream);
+    } catch (const std::ios_base::failure& exception) {
+        std::cerr << "A file system error has occurred: " << exception.what() << std::endl;
+        std::exit(222);
+    } catch (const ModelFormatError& exception) {
+        std::cerr << "A problem with " << model_name << " has occured: " << exception.what() << std::endl;
+        std::exit(111);
+    }
+}
+
+std::vector<uint8_t> ReadFilePrefix(const std::string& filename, size_t max_size) {
+    std::ifstream file;
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    file.open(filename, std::ios::binary);
+    file.exceptions(std::ifstream::badbit);
+    std::vector<uint8_t> content(max_size);
+    file.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    content.resize(static_cast<size_t>(file.gcount()));
+    return content;
+}
+
+LzDictionary LoadDictionary(const std::string& dictionary_name) {
+    try {
+        // Лишний байт отличает слишком длинный словарь от словаря наибольшего размера.
+        return LzDictionary::FromContent(ReadFilePrefix(dictionary_name, LzDictionary::MAX_SIZE + 1));
+    } catch (const std::ios_base::failure& exception) {
+        std::cerr << "A file system error has occurred: " << exception.what() << std::endl;
+        std::exit(222);
+    } catch (const DictionaryFormatError& exception) {
+        std::cerr << "A problem with " << dictionary_name << " has occured: " << exception.what() << std::endl;
+        std::exit(111);
+    }
+}
+
+IoOptions ParseIoOptions(const CLIParsedArguments& parsed_arguments) {
+    IoOptions options;
+    if (!parsed_arguments.IsDefined("cache")) {
+        return options;
+    }
+    const auto& cache = parsed_arguments.GetValue("cache");
+    if (cache == "normal") {
+        options.cache = CachePolicy::NORMAL;
+    } else if (cache == "sequential") {
+        options.cache = CachePolicy::SEQUENTIAL;
+    } else if (cache == "dropbehind") {
+        options.cache = CachePolicy::DROP_BEHIND;
+    } else if (cache == "direct") {
+        options.cache = CachePolicy::DIRECT;
+    } else {
+        throw CLIArgumentParser::ArgumentParsingException("Unknown page cache policy " + cache + ".");
+    }
+    return options;
+}
+
+EncoderOptions ParseEncoderOptions(const CLIParsedArguments& parsed_arguments) {
+    // Уровень задает начальные настройки, явно указанные параметры их уточняют.
+    EncoderOptions options;
+    size_t levels_count = 0;
+    for (size_t level = EncoderOptions::MIN_LEVEL; level <= EncoderOptions::MAX_LEVEL; ++level) {
+        if (parsed_arguments.HasFlag("level" + std::to_string(level))) {
+            options = EncoderOptions::FromLevel(level);
+            ++levels_count;
+        }
+    }
+    if (levels_count > 1) {
+        throw CLIArgumentParser::ArgumentParsingException("Only one compression level can be specified.");
+    }
+
+    if (parsed_arguments.IsDefined("format")) {
+        const auto& format = parsed_arguments.GetValue("format");
+        if (format == "1") {
+            options.format_version = archive::FormatVersion::V1;
+        } else if (format == "2") {
+            options.format_version = archive::FormatVersion::V2;
+        } else if (format == "3") {
+            options.format_version = archive::FormatVersion::V3;
+        } else {
+            throw CLIArgumentParser::ArgumentParsingException("Unknown archive format version " + format + ".");
+        }
+    }
+    if (parsed_arguments.HasFlag("lsb")) {
+        if (options.format_version == archive::FormatVersion::V1) {
+            throw CLIArgumentParser::ArgumentParsingException("--lsb requires --format=2 or --format=3.");
+        }
+        options.bit_order = BitOrder::LSB_FIRST;
+    }
+
+    // Кодеки блоков разбираются ниже, вместе с --blocks.
+    if (parsed_arguments.IsDefined("codec") && !parsed_arguments.HasFlag("blocks")) {
+        options.block_mode = false;
+        const auto& codec = parsed_arguments.GetValue("codec");
+        if (codec == "huffman") {
+            options.method = EncodingMethod::HUFFMAN;
+        } else if (codec == "order1") {
+            options.method = EncodingMethod::CONTEXT_HUFFMAN;
+        } else if (codec == "lz77") {
+            options.method = EncodingMethod::LZ77;
+        } else if (codec == "tans") {
+            options.method = EncodingMethod::TANS;
+        } else if (codec == "cm") {
+            options.method = EncodingMethod::CONTEXT_MIXING;
+        } else if (codec == "bwt") {
+            options.method = EncodingMethod::BWT;
+        } else if (codec == "stored") {
+            options.method = EncodingMethod::STORED;
+        } else if (codec == "raw") {
+            options.method = EncodingMethod::RAW;
+        } else if (codec == "auto") {
+            options.method = EncodingMethod::AUTO;
+        } else {
+            throw CLIArgumentParser::ArgumentParsingException("Unknown codec " + codec + ".");
+        }
+    }
+
+    if (parsed_arguments.HasFlag("blocks")) {
+        options.block_mode = true;
+        const std::string codec = parsed_arguments.IsDefined("codec") ? parsed_arguments.GetValue("codec") : "huffman";
+        if (codec == "auto") {
+            options.block_codec = std::nullopt;
+        } else if (const Codec* block_codec = CodecRegistry::Default().Find(codec)) {
+            options.block_codec = block_codec->Id();
+        } else {
+            throw CLIArgumentParser::ArgumentParsingException("Codec " + codec + " can't encode independent blocks.");
+        }
+    }
+
+    if (parsed_arguments.HasFlag("rle")) {
+        if (options.method != EncodingMethod::HUFFMAN || options.block_mode) {
+            throw CLIArgumentParser::ArgumentParsingException("Option --rle works only with the huffman codec.");
+        }
+        options.run_length_filter = true;
+    }
+
+    if (parsed_arguments.IsDefined("model")) {
+        if (options.method != EncodingMethod::HUFFMAN || options.block_mode || options.run_length_filter) {
+            throw CLIArgumentParser::ArgumentParsingException("Option --model works only with the huffman codec.");
+        }
+        options.model = LoadModel(parsed_arguments.GetValue("model"));
+    }
+
+    if (parsed_arguments.IsDefined("dictionary")) {
+        const bool uses_lz77 = options.method == EncodingMethod::LZ77 ||
+                               (options.method == EncodingMethod::AUTO &&
+                                options.selection.repetitive_method == EncodingMethod::LZ77);
+        if (!uses_lz77 || options.block_mode) {
+            throw CLIArgumentParser::ArgumentParsingException("Option --dictionary works only with the lz77 codec.");
+        }
+        options.dictionary = LoadDictionary(parsed_arguments.GetValue("dictionary"));
+    }
+
+    if (parsed_arguments.IsDefined("window")) {
+        options.lz77.window_bits = ParseNumberOption(parsed_arguments, "window", Lz77Parameters::MIN_WINDOW_BITS,
+                                                     Lz77Parameters::MAX_WINDOW_BITS);
+    }
+    if (parsed_arguments.IsDefined("chain")) {
+        options.lz77.chain_depth = ParseNumberOption(parsed_arguments, "chain", 1, 4096);
+    }
+    if (parsed_arguments.IsDefined("order")) {
+        options.context_mixing_order = ParseNumberOption(parsed_arguments, "order", 0, ContextMixingModel::MAX_ORDER);
+    }
+    if (parsed_arguments.HasFlag("sparse")) {
+        if (parsed_arguments.HasFlag("solid")) {
+            throw CLIArgumentParser::ArgumentParsingException("Option --sparse can't be used in solid mode.");
+        }
+        options.sparse_files = true;
+    }
+    return options;
+}
+
+/// Имя файла "-" означает стандартный ввод или вывод.
+constexpr std::string_view STANDARD_STREAM = "-";
 
 void ProcessCreateArchiveCommand(const CLIParsedArguments& parsed_arguments) {
     const auto& archive_name = parsed_arguments.GetValue("create");
@@ -12,19 +252,40 @@ void ProcessCreateArchiveCommand(const CLIParsedArguments& parsed_arguments) {
     if (files.empty()) {
         throw CLIArgumentParser::ArgumentParsingException("Files for archiving are not specified.");
     }
+    const auto stdin_count = std::ranges::count(files, STANDARD_STREAM);
+    if (stdin_count > 1 || (stdin_count == 1 && parsed_arguments.HasFlag("solid"))) {
+        throw CLIArgumentParser::ArgumentParsingException(
+            "Standard input can be archived only once and not in solid mode.");
+    }
+    const std::string stdin_name = parsed_arguments.IsDefined("name") ? parsed_arguments.GetValue("name") : "stdin";
 
+    auto options = ParseEncoderOptions(parsed_arguments);
+    options.input = ParseIoOptions(parsed_arguments);
+    if (options.method == EncodingMethod::AUTO) {
+        options.selection_listener = PrintSelection;
+    }
     std::cerr << "Creating archive " << archive_name << "..." << std::endl;
 
-    auto archive_stream = std::make_unique<std::ofstream>();
     try {
-        archive_stream->exceptions(std::ofstream::failbit | std::ofstream::badbit);
-        archive_stream->open(archive_name, std::ios::binary);
-        BitWriterStream bitstream(std::move(archive_stream));
+        auto bitstream = archive_name == STANDARD_STREAM ? std::make_unique<BitWriterFile>(STDOUT_FILENO, options.input)
+                                                         : std::make_unique<BitWriterFile>(archive_name, options.input);
 
-        ArchiveEncoder encoder(bitstream);
-        for (const auto& filename : files) {
-            std::cerr << "Archiving " << filename << "..." << std::endl;
-            encoder.EncodeFile(filename);
+        ArchiveEncoder encoder(*bitstream, options);
+        if (parsed_arguments.HasFlag("solid")) {
+            std::cerr << "Archiving " << files.size() << " files in solid mode..." << std::endl;
+            encoder.EncodeSolidFiles(files);
+        } else {
+            for (const auto& filename : files) {
+                if (filename == STANDARD_STREAM) {
+                    std::cerr << "Archiving standard input as " << stdin_name << "..." << std::endl;
+                    auto stream = std::make_unique<AsyncInputFile>(STDIN_FILENO, options.input);
+                    stream->exceptions(std::ios_base::badbit);
+                    encoder.EncodeStream(stdin_name, std::move(stream));
+                    continue;
+                }
+                std::cerr << "Archiving " << filename << "..." << std::endl;
+                encoder.EncodeFile(filename);
+            }
         }
 
         encoder.Close();
@@ -38,19 +299,29 @@ void ProcessCreateArchiveCommand(const CLIParsedArguments& parsed_arguments) {
 
 void ProcessUnzipArchiveCommand(const CLIParsedArguments& parsed_arguments) {
     const auto& archive_name = parsed_arguments.GetValue("unzip");
+    const auto io_options = ParseIoOptions(parsed_arguments);
     std::cerr << "Unzipping archive " << archive_name << "..." << std::endl;
 
-    auto archive_stream = std::make_unique<std::ifstream>();
     try {
-        archive_stream->exceptions(std::ofstream::badbit);
-        archive_stream->open(archive_name, std::ios::binary);
-        BitReaderStream bitstream(std::move(archive_stream));
+        auto bitstream = archive_name == STANDARD_STREAM ? std::make_unique<BitReaderFile>(STDIN_FILENO, io_options)
+                                                         : std::make_unique<BitReaderFile>(archive_name, io_options);
 
-        ArchiveDecoder decoder(bitstream);
+        ArchiveDecoder decoder(*bitstream);
+        if (parsed_arguments.IsDefined("model")) {
+            decoder.AddModel(LoadModel(parsed_arguments.GetValue("model")));
+        }
+        if (parsed_arguments.IsDefined("dictionary")) {
+            decoder.AddDictionary(LoadDictionary(parsed_arguments.GetValue("dictionary")));
+        }
+        const bool print = parsed_arguments.HasFlag("print");
+        if (print) {
+            std::cout.exceptions(std::ios_base::badbit);
+        }
         while (!decoder.Done()) {
-            auto decoded_file = decoder.DecodeFile();
+            auto decoded_file = print ? decoder.Decode(std::cout) : decoder.DecodeFile();
             std::cerr << "Decoded " << decoded_file << "." << std::endl;
         }
+        std::cout.flush();
 
         std::cerr << "Done!" << std::endl;
     } catch (const std::ios_base::failure& exception) {
@@ -62,23 +333,140 @@ void ProcessUnzipArchiveCommand(const CLIParsedArguments& parsed_arguments) {
     }
 }
 
+void ProcessTrainModelCommand(const CLIParsedArguments& parsed_arguments) {
+    const auto& model_name = parsed_arguments.GetValue("train");
+    const auto& files = parsed_arguments.GetValueArray();
+    if (files.empty()) {
+        throw CLIArgumentParser::ArgumentParsingException("Files for training are not specified.");
+    }
+    std::cerr << "Training model " << model_name << "..." << std::endl;
+
+    try {
+        std::vector<size_t> frequencies(HuffmanModel::ALPHABET_SIZE, 0);
+        std::vector<char> chunk(1 << 16);
+        for (const auto& filename : files) {
+            std::ifstream file;
+            file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+            file.open(filename, std::ios::binary);
+            file.exceptions(std::ifstream::badbit);
+            while (file.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || file.gcount() > 0) {
+                for (char byte : std::span(chunk).first(static_cast<size_t>(file.gcount()))) {
+                    ++frequencies[static_cast<uint8_t>(byte)];
+                }
+            }
+        }
+
+        const auto model = HuffmanModel::Train(frequencies);
+        BitWriterStream bitstream(model_name);
+        model.Write(bitstream);
+        bitstream.Close();
+
+        std::cerr << "Done! Model id " << std::hex << model.Id() << std::dec << "." << std::endl;
+    } catch (const std::ios_base::failure& exception) {
+        std::cerr << "A file system error has occurred: " << exception.what() << std::endl;
+        std::exit(222);
+    }
+}
+
+void ProcessTrainDictionaryCommand(const CLIParsedArguments& parsed_arguments) {
+    const auto& dictionary_name = parsed_arguments.GetValue("train");
+    const auto& files = parsed_arguments.GetValueArray();
+    if (files.empty()) {
+        throw CLIArgumentParser::ArgumentParsingException("Files for training are not specified.");
+    }
+    std::cerr << "Training dictionary " << dictionary_name << "..." << std::endl;
+
+    try {
+        std::vector<std::vector<uint8_t>> samples;
+        samples.reserve(files.size());
+        for (const auto& filename : files) {
+            samples.push_back(ReadFilePrefix(filename, LzDictionary::MAX_SAMPLE_SIZE));
+        }
+
+        const auto dictionary = LzDictionary::Train(samples);
+        const auto content = dictionary.Content();
+        std::ofstream dictionary_stream;
+        dictionary_stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        dictionary_stream.open(dictionary_name, std::ios::binary);
+        dictionary_stream.write(reinterpret_cast<const char*>(content.data()),
+                                static_cast<std::streamsize>(content.size()));
+        dictionary_stream.close();
+
+        std::cerr << "Done! Dictionary id " << std::hex << dictionary.Id() << std::dec << ", " << content.size()
+                  << " bytes." << std::endl;
+    } catch (const std::ios_base::failure& exception) {
+        std::cerr << "A file system error has occurred: " << exception.what() << std::endl;
+        std::exit(222);
+    } catch (const std::invalid_argument& exception) {
+        std::cerr << "Can't train a dictionary: " << exception.what() << std::endl;
+        std::exit(111);
+    }
+}
+
+void ProcessTrainCommand(const CLIParsedArguments& parsed_arguments) {
+    const std::string codec = parsed_arguments.IsDefined("codec") ? parsed_arguments.GetValue("codec") : "huffman";
+    if (codec == "huffman") {
+        ProcessTrainModelCommand(parsed_arguments);
+    } else if (codec == "lz77") {
+        ProcessTrainDictionaryCommand(parsed_arguments);
+    } else {
+        throw CLIArgumentParser::ArgumentParsingException("Only huffman models and lz77 dictionaries can be trained.");
+    }
+}
+
 int main(int argc, const char* argv[]) {
     CLIArgumentParser parser_archiver{
         CLIOption("help", "output help information").ShortName('h'),
         CLIOption("create", "create archive").ShortName('c').WithArgument(),
         CLIOption("unzip", "unzip archive").ShortName('d').WithArgument(),
+        CLIOption("train", "train a huffman model (or an lz77 dictionary with --codec=lz77) on the files")
+            .WithArgument(),
+        CLIOption("model", "huffman: code with a trained model file or the builtin one").WithArgument(),
+        CLIOption("dictionary", "lz77: prime the window with a trained dictionary file").WithArgument(),
+        CLIOption("solid", "use one code table for all files").ShortName('s'),
+        CLIOption("format", "archive format version: 1 (default), 2 or 3").WithArgument(),
+        CLIOption("lsb", "format 2 and 3: store bits least significant first for faster decoding"),
+        CLIOption("codec", "content coding: huffman (default), order1, lz77, tans, cm, bwt, stored, raw or auto")
+            .WithArgument(),
+        CLIOption("level1", "fastest: huffman, tans or stored per 1 MiB block").ShortName('1'),
+        CLIOption("level2", "huffman, tans or stored per 256 KiB block").ShortName('2'),
+        CLIOption("level3", "per-file choice of lz77 (chain 4), huffman, tans or stored").ShortName('3'),
+        CLIOption("level4", "as -3, lz77 chain 8").ShortName('4'),
+        CLIOption("level5", "as -3, lz77 chain 16").ShortName('5'),
+        CLIOption("level6", "as -3, lz77 chain 32").ShortName('6'),
+        CLIOption("level7", "as -3, lz77 chain 64 and 256 KiB window").ShortName('7'),
+        CLIOption("level8", "as -3, bwt instead of lz77").ShortName('8'),
+        CLIOption("level9", "slowest: as -3, context mixing instead of lz77").ShortName('9'),
+        CLIOption("blocks", "encode independent 1 MiB blocks: huffman, multihuffman, tans, stored or auto per block"),
+        CLIOption("rle", "huffman: encode runs of equal bytes with repeat symbols"),
+        CLIOption("window", "lz77: log2 of the window size, 8-24 (default 16)").WithArgument(),
+        CLIOption("chain", "lz77: hash chain search depth (default 32)").WithArgument(),
+        CLIOption("order", "cm: maximal context order, 0-6 (default 4)").WithArgument(),
+        CLIOption("sparse", "encode only the data ranges of files with holes, as blocks of the --blocks codec"),
+        CLIOption("cache", "page cache use: normal (default), sequential, dropbehind or direct").WithArgument(),
+        CLIOption("name", "name of the entry read from - (standard input), stdin by default").WithArgument(),
+        CLIOption("print", "with -d: write the content of entries to standard output instead of files")
+            .ShortName('p'),
     };
 
     parser_archiver.AddUsageCase("archiver -h");
-    parser_archiver.AddUsageCase("archiver -c <archive> <file...>");
-    parser_archiver.AddUsageCase("archiver -d <archive>");
+    parser_archiver.AddUsageCase("archiver -c <archive> [-1...-9] [--solid] [--format=2|3 [--lsb]] "
+                                 "[--codec=<codec> [<codec options>]] [--sparse] [--cache=<policy>] <file...>");
+    parser_archiver.AddUsageCase("archiver -c - [<options>] [--name=<name>] <file or - ...> | ...");
+    parser_archiver.AddUsageCase("archiver -d <archive> [--model=<model>] [--dictionary=<dictionary>] "
+                                 "[--cache=<policy>] [-p]");
+    parser_archiver.AddUsageCase("... | archiver -d - [-p]");
+    parser_archiver.AddUsageCase("archiver --train <model> <file...>");
+    parser_archiver.AddUsageCase("archiver --train <dictionary> --codec=lz77 <file...>");
 
     try {
         auto parsed_arguments = parser_archiver.Parse(argc, argv);
 
-        if (parsed_arguments.IsDefined("create") && parsed_arguments.IsDefined("unzip")) {
+        const size_t operations_count = static_cast<size_t>(parsed_arguments.IsDefined("create")) +
+                                        parsed_arguments.IsDefined("unzip") + parsed_arguments.IsDefined("train");
+        if (operations_count > 1) {
             using ParsingException = CLIArgumentParser::ArgumentParsingException;
-            throw ParsingException("Options --create and --unzip cannot be mentioned in a single program call.");
+            throw ParsingException("Only one of --create, --unzip and --train can be mentioned in a program call.");
         }
 
         if (parsed_arguments.HasFlag("help")) {
@@ -87,6 +475,8 @@ int main(int argc, const char* argv[]) {
             ProcessCreateArchiveCommand(parsed_arguments);
         } else if (parsed_arguments.IsDefined("unzip")) {
             ProcessUnzipArchiveCommand(parsed_arguments);
+        } else if (parsed_arguments.IsDefined("train")) {
+            ProcessTrainCommand(parsed_arguments);
         } else {
             throw CLIArgumentParser::ArgumentParsingException("No operation specified");
         }
@@ -68,7 +68,8 @@ CLIParsedArguments CLIArgumentParser::Parse(size_t argc, const char* argv[]) con
         std::vector<std::string> arguments;
         while (i != argc && arguments.size() < option.GetArgumentCount()) {
             std::string_view argument = argv[i];
-            if (argument[0] == '-') {
+            // Одиночный дефис - значение: стандартный ввод или вывод.
+            if (argument.size() > 1 && argument[0] == '-') {
                 break;
             }
 
@@ -91,11 +92,7 @@ CLIParsedArguments CLIArgumentParser::Parse(size_t argc, const char* argv[]) con
             continue;
         }
 
-        if (lexem.front() == '-') {
-            if (lexem.size() == 1) {
-                throw ArgumentParsingException("A set of flags was expected after the hyphen.");
-            }
-
+        if (lexem.front() == '-' && lexem.size() > 1) {
             auto it = std::find(lexem.begin(), lexem.end(), '=');
 
             if (lexem[1] == '-') {
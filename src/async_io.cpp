@@ -0,0 +1,1060 @@
+#include "async_io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <ios>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define ARCHIVER_HAS_IO_URING 1
+#endif
+
+namespace {
+
+constexpr uint8_t OPCODE_READ = 0;
+constexpr uint8_t OPCODE_WRITE = 1;
+/// Позиция операции для дескрипторов без произвольного доступа: read и write с текущей позиции.
+constexpr uint64_t CURRENT_POSITION = std::numeric_limits<uint64_t>::max();
+
+[[noreturn]] void ThrowSystemError(const std::string& message, int error) {
+    // Описание ошибки по коду failure добавляет к сообщению сам.
+    throw std::ios_base::failure(message, std::error_code(error, std::system_category()));
+}
+
+int64_t SyncTransfer(uint8_t opcode, int fd, const uint8_t* buffer, size_t size, uint64_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = 0;
+        if (offset == CURRENT_POSITION) {
+            result = opcode == OPCODE_READ ? read(fd, const_cast<uint8_t*>(buffer) + done, size - done)
+                                           : write(fd, buffer + done, size - done);
+        } else {
+            result = opcode == OPCODE_READ ? pread(fd, const_cast<uint8_t*>(buffer) + done, size - done,
+                                                   static_cast<off_t>(offset + done))
+                                           : pwrite(fd, buffer + done, size - done, static_cast<off_t>(offset + done));
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            return -errno;
+        }
+        if (result == 0) {
+            break;
+        }
+        done += static_cast<size_t>(result);
+    }
+    return static_cast<int64_t>(done);
+}
+
+/// Больше за один вызов copy_file_range и sendfile не передают.
+constexpr size_t MAX_KERNEL_COPY = 1 << 30;
+
+/// Передать size байт из in_fd с позиции in_offset в out_fd с позиции out_offset (CURRENT_POSITION - с текущей)
+/// средствами ядра. Возвращает, сколько байт передано: меньше size, если ядро не умеет передавать данные между
+/// этими файлами, тогда остаток передает вызывающий.
+uint64_t KernelCopy(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t size) {
+    uint64_t done = 0;
+    bool use_sendfile = false;
+    while (done < size) {
+        const auto count = static_cast<size_t>(std::min<uint64_t>(size - done, MAX_KERNEL_COPY));
+        auto in = static_cast<off_t>(in_offset + done);
+        ssize_t result = 0;
+        if (!use_sendfile) {
+            auto out = static_cast<off_t>(out_offset + done);
+            result = copy_file_range(in_fd, &in, out_fd, out_offset == CURRENT_POSITION ? nullptr : &out, count, 0);
+            // Разные файловые системы, канал, старое ядро или O_APPEND.
+            if (result < 0 &&
+                (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+                use_sendfile = true;
+                continue;
+            }
+        } else {
+            // sendfile пишет в текущую позицию out_fd.
+            if (out_offset != CURRENT_POSITION && lseek(out_fd, static_cast<off_t>(out_offset + done), SEEK_SET) < 0) {
+                return done;
+            }
+            result = sendfile(out_fd, in_fd, &in, count);
+            if (result < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                return done;
+            }
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            ThrowSystemError("Cannot copy a file", errno);
+        }
+        if (result == 0) {
+            ThrowSystemError("Unexpected end of a file", EIO);
+        }
+        done += static_cast<uint64_t>(result);
+    }
+    return done;
+}
+
+/// Открыть файл. Если файловая система не поддерживает O_DIRECT, файл открывается без него, а политика
+/// меняется на DROP_BEHIND.
+int OpenWithPolicy(const std::string& filename, int flags, CachePolicy& cache) {
+    if (cache == CachePolicy::DIRECT) {
+        const int fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        cache = CachePolicy::DROP_BEHIND;
+    }
+    return open(filename.c_str(), flags, 0644);
+}
+
+}  // namespace
+
+#ifdef ARCHIVER_HAS_IO_URING
+
+/// Кольца io_uring, отображенные в память процесса. Очередь заполняет только этот поток, поэтому
+/// синхронизация с ядром сводится к упорядоченным загрузкам и сохранениям head и tail.
+struct IoQueue::Ring {
+    int fd = -1;
+    void* sq_pointer = MAP_FAILED;
+    size_t sq_size = 0;
+    void* cq_pointer = MAP_FAILED;
+    size_t cq_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    uint32_t* sq_tail = nullptr;
+    uint32_t* sq_mask = nullptr;
+    uint32_t* sq_array = nullptr;
+    uint32_t* cq_head = nullptr;
+    uint32_t* cq_tail = nullptr;
+    uint32_t* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_pointer != MAP_FAILED && cq_pointer != sq_pointer) {
+            munmap(cq_pointer, cq_size);
+        }
+        if (sq_pointer != MAP_FAILED) {
+            munmap(sq_pointer, sq_size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    /// @brief Создать кольцо. nullptr - io_uring недоступен (старое ядро, запрет seccomp) или не умеет
+    /// IORING_OP_READ и IORING_OP_WRITE.
+    static std::unique_ptr<Ring> Create(size_t depth) {
+        io_uring_params params{};
+        auto ring = std::make_unique<Ring>();
+        ring->fd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+        if (ring->fd < 0 || (params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+            return nullptr;
+        }
+
+        ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+        }
+        ring->sq_pointer = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                                IORING_OFF_SQ_RING);
+        if (ring->sq_pointer == MAP_FAILED) {
+            return nullptr;
+        }
+        ring->cq_pointer = single_mmap ? ring->sq_pointer
+                                       : mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_pointer == MAP_FAILED) {
+            return nullptr;
+        }
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED) {
+            return nullptr;
+        }
+
+        auto* sq = static_cast<uint8_t*>(ring->sq_pointer);
+        ring->sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        ring->sq_mask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        ring->sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        auto* cq = static_cast<uint8_t*>(ring->cq_pointer);
+        ring->cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        ring->cq_mask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+
+    void Submit(uint8_t opcode, int file, const uint8_t* buffer, size_t size, uint64_t offset, uint64_t tag) {
+        const uint32_t tail = *sq_tail;
+        const uint32_t index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode == OPCODE_READ ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = static_cast<uint32_t>(size);
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array[index] = index;
+        std::atomic_ref<uint32_t>(*sq_tail).store(tail + 1, std::memory_order_release);
+
+        while (syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                ThrowSystemError("io_uring_enter", errno);
+            }
+        }
+    }
+
+    Completion Wait() {
+        const uint32_t head = *cq_head;
+        while (std::atomic_ref<uint32_t>(*cq_tail).load(std::memory_order_acquire) == head) {
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                ThrowSystemError("io_uring_enter", errno);
+            }
+        }
+        const io_uring_cqe& cqe = cqes[head & *cq_mask];
+        const Completion completion{.tag = cqe.user_data, .result = cqe.res};
+        std::atomic_ref<uint32_t>(*cq_head).store(head + 1, std::memory_order_release);
+        return completion;
+    }
+};
+
+#else
+
+struct IoQueue::Ring {
+    static std::unique_ptr<Ring> Create(size_t depth) {
+        return nullptr;
+    }
+
+    void Submit(uint8_t opcode, int file, const uint8_t* buffer, size_t size, uint64_t offset, uint64_t tag) {
+    }
+
+    Completion Wait() {
+        return Completion{};
+    }
+};
+
+#endif
+
+/// Фоновый поток, выполняющий операции в порядке постановки. Пока он ждет диска, вызывающий поток
+/// обрабатывает уже прочитанные фрагменты или заполняет следующий буфер записи.
+struct IoQueue::Worker {
+    struct Request {
+        uint8_t opcode;
+        int fd;
+        const uint8_t* buffer;
+        size_t size;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    std::mutex mutex;
+    std::condition_variable submitted;
+    std::condition_variable completed;
+    std::deque<Request> requests;
+    std::deque<Completion> results;
+    bool stopped = false;
+    std::thread thread;
+
+    Worker() : thread([this] { Run(); }) {
+    }
+
+    ~Worker() {
+        {
+            std::lock_guard lock(mutex);
+            stopped = true;
+        }
+        submitted.notify_one();
+        thread.join();
+    }
+
+    void Run() {
+        std::unique_lock lock(mutex);
+        while (true) {
+            submitted.wait(lock, [this] { return stopped || !requests.empty(); });
+            if (requests.empty()) {
+                return;
+            }
+            const Request request = requests.front();
+            requests.pop_front();
+            lock.unlock();
+            const int64_t result = SyncTransfer(request.opcode, request.fd, request.buffer, request.size,
+                                                request.offset);
+            lock.lock();
+            results.push_back(Completion{.tag = request.tag, .result = result});
+            completed.notify_one();
+        }
+    }
+
+    void Submit(uint8_t opcode, int file, const uint8_t* buffer, size_t size, uint64_t offset, uint64_t tag) {
+        {
+            std::lock_guard lock(mutex);
+            requests.push_back(
+                Request{.opcode = opcode, .fd = file, .buffer = buffer, .size = size, .offset = offset, .tag = tag});
+        }
+        submitted.notify_one();
+    }
+
+    Completion Wait() {
+        std::unique_lock lock(mutex);
+        completed.wait(lock, [this] { return !results.empty(); });
+        const Completion completion = results.front();
+        results.pop_front();
+        return completion;
+    }
+};
+
+IoQueue::IoQueue(size_t depth, bool use_io_uring)
+    : depth_(depth), in_flight_(0), ring_(use_io_uring ? Ring::Create(depth) : nullptr), worker_() {
+    if (!ring_) {
+        worker_ = std::make_unique<Worker>();
+    }
+}
+
+IoQueue::~IoQueue() {
+    Drain();
+}
+
+bool IoQueue::UsesIoUring() const {
+    return ring_ != nullptr;
+}
+
+size_t IoQueue::Depth() const {
+    return depth_;
+}
+
+size_t IoQueue::InFlight() const {
+    return in_flight_;
+}
+
+void IoQueue::SubmitRead(int fd, std::span<uint8_t> buffer, uint64_t offset, uint64_t tag) {
+    Submit(OPCODE_READ, fd, buffer.data(), buffer.size(), offset, tag);
+}
+
+void IoQueue::SubmitWrite(int fd, std::span<const uint8_t> buffer, uint64_t offset, uint64_t tag) {
+    Submit(OPCODE_WRITE, fd, buffer.data(), buffer.size(), offset, tag);
+}
+
+void IoQueue::Submit(uint8_t opcode, int fd, const uint8_t* buffer, size_t size, uint64_t offset, uint64_t tag) {
+    if (ring_) {
+        ring_->Submit(opcode, fd, buffer, size, offset, tag);
+    } else {
+        worker_->Submit(opcode, fd, buffer, size, offset, tag);
+    }
+    ++in_flight_;
+}
+
+IoQueue::Completion IoQueue::Wait() {
+    Completion completion{};
+    if (ring_) {
+        completion = ring_->Wait();
+    } else {
+        completion = worker_->Wait();
+    }
+    --in_flight_;
+    return completion;
+}
+
+void IoQueue::Drain() {
+    while (in_flight_ != 0) {
+        Wait();
+    }
+}
+
+void AlignedDeleter::operator()(uint8_t* pointer) const {
+    ::operator delete[](pointer, std::align_val_t(IO_ALIGNMENT));
+}
+
+AlignedBuffer MakeAlignedBuffer(size_t size) {
+    return AlignedBuffer(static_cast<uint8_t*>(::operator new[](size, std::align_val_t(IO_ALIGNMENT))));
+}
+
+void ReadFileRange(int fd, std::span<uint8_t> buffer, uint64_t offset) {
+    const int64_t result = SyncTransfer(OPCODE_READ, fd, buffer.data(), buffer.size(), offset);
+    if (result < 0) {
+        ThrowSystemError("Cannot read a file", static_cast<int>(-result));
+    }
+    if (static_cast<size_t>(result) < buffer.size()) {
+        ThrowSystemError("Unexpected end of a file", EIO);
+    }
+}
+
+void WriteAll(int fd, std::span<const uint8_t> data) {
+    const int64_t result = SyncTransfer(OPCODE_WRITE, fd, data.data(), data.size(), CURRENT_POSITION);
+    if (result < 0 || static_cast<size_t>(result) < data.size()) {
+        ThrowSystemError("Cannot write a file", result < 0 ? static_cast<int>(-result) : EIO);
+    }
+}
+
+void WriteAll(int fd, std::span<const uint8_t> head, std::span<const uint8_t> tail) {
+    while (!head.empty()) {
+        std::array<iovec, 2> vectors{iovec{const_cast<uint8_t*>(head.data()), head.size()},
+                                     iovec{const_cast<uint8_t*>(tail.data()), tail.size()}};
+        const ssize_t result = writev(fd, vectors.data(), tail.empty() ? 1 : 2);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            ThrowSystemError("Cannot write a file", result < 0 ? errno : EIO);
+        }
+        const size_t written = static_cast<size_t>(result);
+        if (written < head.size()) {
+            head = head.subspan(written);
+        } else {
+            head = tail.subspan(written - head.size());
+            tail = {};
+        }
+    }
+    WriteAll(fd, tail);
+}
+
+void SyncFile(int fd) {
+    // Каналы и терминалы fdatasync не поддерживают, а сохранять на носитель в них нечего.
+    if (fdatasync(fd) != 0 && errno != EINVAL && errno != EROFS) {
+        ThrowSystemError("Cannot sync a file", errno);
+    }
+}
+
+uint64_t FileLayout::DataSize() const {
+    uint64_t size = 0;
+    for (const FileRange& range : data) {
+        size += range.size;
+    }
+    return size;
+}
+
+FileLayout ReadFileLayout(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ThrowSystemError("Cannot open " + filename, errno);
+    }
+    struct stat status {};
+    if (fstat(fd, &status) != 0) {
+        const int error = errno;
+        close(fd);
+        ThrowSystemError("Cannot open " + filename, error);
+    }
+
+    FileLayout layout{.size = static_cast<uint64_t>(status.st_size), .data = {}};
+    for (off_t position = 0; static_cast<uint64_t>(position) < layout.size;) {
+        const off_t data = lseek(fd, position, SEEK_DATA);
+        if (data < 0) {
+            // ENXIO - после position только дыра, EINVAL - SEEK_DATA не поддерживается.
+            if (errno == EINVAL) {
+                layout.data = {FileRange{.offset = 0, .size = layout.size}};
+            } else if (errno != ENXIO) {
+                const int error = errno;
+                close(fd);
+                ThrowSystemError("Cannot read " + filename, error);
+            }
+            break;
+        }
+        // Файл мог измениться после fstat: участки не выходят за размер при открытии.
+        const off_t hole = std::min<off_t>(lseek(fd, data, SEEK_HOLE), static_cast<off_t>(layout.size));
+        if (hole <= data) {
+            break;
+        }
+        layout.data.push_back(
+            FileRange{.offset = static_cast<uint64_t>(data), .size = static_cast<uint64_t>(hole - data)});
+        position = hole;
+    }
+    close(fd);
+    return layout;
+}
+
+AsyncFileReader::AsyncFileReader(const std::string& filename, const IoOptions& options)
+    : fd_(-1),
+      owns_fd_(true),
+      seekable_(true),
+      cache_(options.cache),
+      size_(0),
+      chunks_(options.depth),
+      head_(0),
+      head_returned_(false),
+      next_offset_(0),
+      skip_(0),
+      queue_(options.depth, options.use_io_uring) {
+    fd_ = OpenWithPolicy(filename, O_RDONLY | O_CLOEXEC, cache_);
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot open " + filename, errno);
+    }
+    struct stat status {};
+    if (fstat(fd_, &status) != 0 || !S_ISREG(status.st_mode)) {
+        const int error = S_ISDIR(status.st_mode) ? EISDIR : errno;
+        close(fd_);
+        ThrowSystemError("Cannot read " + filename, error);
+    }
+    size_ = static_cast<uint64_t>(status.st_size);
+    if (cache_ == CachePolicy::SEQUENTIAL || cache_ == CachePolicy::DROP_BEHIND) {
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    for (Chunk& chunk : chunks_) {
+        chunk.data = MakeAlignedBuffer(CHUNK_SIZE);
+    }
+    Restart(0);
+}
+
+AsyncFileReader::AsyncFileReader(int fd, const IoOptions& options)
+    : fd_(fd),
+      owns_fd_(false),
+      seekable_(false),
+      cache_(CachePolicy::NORMAL),
+      size_(std::numeric_limits<uint64_t>::max()),
+      chunks_(options.depth),
+      head_(0),
+      head_returned_(false),
+      next_offset_(0),
+      skip_(0),
+      // Операции io_uring с текущей позиции могут выполниться не по порядку, фоновый поток сохраняет порядок.
+      queue_(options.depth, false) {
+    for (Chunk& chunk : chunks_) {
+        chunk.data = MakeAlignedBuffer(CHUNK_SIZE);
+    }
+    Restart(0);
+}
+
+AsyncFileReader::~AsyncFileReader() {
+    queue_.Drain();
+    // Кроме обработанных фрагментов, из кэша уходит и прочитанное впрок.
+    if (cache_ == CachePolicy::DROP_BEHIND) {
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    if (owns_fd_) {
+        close(fd_);
+    }
+}
+
+bool AsyncFileReader::IsRegularFile(const std::string& filename) {
+    struct stat status {};
+    return stat(filename.c_str(), &status) == 0 && S_ISREG(status.st_mode);
+}
+
+uint64_t AsyncFileReader::Size() const {
+    return size_;
+}
+
+void AsyncFileReader::SubmitChunk(Chunk& chunk) {
+    chunk.offset = next_offset_;
+    chunk.pending = next_offset_ < size_;
+    chunk.result = 0;
+    if (!chunk.pending) {
+        return;
+    }
+    queue_.SubmitRead(fd_, std::span(chunk.data.get(), CHUNK_SIZE), seekable_ ? chunk.offset : CURRENT_POSITION,
+                      static_cast<uint64_t>(&chunk - chunks_.data()));
+    next_offset_ += CHUNK_SIZE;
+    if (cache_ == CachePolicy::SEQUENTIAL || cache_ == CachePolicy::DROP_BEHIND) {
+        // Фрагмент, который через круг будет прочитан в этот же буфер, ядро читает заранее.
+        const uint64_t ahead = next_offset_ + (chunks_.size() - 1) * CHUNK_SIZE;
+        posix_fadvise(fd_, static_cast<off_t>(ahead), CHUNK_SIZE, POSIX_FADV_WILLNEED);
+    }
+}
+
+void AsyncFileReader::ReleaseChunk(Chunk& chunk) {
+    if (cache_ == CachePolicy::DROP_BEHIND && chunk.result > 0) {
+        posix_fadvise(fd_, static_cast<off_t>(chunk.offset), chunk.result, POSIX_FADV_DONTNEED);
+    }
+}
+
+void AsyncFileReader::Restart(uint64_t offset) {
+    queue_.Drain();
+    head_ = 0;
+    head_returned_ = false;
+    // O_DIRECT читает только с выровненных позиций, лишнее начало первого фрагмента пропускается.
+    next_offset_ = cache_ == CachePolicy::DIRECT ? offset / IO_ALIGNMENT * IO_ALIGNMENT : offset;
+    skip_ = static_cast<size_t>(offset - next_offset_);
+    for (Chunk& chunk : chunks_) {
+        SubmitChunk(chunk);
+    }
+}
+
+std::span<const uint8_t> AsyncFileReader::Next() {
+    // Буфер, отданный прошлым вызовом, больше не нужен: в него читается следующий фрагмент.
+    if (head_returned_) {
+        ReleaseChunk(chunks_[head_]);
+        SubmitChunk(chunks_[head_]);
+        head_ = (head_ + 1) % chunks_.size();
+        head_returned_ = false;
+    }
+
+    Chunk& chunk = chunks_[head_];
+    while (chunk.pending) {
+        const auto completion = queue_.Wait();
+        chunks_[completion.tag].result = completion.result;
+        chunks_[completion.tag].pending = false;
+    }
+    if (chunk.result < 0) {
+        ThrowSystemError("Cannot read a file", static_cast<int>(-chunk.result));
+    }
+
+    const auto size = static_cast<size_t>(chunk.result);
+    if (!seekable_ && size < CHUNK_SIZE) {
+        // Фрагмент канала читается, пока не заполнится, поэтому неполный фрагмент - последний.
+        size_ = std::min(size_, chunk.offset + size);
+    } else if (size < CHUNK_SIZE && chunk.offset + size < size_) {
+        // Короткое чтение не в конце файла: следующие фрагменты читались с неверных позиций.
+        if (size == 0) {
+            ThrowSystemError("Unexpected end of a file", EIO);
+        }
+        Restart(chunk.offset + std::max(size, skip_));
+        return Next();
+    }
+    head_returned_ = true;
+    const size_t skip = std::min(skip_, size);
+    skip_ = 0;
+    return std::span<const uint8_t>(chunk.data.get(), size).subspan(skip);
+}
+
+void AsyncFileReader::Seek(uint64_t offset) {
+    if (!seekable_) {
+        ThrowSystemError("Cannot seek in a stream", ESPIPE);
+    }
+    Restart(offset);
+}
+
+bool AsyncFileReader::CopyTo(int fd, uint64_t size) {
+    // Позиция сразу за последним возвращенным фрагментом; без O_DIRECT начало фрагментов не пропускается.
+    const Chunk& head = chunks_[head_];
+    const uint64_t position = head_returned_ ? head.offset + static_cast<uint64_t>(head.result) : head.offset;
+    if (!seekable_ || cache_ == CachePolicy::DIRECT || position > size_ || size > size_ - position) {
+        return false;
+    }
+
+    queue_.Drain();
+    uint64_t done = KernelCopy(fd_, position, fd, CURRENT_POSITION, size);
+    const std::span<uint8_t> buffer(chunks_.front().data.get(), CHUNK_SIZE);
+    while (done < size) {
+        const auto part = buffer.first(static_cast<size_t>(std::min<uint64_t>(size - done, buffer.size())));
+        ReadFileRange(fd_, part, position + done);
+        WriteAll(fd, part);
+        done += part.size();
+    }
+    Restart(position + size);
+    return true;
+}
+
+AsyncFileWriter::AsyncFileWriter(const std::string& filename, const IoOptions& options)
+    : fd_(-1),
+      owns_fd_(true),
+      seekable_(true),
+      cache_(options.cache),
+      chunks_(options.depth),
+      current_(nullptr),
+      offset_(0),
+      size_(0),
+      written_offset_(0),
+      written_size_(0),
+      queue_(options.depth, options.use_io_uring) {
+    fd_ = OpenWithPolicy(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, cache_);
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot open " + filename, errno);
+    }
+    for (Chunk& chunk : chunks_) {
+        chunk.data = MakeAlignedBuffer(CHUNK_SIZE);
+        chunk.size = 0;
+        chunk.pending = false;
+    }
+    current_ = &chunks_.front();
+}
+
+AsyncFileWriter::AsyncFileWriter(int fd, const IoOptions& options)
+    : fd_(fd),
+      owns_fd_(false),
+      seekable_(false),
+      cache_(CachePolicy::NORMAL),
+      chunks_(options.depth),
+      current_(nullptr),
+      offset_(0),
+      size_(0),
+      written_offset_(0),
+      written_size_(0),
+      queue_(options.depth, false) {
+    for (Chunk& chunk : chunks_) {
+        chunk.data = MakeAlignedBuffer(CHUNK_SIZE);
+        chunk.size = 0;
+        chunk.pending = false;
+    }
+    current_ = &chunks_.front();
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    try {
+        Close();
+    } catch (const std::ios_base::failure& exception) {
+    }
+}
+
+void AsyncFileWriter::Write(std::span<const uint8_t> data) {
+    while (!data.empty()) {
+        if (current_->size == CHUNK_SIZE) {
+            SubmitCurrent();
+        }
+        const size_t count = std::min(data.size(), CHUNK_SIZE - current_->size);
+        std::memcpy(current_->data.get() + current_->size, data.data(), count);
+        current_->size += count;
+        data = data.subspan(count);
+    }
+}
+
+void AsyncFileWriter::CopyFrom(int fd, uint64_t offset, uint64_t size) {
+    uint64_t done = 0;
+    // O_DIRECT требует выровненных позиций, поэтому данные идут через буферы записи.
+    if (cache_ != CachePolicy::DIRECT) {
+        SubmitCurrent();
+        while (queue_.InFlight() != 0) {
+            Complete(queue_.Wait());
+        }
+        done = KernelCopy(fd, offset, fd_, seekable_ ? offset_ : CURRENT_POSITION, size);
+        offset_ += done;
+        size_ += done;
+    }
+
+    // Остаток читается прямо в буферы записи.
+    while (done < size) {
+        if (current_->size == CHUNK_SIZE) {
+            SubmitCurrent();
+        }
+        const auto count = static_cast<size_t>(std::min<uint64_t>(size - done, CHUNK_SIZE - current_->size));
+        ReadFileRange(fd, std::span(current_->data.get() + current_->size, count), offset + done);
+        current_->size += count;
+        done += count;
+    }
+}
+
+void AsyncFileWriter::SubmitCurrent() {
+    if (current_->size == 0) {
+        return;
+    }
+    size_ += current_->size;
+    if (cache_ == CachePolicy::DIRECT && current_->size % IO_ALIGNMENT != 0) {
+        // Неполным бывает только последний фрагмент: он дополняется нулями, лишнее отрезается в Close.
+        const size_t aligned = (current_->size + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+        std::memset(current_->data.get() + current_->size, 0, aligned - current_->size);
+        current_->size = aligned;
+    }
+    current_->offset = offset_;
+    current_->pending = true;
+    queue_.SubmitWrite(fd_, std::span<const uint8_t>(current_->data.get(), current_->size),
+                       seekable_ ? offset_ : CURRENT_POSITION, static_cast<uint64_t>(current_ - chunks_.data()));
+    offset_ += current_->size;
+
+    current_ = current_ + 1 == chunks_.data() + chunks_.size() ? chunks_.data() : current_ + 1;
+    while (current_->pending) {
+        Complete(queue_.Wait());
+    }
+    current_->size = 0;
+}
+
+void AsyncFileWriter::Complete(const IoQueue::Completion& completion) {
+    Chunk& chunk = chunks_[completion.tag];
+    chunk.pending = false;
+    if (completion.result < 0) {
+        ThrowSystemError("Cannot write a file", static_cast<int>(-completion.result));
+    }
+    // Короткая запись (например, при нехватке места) дописывается синхронно, чтобы получить точную ошибку.
+    // Остаток может быть не выровнен, поэтому O_DIRECT для него снимается.
+    const auto written = static_cast<size_t>(completion.result);
+    if (written < chunk.size) {
+        if (cache_ == CachePolicy::DIRECT) {
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        }
+        const int64_t result =
+            SyncTransfer(OPCODE_WRITE, fd_, chunk.data.get() + written, chunk.size - written, chunk.offset + written);
+        if (result < 0) {
+            ThrowSystemError("Cannot write a file", static_cast<int>(-result));
+        }
+        if (static_cast<size_t>(result) < chunk.size - written) {
+            ThrowSystemError("Cannot write a file", EIO);
+        }
+    }
+    if (cache_ == CachePolicy::DROP_BEHIND) {
+        DropBehind(chunk);
+    }
+}
+
+void AsyncFileWriter::DropBehind(const Chunk& chunk) {
+    // Грязные страницы POSIX_FADV_DONTNEED не вытесняет. Запись фрагмента на диск начинается сразу,
+    // а вытесняется предыдущий записанный фрагмент: к этому моменту он обычно уже на диске, и ожидание
+    // не задерживает кодирование.
+    sync_file_range(fd_, static_cast<off_t>(chunk.offset), static_cast<off_t>(chunk.size), SYNC_FILE_RANGE_WRITE);
+    if (written_size_ != 0) {
+        const auto offset = static_cast<off_t>(written_offset_);
+        const auto size = static_cast<off_t>(written_size_);
+        sync_file_range(fd_, offset, size,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd_, offset, size, POSIX_FADV_DONTNEED);
+    }
+    written_offset_ = chunk.offset;
+    written_size_ = chunk.size;
+}
+
+void AsyncFileWriter::Close() {
+    if (fd_ < 0) {
+        return;
+    }
+    const int fd = fd_;
+    try {
+        SubmitCurrent();
+        while (queue_.InFlight() != 0) {
+            Complete(queue_.Wait());
+        }
+        if (offset_ != size_ && ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+            ThrowSystemError("Cannot write a file", errno);
+        }
+        if (cache_ == CachePolicy::DROP_BEHIND) {
+            sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    } catch (const std::ios_base::failure& exception) {
+        queue_.Drain();
+        fd_ = -1;
+        if (owns_fd_) {
+            close(fd);
+        }
+        throw;
+    }
+    fd_ = -1;
+    if (owns_fd_ && close(fd) != 0) {
+        ThrowSystemError("Cannot close a file", errno);
+    }
+}
+
+AsyncInputFile::AsyncInputFile(const std::string& filename, const IoOptions& options)
+    : std::istream(nullptr), buffer_(filename, options) {
+    rdbuf(&buffer_);
+}
+
+AsyncInputFile::AsyncInputFile(int fd, const IoOptions& options) : std::istream(nullptr), buffer_(fd, options) {
+    rdbuf(&buffer_);
+}
+
+AsyncInputFile::Buffer::Buffer(const std::string& filename, const IoOptions& options)
+    : reader_(filename, options), chunk_offset_(0) {
+}
+
+AsyncInputFile::Buffer::Buffer(int fd, const IoOptions& options) : reader_(fd, options), chunk_offset_(0) {
+}
+
+AsyncInputFile::Buffer::int_type AsyncInputFile::Buffer::underflow() {
+    if (gptr() != egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    chunk_offset_ += static_cast<uint64_t>(egptr() - eback());
+    const auto chunk = reader_.Next();
+    // Буфер фрагмента принадлежит читателю; streambuf требует неконстантный указатель, но не пишет в него.
+    auto* begin = reinterpret_cast<char*>(const_cast<uint8_t*>(chunk.data()));
+    setg(begin, begin, begin + chunk.size());
+    return chunk.empty() ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+AsyncInputFile::Buffer::pos_type AsyncInputFile::Buffer::seekoff(off_type offset, std::ios_base::seekdir direction,
+                                                                 std::ios_base::openmode mode) {
+    const auto current = static_cast<off_type>(chunk_offset_) + (gptr() - eback());
+    off_type target = offset;
+    if (direction == std::ios_base::cur) {
+        target += current;
+    } else if (direction == std::ios_base::end) {
+        target += static_cast<off_type>(reader_.Size());
+    }
+    if ((mode & std::ios_base::in) == 0 || target < 0) {
+        return pos_type(off_type(-1));
+    }
+    if (target == current) {
+        return pos_type(target);
+    }
+
+    // Внутри текущего фрагмента перемещается только указатель, иначе чтение начинается заново.
+    const auto chunk_begin = static_cast<off_type>(chunk_offset_);
+    if (target >= chunk_begin && target <= chunk_begin + (egptr() - eback())) {
+        setg(eback(), eback() + (target - chunk_begin), egptr());
+    } else {
+        reader_.Seek(static_cast<uint64_t>(target));
+        chunk_offset_ = static_cast<uint64_t>(target);
+        setg(nullptr, nullptr, nullptr);
+    }
+    return pos_type(target);
+}
+
+AsyncInputFile::Buffer::pos_type AsyncInputFile::Buffer::seekpos(pos_type position, std::ios_base::openmode mode) {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
+MappedOutputFile::MappedOutputFile(const std::string& filename, uint64_t size)
+    : std::ostream(nullptr), buffer_(filename, size) {
+    rdbuf(&buffer_);
+    exceptions(std::ios_base::badbit);
+}
+
+void MappedOutputFile::Skip(uint64_t size) {
+    buffer_.Skip(size);
+}
+
+void MappedOutputFile::Close() {
+    buffer_.Close();
+}
+
+MappedOutputFile::Buffer::Buffer(const std::string& filename, uint64_t size)
+    : fd_(open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+      expected_size_(size),
+      window_offset_(0),
+      window_size_(0),
+      window_(nullptr),
+      buffer_() {
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot open " + filename, errno);
+    }
+}
+
+MappedOutputFile::Buffer::~Buffer() {
+    try {
+        Close();
+    } catch (const std::ios_base::failure& exception) {
+    }
+}
+
+uint64_t MappedOutputFile::Buffer::Position() const {
+    return window_offset_ + static_cast<uint64_t>(pptr() - pbase());
+}
+
+void MappedOutputFile::Buffer::ReleaseWindow() {
+    if (window_ != nullptr) {
+        munmap(window_, window_size_);
+        window_ = nullptr;
+    }
+}
+
+void MappedOutputFile::Buffer::NextWindow() {
+    const uint64_t offset = Position();
+    if (!buffer_.empty()) {
+        const auto size = static_cast<size_t>(offset - window_offset_);
+        const int64_t result = SyncTransfer(OPCODE_WRITE, fd_, reinterpret_cast<const uint8_t*>(buffer_.data()),
+                                            size, window_offset_);
+        if (result < 0 || static_cast<size_t>(result) < size) {
+            ThrowSystemError("Cannot write a file", result < 0 ? static_cast<int>(-result) : EIO);
+        }
+        window_offset_ = offset;
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return;
+    }
+
+    ReleaseWindow();
+    // Окна начинаются с границ MIN_WINDOW_SIZE, как того требует mmap (после Skip - с ближайшей слева),
+    // и кратны MIN_WINDOW_SIZE; лишнее обрезает Close.
+    const uint64_t begin = offset / MIN_WINDOW_SIZE * MIN_WINDOW_SIZE;
+    size_t size = std::clamp<size_t>(window_size_ * 2, MIN_WINDOW_SIZE, MAX_WINDOW_SIZE);
+    if (expected_size_ > offset) {
+        size = static_cast<size_t>(std::min<uint64_t>(expected_size_ - begin, MAX_WINDOW_SIZE));
+        size = (size + MIN_WINDOW_SIZE - 1) / MIN_WINDOW_SIZE * MIN_WINDOW_SIZE;
+    }
+    window_offset_ = begin;
+    window_size_ = size;
+
+    if (fallocate(fd_, 0, static_cast<off_t>(offset), static_cast<off_t>(begin + size - offset)) != 0) {
+        if (errno != EOPNOTSUPP) {
+            ThrowSystemError("Cannot allocate space for a file", errno);
+        }
+        // Запись в отображение файла без выделенного места при нехватке диска завершилась бы сигналом.
+        window_offset_ = offset;
+        buffer_.resize(BUFFER_SIZE);
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return;
+    }
+    void* window = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                        static_cast<off_t>(begin));
+    if (window == MAP_FAILED) {
+        ThrowSystemError("Cannot map a file", errno);
+    }
+    window_ = static_cast<char*>(window);
+    setp(window_, window_ + size);
+    pbump(static_cast<int>(offset - begin));
+}
+
+void MappedOutputFile::Buffer::Skip(uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+    const uint64_t offset = Position();
+    if (!buffer_.empty()) {
+        NextWindow();
+        window_offset_ = offset + size;
+        return;
+    }
+
+    // Остаток окна уже выделен fallocate. Если дыры не поддерживаются, там остаются нули, что тоже верно.
+    const bool mapped = window_ != nullptr;
+    const uint64_t window_end = window_offset_ + window_size_;
+    ReleaseWindow();
+    setp(nullptr, nullptr);
+    if (mapped && window_end > offset) {
+        const uint64_t end = std::min(window_end, offset + size);
+        if (fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                      static_cast<off_t>(end - offset)) != 0 &&
+            errno != EOPNOTSUPP) {
+            ThrowSystemError("Cannot punch a hole in a file", errno);
+        }
+    }
+    window_offset_ = offset + size;
+    // Данные после дыры снова получают небольшие окна, чтобы не выделять место под следующую дыру.
+    window_size_ = 0;
+}
+
+MappedOutputFile::Buffer::int_type MappedOutputFile::Buffer::overflow(int_type ch) {
+    NextWindow();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+void MappedOutputFile::Buffer::Close() {
+    if (fd_ < 0) {
+        return;
+    }
+    const int fd = fd_;
+    const uint64_t size = Position();
+    try {
+        if (!buffer_.empty() && size != window_offset_) {
+            NextWindow();
+        }
+    } catch (const std::ios_base::failure& exception) {
+        fd_ = -1;
+        close(fd);
+        throw;
+    }
+    ReleaseWindow();
+    setp(nullptr, nullptr);
+    fd_ = -1;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        const int error = errno;
+        close(fd);
+        ThrowSystemError("Cannot write a file", error);
+    }
+    if (close(fd) != 0) {
+        ThrowSystemError("Cannot close a file", errno);
+    }
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Очередь асинхронных чтений и записей файлов. Если ядро поддерживает io_uring, операции ставятся в его
+ * кольцо напрямую системными вызовами, и одновременно выполняются до Depth() операций. Иначе (старое ядро,
+ * io_uring запрещен в контейнере) операции по порядку выполняет фоновый поток через pread/pwrite. В обоих
+ * случаях ввод-вывод идет параллельно с вычислениями вызывающего потока.
+ */
+class IoQueue {
+public:
+    static constexpr size_t DEFAULT_DEPTH = 8;
+
+    struct Completion {
+        uint64_t tag;
+        /// Количество прочитанных или записанных байт, при ошибке - минус errno.
+        int64_t result;
+    };
+
+    /// @param use_io_uring false - всегда использовать фоновый поток.
+    explicit IoQueue(size_t depth = DEFAULT_DEPTH, bool use_io_uring = true);
+    ~IoQueue();
+
+    IoQueue(const IoQueue&) = delete;
+    IoQueue& operator=(const IoQueue&) = delete;
+
+    bool UsesIoUring() const;
+    size_t Depth() const;
+    size_t InFlight() const;
+
+    /// @brief Поставить операцию в очередь. Буфер должен жить до получения ее результата, в очереди должно
+    /// быть меньше Depth() операций.
+    void SubmitRead(int fd, std::span<uint8_t> buffer, uint64_t offset, uint64_t tag);
+    void SubmitWrite(int fd, std::span<const uint8_t> buffer, uint64_t offset, uint64_t tag);
+
+    /// @brief Дождаться завершения одной из операций.
+    Completion Wait();
+
+    /// @brief Дождаться завершения всех операций, их результаты отбрасываются.
+    void Drain();
+
+private:
+    struct Ring;
+    struct Worker;
+
+    size_t depth_;
+    size_t in_flight_;
+    std::unique_ptr<Ring> ring_;
+    std::unique_ptr<Worker> worker_;
+
+    void Submit(uint8_t opcode, int fd, const uint8_t* buffer, size_t size, uint64_t offset, uint64_t tag);
+};
+
+/// @brief Как чтение и запись файлов используют page cache.
+enum class CachePolicy {
+    /// Решения оставлены ядру.
+    NORMAL,
+    /// Подсказки POSIX_FADV_SEQUENTIAL для всего файла и POSIX_FADV_WILLNEED для фрагментов за кольцом
+    /// буферов: ядро читает с большим упреждением.
+    SEQUENTIAL,
+    /// Как SEQUENTIAL, но обработанные фрагменты вытесняются из кэша (POSIX_FADV_DONTNEED), а записанные
+    /// сразу отправляются на диск: архивирование больших объемов не вытесняет данные других процессов.
+    DROP_BEHIND,
+    /// O_DIRECT: данные идут между диском и выровненными буферами в обход кэша. Если файловая система
+    /// не поддерживает O_DIRECT, используется DROP_BEHIND.
+    DIRECT,
+};
+
+struct IoOptions {
+    /// Количество фрагментов, которые читаются или записываются одновременно.
+    size_t depth = IoQueue::DEFAULT_DEPTH;
+    /// false - всегда использовать фоновый поток вместо io_uring.
+    bool use_io_uring = true;
+    CachePolicy cache = CachePolicy::NORMAL;
+};
+
+/// @brief Выравнивание буферов, позиций и длин операций, которого требует O_DIRECT.
+inline constexpr size_t IO_ALIGNMENT = 4096;
+
+struct AlignedDeleter {
+    void operator()(uint8_t* pointer) const;
+};
+
+/// @brief Буфер, выровненный по IO_ALIGNMENT.
+using AlignedBuffer = std::unique_ptr<uint8_t[], AlignedDeleter>;
+
+AlignedBuffer MakeAlignedBuffer(size_t size);
+
+/// @brief Прочитать buffer.size() байт файла с позиции offset. Ошибки и конец файла раньше времени бросаются
+/// как std::ios_base::failure.
+void ReadFileRange(int fd, std::span<uint8_t> buffer, uint64_t offset);
+
+/// @brief Записать все данные в текущую позицию дескриптора. Ошибки бросаются как std::ios_base::failure.
+void WriteAll(int fd, std::span<const uint8_t> data);
+
+/// @brief Записать head и сразу за ним tail одним вызовом writev, досылая остаток после частичной записи.
+/// Ошибки бросаются как std::ios_base::failure.
+void WriteAll(int fd, std::span<const uint8_t> head, std::span<const uint8_t> tail);
+
+/// @brief Дождаться, пока записанные данные файла дойдут до носителя (fdatasync). Для каналов и терминалов
+/// ничего не делает. Ошибки бросаются как std::ios_base::failure.
+void SyncFile(int fd);
+
+/// @brief Участок файла.
+struct FileRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+/// @brief Размер файла и его участки с данными по возрастанию; остальное - дыры, которые читаются как нули.
+struct FileLayout {
+    uint64_t size;
+    std::vector<FileRange> data;
+
+    uint64_t DataSize() const;
+};
+
+/// @brief Найти участки обычного файла с данными через SEEK_DATA и SEEK_HOLE. Если файловая система дыр
+/// не различает, данными считается весь файл. Ошибки бросаются как std::ios_base::failure.
+FileLayout ReadFileLayout(const std::string& filename);
+
+/**
+ * @brief Последовательное чтение обычного файла фрагментами по CHUNK_SIZE, пока обрабатывается один фрагмент,
+ * следующие уже читаются. Ошибки ввода-вывода бросаются как std::ios_base::failure.
+ */
+class AsyncFileReader {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 18;
+
+    explicit AsyncFileReader(const std::string& filename, const IoOptions& options = {});
+    /// @brief Последовательное чтение открытого дескриптора, например канала стандартного ввода. Дескриптор
+    /// закрывает вызывающий, Seek не поддерживается, операции выполняет фоновый поток, а options.cache
+    /// не действует.
+    explicit AsyncFileReader(int fd, const IoOptions& options = {});
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    /// @brief Является ли файл обычным: только такие файлы можно читать с произвольного места.
+    static bool IsRegularFile(const std::string& filename);
+
+    /// @brief Размер файла при открытии. Размер канала известен только после чтения последнего фрагмента,
+    /// до этого - максимальное значение uint64_t.
+    uint64_t Size() const;
+
+    /// @brief Следующий фрагмент файла, пустой - в конце файла. Действителен до следующего вызова Next или Seek.
+    std::span<const uint8_t> Next();
+
+    /// @brief Продолжить чтение с позиции offset.
+    void Seek(uint64_t offset);
+
+    /// @brief Передать size байт после последнего фрагмента, возвращенного Next, в текущую позицию fd и
+    /// продолжить чтение за ними. Данные передает ядро, как в AsyncFileWriter::CopyFrom.
+    /// @return false, если ничего не передано: файл нельзя читать с произвольного места, он открыт с O_DIRECT
+    /// или в нем меньше size байт.
+    bool CopyTo(int fd, uint64_t size);
+
+private:
+    struct Chunk {
+        AlignedBuffer data;
+        uint64_t offset;
+        int64_t result;
+        bool pending;
+    };
+
+    int fd_;
+    bool owns_fd_;
+    /// false - файл читается read с текущей позиции.
+    bool seekable_;
+    CachePolicy cache_;
+    uint64_t size_;
+    std::vector<Chunk> chunks_;
+    /// Фрагмент, который вернет следующий вызов Next.
+    size_t head_;
+    /// Фрагмент, возвращенный последним вызовом Next: его буфер можно переиспользовать только при следующем вызове.
+    bool head_returned_;
+    uint64_t next_offset_;
+    /// Сколько байт в начале следующего фрагмента пропустить: с O_DIRECT чтение начинается с выровненной позиции.
+    size_t skip_;
+    IoQueue queue_;
+
+    void SubmitChunk(Chunk& chunk);
+    void ReleaseChunk(Chunk& chunk);
+    void Restart(uint64_t offset);
+};
+
+/**
+ * @brief Последовательная запись файла: данные копируются в буфер CHUNK_SIZE, заполненный буфер отправляется
+ * на запись, и запись продолжается в следующий свободный. Ошибки ввода-вывода бросаются как std::ios_base::failure.
+ */
+class AsyncFileWriter {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 18;
+
+    explicit AsyncFileWriter(const std::string& filename, const IoOptions& options = {});
+    /// @brief Последовательная запись в открытый дескриптор, например в канал стандартного вывода.
+    /// Дескриптор закрывает вызывающий, операции выполняет фоновый поток, а options.cache не действует.
+    explicit AsyncFileWriter(int fd, const IoOptions& options = {});
+    /// @brief Дописывает данные, но ошибки записи при этом теряются; чтобы их увидеть, нужно вызвать Close.
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    void Write(std::span<const uint8_t> data);
+
+    /// @brief Дописать size байт файла fd с позиции offset. Данные передает ядро через copy_file_range (или
+    /// sendfile, если файловые системы разные или запись идет в канал), не копируя их в буферы процесса;
+    /// с O_DIRECT и если ядро не умеет передавать данные между этими файлами, они идут через буферы записи.
+    void CopyFrom(int fd, uint64_t offset, uint64_t size);
+
+    void Put(uint8_t byte) {
+        if (current_->size == CHUNK_SIZE) {
+            SubmitCurrent();
+        }
+        current_->data[current_->size++] = byte;
+    }
+
+    /// @brief Дождаться записи всех данных и закрыть файл.
+    void Close();
+
+private:
+    struct Chunk {
+        AlignedBuffer data;
+        size_t size;
+        uint64_t offset;
+        bool pending;
+    };
+
+    int fd_;
+    bool owns_fd_;
+    /// false - данные пишутся write в текущую позицию.
+    bool seekable_;
+    CachePolicy cache_;
+    std::vector<Chunk> chunks_;
+    Chunk* current_;
+    /// Позиция следующей записи; с O_DIRECT последний фрагмент дополняется до выровненной длины.
+    uint64_t offset_;
+    /// Размер записанных данных без дополнения.
+    uint64_t size_;
+    /// Записанный фрагмент, который DROP_BEHIND вытеснит из кэша при завершении записи следующего.
+    uint64_t written_offset_;
+    size_t written_size_;
+    IoQueue queue_;
+
+    void SubmitCurrent();
+    void Complete(const IoQueue::Completion& completion);
+    void DropBehind(const Chunk& chunk);
+};
+
+/**
+ * @brief Поток чтения файла поверх AsyncFileReader с поддержкой seekg и tellg (кодировщик проходит по файлу
+ * несколько раз).
+ */
+class AsyncInputFile : public std::istream {
+public:
+    explicit AsyncInputFile(const std::string& filename, const IoOptions& options = {});
+    /// @brief Поток чтения открытого дескриптора, см. AsyncFileReader(int, const IoOptions&).
+    explicit AsyncInputFile(int fd, const IoOptions& options = {});
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer(const std::string& filename, const IoOptions& options);
+        Buffer(int fd, const IoOptions& options);
+
+    protected:
+        int_type underflow() override;
+        pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+        pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+    private:
+        AsyncFileReader reader_;
+        /// Позиция в файле начала текущего фрагмента.
+        uint64_t chunk_offset_;
+    };
+
+    Buffer buffer_;
+};
+
+/**
+ * @brief Поток записи файла прямо в отображенную в память область. Место выделяется fallocate окнами: если
+ * размер содержимого известен, окна покрывают его целиком (не больше MAX_WINDOW_SIZE за раз), и файл ложится
+ * на диск непрерывно; иначе окна растут вдвое от MIN_WINDOW_SIZE. Неверный размер из поврежденного архива
+ * поэтому занимает лишнее место не дольше, чем до закрытия файла. Если файловая система не поддерживает
+ * fallocate, данные пишутся через буфер. Ошибки бросаются как std::ios_base::failure.
+ */
+class MappedOutputFile : public std::ostream {
+public:
+    static constexpr size_t MIN_WINDOW_SIZE = 1 << 16;
+    static constexpr size_t MAX_WINDOW_SIZE = 1 << 24;
+
+    /// @param size ожидаемый размер содержимого, 0 - неизвестен.
+    explicit MappedOutputFile(const std::string& filename, uint64_t size = 0);
+
+    /// @brief Пропустить size байт: они остаются дырой, которую Close при необходимости продлевает до конца файла.
+    /// Место, уже выделенное под них вместе с окном, освобождается FALLOC_FL_PUNCH_HOLE.
+    void Skip(uint64_t size);
+
+    /// @brief Обрезать файл до записанного размера и закрыть его. Без вызова Close это делает деструктор,
+    /// но ошибки при этом теряются.
+    void Close();
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer(const std::string& filename, uint64_t size);
+        ~Buffer() override;
+
+        void Skip(uint64_t size);
+        void Close();
+
+    protected:
+        int_type overflow(int_type ch) override;
+
+    private:
+        static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+        int fd_;
+        uint64_t expected_size_;
+        /// Позиция в файле начала текущего окна или буфера.
+        uint64_t window_offset_;
+        size_t window_size_;
+        char* window_;
+        /// Непустой, если fallocate не поддерживается: данные копятся в нем и пишутся pwrite.
+        std::vector<char> buffer_;
+
+        uint64_t Position() const;
+        void NextWindow();
+        void ReleaseWindow();
+    };
+
+    Buffer buffer_;
+};
@@ -0,0 +1,194 @@
+#include "../bitstream_reader.hpp"
+#include "../bitstream_writer.hpp"
+#include "../codec.hpp"
+#include "../huffman.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Сравнение порядков бит на кодах Хаффмана: запись кодов, декодирование из памяти и из потока. Затем запись
+// в файл через BitWriterStream: по байту в ofstream или в дескриптор, как раньше, и через большой буфер.
+// В конце - каждый кодек CodecRegistry::Default() отдельно от архива: блоками Codec::BLOCK_SIZE в памяти.
+
+namespace {
+
+constexpr size_t CONTENT_SIZE = 16 << 20;
+constexpr size_t ALPHABET_SIZE = 256;
+
+/// @brief Байты с геометрическим распределением, примерно 5 бит энтропии на байт, как у текста.
+std::vector<uint8_t> MakeContent() {
+    std::mt19937 generator(2024);
+    std::geometric_distribution<size_t> distribution(0.05);
+    std::vector<uint8_t> content(CONTENT_SIZE);
+    for (uint8_t& byte : content) {
+        byte = static_cast<uint8_t>(distribution(generator) % ALPHABET_SIZE);
+    }
+    return content;
+}
+
+template <class F>
+double MeasureSpeed(F&& function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(CONTENT_SIZE) / elapsed.count() / (1 << 20);
+}
+
+/// @brief Записать содержимое писателем writer по байту через WriteInt и закрыть его. В порядке LSB_FIRST
+/// WriteInt не перебирает биты, и каждый байт - один WriteWord.
+double MeasureFileSpeed(const std::vector<uint8_t>& content, BitWriterStream& writer) {
+    writer.SetBitOrder(BitOrder::LSB_FIRST);
+    return MeasureSpeed([&] {
+        for (uint8_t byte : content) {
+            writer.WriteInt(byte, 8);
+        }
+        writer.Close();
+    });
+}
+
+void CheckDecoded(const std::vector<uint8_t>& decoded, const std::vector<uint8_t>& content) {
+    if (decoded != content) {
+        throw std::logic_error("Decoded content differs from the source.");
+    }
+}
+
+/// @brief Закодировать содержимое блоками кодека codec и декодировать обратно, напечатать скорости и размер
+/// закодированных данных относительно исходных вместе с оценкой Codec::Estimate.
+void MeasureCodec(const Codec& codec, const std::vector<uint8_t>& content) {
+    const auto blocks = [&](auto&& process) {
+        for (size_t offset = 0; offset < content.size(); offset += Codec::BLOCK_SIZE) {
+            process(std::span(content).subspan(offset, std::min(Codec::BLOCK_SIZE, content.size() - offset)));
+        }
+    };
+
+    double estimated_bits = 0;
+    blocks([&](std::span<const uint8_t> block) { estimated_bits += codec.Estimate(SampleEstimate::FromBlock(block)); });
+
+    BitWriterU8 writer;
+    writer.SetBitOrder(BitOrder::LSB_FIRST);
+    const double encode_speed = MeasureSpeed([&] {
+        blocks([&](std::span<const uint8_t> block) { codec.EncodeBlock(block, writer); });
+        writer.Close();
+    });
+
+    std::vector<uint8_t> decoded(content.size());
+    BitReaderU8 reader(writer.Data());
+    reader.SetBitOrder(BitOrder::LSB_FIRST);
+    const double decode_speed = MeasureSpeed([&] {
+        for (size_t offset = 0; offset < decoded.size(); offset += Codec::BLOCK_SIZE) {
+            codec.DecodeBlock(reader, std::span(decoded).subspan(offset, std::min(Codec::BLOCK_SIZE,
+                                                                                  decoded.size() - offset)));
+        }
+    });
+    CheckDecoded(decoded, content);
+
+    const auto source_bits = static_cast<double>(content.size() * 8);
+    std::cout << std::setw(14) << codec.Name() << std::fixed << std::setprecision(1) << std::setw(12) << encode_speed
+              << std::setw(12) << decode_speed << std::setprecision(3) << std::setw(10)
+              << static_cast<double>(writer.Data().size() * 8) / source_bits << std::setw(10)
+              << estimated_bits / source_bits << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    const auto content = MakeContent();
+    std::vector<size_t> frequencies(ALPHABET_SIZE, 0);
+    for (uint8_t byte : content) {
+        ++frequencies[byte];
+    }
+    const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    const HuffmanDecoder decoder(code);
+
+    std::cout << std::setw(10) << "order" << std::setw(12) << "write" << std::setw(12) << "read u8" << std::setw(12)
+              << "read stream" << "  (MiB/s)" << std::endl;
+    for (BitOrder order : {BitOrder::MSB_FIRST, BitOrder::LSB_FIRST}) {
+        BitWriterU8 writer;
+        writer.SetBitOrder(order);
+        const double write_speed = MeasureSpeed([&] {
+            for (uint8_t byte : content) {
+                for (bool bit : code.GetCode(byte)) {
+                    writer.WriteBit(bit);
+                }
+            }
+            writer.Close();
+        });
+
+        std::vector<uint8_t> decoded(CONTENT_SIZE);
+        BitReaderU8 reader(writer.Data());
+        reader.SetBitOrder(order);
+        const double read_speed = MeasureSpeed([&] {
+            for (uint8_t& byte : decoded) {
+                byte = static_cast<uint8_t>(decoder.ReadSymbol(reader));
+            }
+        });
+        CheckDecoded(decoded, content);
+
+        BitReaderStream stream_reader(std::make_unique<std::istringstream>(
+            std::string(reinterpret_cast<const char*>(writer.Data().data()), writer.Data().size())));
+        stream_reader.SetBitOrder(order);
+        const double stream_speed = MeasureSpeed([&] {
+            for (uint8_t& byte : decoded) {
+                byte = static_cast<uint8_t>(decoder.ReadSymbol(stream_reader));
+            }
+        });
+        CheckDecoded(decoded, content);
+
+        std::cout << std::setw(10) << (order == BitOrder::MSB_FIRST ? "msb" : "lsb") << std::fixed
+                  << std::setprecision(1) << std::setw(12) << write_speed << std::setw(12) << read_speed
+                  << std::setw(12) << stream_speed << std::endl;
+    }
+
+    const auto path = (std::filesystem::temp_directory_path() / "archiver_bench_bitstream").string();
+    const auto open_stream = [&] {
+        auto stream = std::make_unique<std::ofstream>();
+        stream->exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        stream->open(path, std::ios::binary);
+        return stream;
+    };
+    std::cout << std::endl << std::setw(24) << "file sink" << std::setw(12) << "write" << "  (MiB/s)" << std::endl;
+    const auto report = [](const char* name, double speed) {
+        std::cout << std::setw(24) << name << std::fixed << std::setprecision(1) << std::setw(12) << speed
+                  << std::endl;
+    };
+    {
+        // Буфер в один байт повторяет прежнюю запись: ostream::write на каждый байт.
+        BitWriterStream writer(open_stream(), 1);
+        report("ofstream, per byte", MeasureFileSpeed(content, writer));
+    }
+    {
+        BitWriterStream writer(open_stream());
+        report("ofstream, 1 MiB buffer", MeasureFileSpeed(content, writer));
+    }
+    {
+        BitWriterStream writer(path, 1);
+        report("fd, per byte", MeasureFileSpeed(content, writer));
+    }
+    {
+        BitWriterStream writer(path);
+        report("fd, 1 MiB buffer", MeasureFileSpeed(content, writer));
+    }
+    {
+        BitWriterStream writer(path);
+        const double speed = MeasureSpeed([&] {
+            writer.WriteBytes(content);
+            writer.Close();
+        });
+        report("fd, WriteBytes", speed);
+    }
+    std::filesystem::remove(path);
+
+    std::cout << std::endl << std::setw(14) << "codec" << std::setw(12) << "encode" << std::setw(12) << "decode"
+              << "  (MiB/s)" << std::setw(10) << "ratio" << std::setw(10) << "estimate" << std::endl;
+    for (const auto& codec : CodecRegistry::Default().Codecs()) {
+        MeasureCodec(*codec, content);
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+/// @brief Порядок бит внутри слов потока.
+enum class BitOrder {
+    /// Первый бит слова - старший, числа записываются старшими битами вперед. Порядок по умолчанию.
+    MSB_FIRST,
+    /// Первый бит слова - младший, числа записываются младшими битами вперед (как в deflate). Коды
+    /// Хаффмана при этом оказываются в слове перевернутыми, зато буфер читателя пополняется сразу
+    /// несколькими словами, а следующие биты извлекаются маской.
+    LSB_FIRST,
+};
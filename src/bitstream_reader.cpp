@@ -1,10 +1,39 @@
 #include "bitstream_reader.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+constexpr size_t BIT_COUNT = sizeof(size_t) * CHAR_BIT;
+
+size_t LowBits(size_t value, size_t count) {
+    return count >= BIT_COUNT ? value : value & ((size_t{1} << count) - 1);
+}
+
+/// @brief Собрать до sizeof(size_t) байт в число, первый байт - младший.
+size_t LoadLittleEndian(const uint8_t* data, size_t size) {
+    size_t value = 0;
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(&value, data, size);
+    } else {
+        for (size_t i = 0; i < size; ++i) {
+            value |= size_t{data[i]} << (i * CHAR_BIT);
+        }
+    }
+    return value;
+}
+
+}  // namespace
+
 const char* BitReader::ReadException::what() const noexcept {
     return "Cannot read another byte";
 }
 
-BitReader::BitReader() : buffer_(0), current_pos_(0) {
+BitReader::BitReader() : buffer_(0), current_pos_(0), order_(BitOrder::MSB_FIRST) {
 }
 
 size_t BitReader::GetBase() const {
@@ -15,8 +44,53 @@ bool BitReader::ReadWord(size_t& output) {
     return false;
 }
 
+size_t BitReader::ReadWords(size_t& output, size_t count) {
+    output = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t word = 0;
+        if (!ReadWord(word)) {
+            return i;
+        }
+        output |= word << (i * GetBase());
+    }
+    return count;
+}
+
+void BitReader::Refill() {
+    // Непрочитанные биты - младшие current_pos_ бит буфера, старшие биты нулевые.
+    const size_t count = (BIT_COUNT - current_pos_) / GetBase();
+    if (count == 0) {
+        return;
+    }
+    size_t words = 0;
+    const size_t read = ReadWords(words, count);
+    buffer_ |= words << current_pos_;
+    current_pos_ += read * GetBase();
+}
+
+void BitReader::DropBits(size_t count) {
+    buffer_ = count >= BIT_COUNT ? 0 : buffer_ >> count;
+    current_pos_ -= count;
+}
+
 bool BitReader::ReadInt(size_t& output, size_t size) {
     output = 0;
+    if (order_ == BitOrder::LSB_FIRST) {
+        for (size_t done = 0; done < size;) {
+            if (current_pos_ < size - done) {
+                Refill();
+            }
+            const size_t count = std::min(size - done, current_pos_);
+            if (count == 0) {
+                return false;
+            }
+            output |= LowBits(buffer_, count) << done;
+            DropBits(count);
+            done += count;
+        }
+        return true;
+    }
+
     for (size_t i = 0; i < size; ++i) {
         output <<= 1;
         bool bit = false;
@@ -31,6 +105,18 @@ bool BitReader::ReadInt(size_t& output, size_t size) {
 }
 
 bool BitReader::ReadBit(bool& output) {
+    if (order_ == BitOrder::LSB_FIRST) {
+        if (current_pos_ == 0) {
+            Refill();
+            if (current_pos_ == 0) {
+                return false;
+            }
+        }
+        output = buffer_ & 1;
+        DropBits(1);
+        return true;
+    }
+
     if (current_pos_ == 0) {
         if (!ReadWord(buffer_)) {
             return false;
@@ -59,6 +145,114 @@ size_t BitReader::ReadInt(size_t size) {
     return value;
 }
 
+size_t BitReader::PeekBits(size_t count) {
+    if (order_ == BitOrder::LSB_FIRST) {
+        if (current_pos_ < count) {
+            Refill();
+        }
+        return LowBits(buffer_, count);
+    }
+
+    // Непрочитанные биты - младшие current_pos_ бит буфера, новое слово дописывается справа.
+    while (current_pos_ < count) {
+        size_t word = 0;
+        if (!ReadWord(word)) {
+            return (buffer_ << (count - current_pos_)) & ((size_t{1} << count) - 1);
+        }
+        buffer_ = (buffer_ << GetBase()) | word;
+        current_pos_ += GetBase();
+    }
+    return (buffer_ >> (current_pos_ - count)) & ((size_t{1} << count) - 1);
+}
+
+void BitReader::SkipBits(size_t count) {
+    if (count > current_pos_) {
+        throw ReadException();
+    }
+    if (order_ == BitOrder::LSB_FIRST) {
+        DropBits(count);
+    } else {
+        current_pos_ -= count;
+    }
+}
+
+void BitReader::AlignToWord() {
+    // Остаток текущего слова - первые непрочитанные биты: старшие в порядке MSB_FIRST, младшие в LSB_FIRST.
+    const size_t base = GetBase();
+    if (order_ == BitOrder::LSB_FIRST) {
+        DropBits(current_pos_ % base);
+    } else {
+        current_pos_ -= current_pos_ % base;
+    }
+}
+
+void BitReader::ReadBytes(std::span<uint8_t> bytes) {
+    AlignToWord();
+    // Сначала - целые байты, уже считанные в буфер битов.
+    size_t done = 0;
+    for (; done < bytes.size() && current_pos_ >= CHAR_BIT; ++done) {
+        bytes[done] = static_cast<uint8_t>(ReadInt(CHAR_BIT));
+    }
+    if (done < bytes.size()) {
+        ReadRawBytes(bytes.subspan(done));
+    }
+}
+
+void BitReader::CopyBytes(int fd, uint64_t size) {
+    AlignToWord();
+    std::array<uint8_t, sizeof(size_t)> buffered{};
+    size_t count = 0;
+    for (; count < size && current_pos_ >= CHAR_BIT; ++count) {
+        buffered[count] = static_cast<uint8_t>(ReadInt(CHAR_BIT));
+    }
+    WriteAll(fd, std::span(buffered).first(count));
+    if (count < size) {
+        CopyRawBytes(fd, size - count);
+    }
+}
+
+void BitReader::ReadRawBytes(std::span<uint8_t> bytes) {
+    for (uint8_t& byte : bytes) {
+        byte = static_cast<uint8_t>(ReadInt(CHAR_BIT));
+    }
+}
+
+void BitReader::CopyRawBytes(int fd, uint64_t size) {
+    std::vector<uint8_t> chunk(static_cast<size_t>(std::min<uint64_t>(size, AsyncFileReader::CHUNK_SIZE)));
+    while (size > 0) {
+        const auto part = std::span(chunk).first(static_cast<size_t>(std::min<uint64_t>(size, chunk.size())));
+        ReadRawBytes(part);
+        WriteAll(fd, part);
+        size -= part.size();
+    }
+}
+
+void BitReader::SetBitOrder(BitOrder order) {
+    if (order == order_) {
+        return;
+    }
+
+    AlignToWord();
+    const size_t base = GetBase();
+
+    // Уже считанные целые слова переставляются в раскладку нового порядка.
+    const size_t words_count = current_pos_ / base;
+    size_t buffer = 0;
+    for (size_t i = 0; i < words_count; ++i) {
+        if (order_ == BitOrder::MSB_FIRST) {
+            buffer |= LowBits(buffer_ >> ((words_count - 1 - i) * base), base) << (i * base);
+        } else {
+            buffer = (buffer << base) | LowBits(buffer_ >> (i * base), base);
+        }
+    }
+    buffer_ = buffer;
+    order_ = order;
+}
+
+BitOrder BitReader::GetBitOrder() const {
+    return order_;
+}
+
 BitReaderU8::BitReaderU8(const std::vector<uint8_t>& data) : BitReader(), data_(data), first_not_readed(0) {
 }
 
@@ -82,6 +276,13 @@ bool BitReaderU8::ReadWord(size_t& output) {
     return true;
 }
 
+size_t BitReaderU8::ReadWords(size_t& output, size_t count) {
+    const size_t read = std::min(count, data_.size() - first_not_readed);
+    output = LoadLittleEndian(data_.data() + first_not_readed, read);
+    first_not_readed += read;
+    return read;
+}
+
 BitReaderStream::BitReaderStream(std::unique_ptr<std::istream>&& is) : BitReader(), is_(std::move(is)) {
 }
 
@@ -94,4 +295,77 @@ bool BitReaderStream::ReadWord(size_t& output) {
     is_->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t));
     output = byte;
     return is_->good();
-}
\ No newline at end of file
+}
+
+size_t BitReaderStream::ReadWords(size_t& output, size_t count) {
+    uint8_t bytes[sizeof(size_t)];
+    is_->read(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(count));
+    const auto read = static_cast<size_t>(is_->gcount());
+    output = LoadLittleEndian(bytes, read);
+    return read;
+}
+
+BitReaderFile::BitReaderFile(const std::string& filename, const IoOptions& options)
+    : BitReader(), reader_(filename, options), chunk_(), position_(0) {
+}
+
+BitReaderFile::BitReaderFile(int fd, const IoOptions& options)
+    : BitReader(), reader_(fd, options), chunk_(), position_(0) {
+}
+
+size_t BitReaderFile::GetBase() const {
+    return 8;
+}
+
+bool BitReaderFile::NextChunk() {
+    chunk_ = reader_.Next();
+    position_ = 0;
+    return !chunk_.empty();
+}
+
+bool BitReaderFile::ReadWord(size_t& output) {
+    if (position_ == chunk_.size() && !NextChunk()) {
+        return false;
+    }
+    output = chunk_[position_++];
+    return true;
+}
+
+size_t BitReaderFile::ReadWords(size_t& output, size_t count) {
+    if (position_ + count > chunk_.size()) {
+        // Слова на границе фрагментов собираются по одному.
+        return BitReader::ReadWords(output, count);
+    }
+    output = LoadLittleEndian(chunk_.data() + position_, count);
+    position_ += count;
+    return count;
+}
+
+void BitReaderFile::ReadRawBytes(std::span<uint8_t> bytes) {
+    while (!bytes.empty()) {
+        if (position_ == chunk_.size() && !NextChunk()) {
+            throw ReadException();
+        }
+        const size_t count = std::min(bytes.size(), chunk_.size() - position_);
+        std::memcpy(bytes.data(), chunk_.data() + position_, count);
+        position_ += count;
+        bytes = bytes.subspan(count);
+    }
+}
+
+void BitReaderFile::CopyRawBytes(int fd, uint64_t size) {
+    // Уже прочитанная часть фрагмента записывается из него, остальное передает ядро.
+    const auto buffered = static_cast<size_t>(std::min<uint64_t>(size, chunk_.size() - position_));
+    WriteAll(fd, chunk_.subspan(position_, buffered));
+    position_ += buffered;
+    size -= buffered;
+    if (size == 0) {
+        return;
+    }
+    if (!reader_.CopyTo(fd, size)) {
+        BitReader::CopyRawBytes(fd, size);
+        return;
+    }
+    chunk_ = {};
+    position_ = 0;
+}
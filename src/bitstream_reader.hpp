@@ -1,9 +1,14 @@
 #pragma once
 
+#include "async_io.hpp"
+#include "bit_order.hpp"
+
+#include <cstdint>
 #include <istream>
 #include <vector>
 #include <istream>
 #include <memory>
+#include <span>
 
 class BitReader {
 public:
@@ -17,6 +22,33 @@ public:
     bool ReadBit();
     size_t ReadInt(size_t size);
 
+    /// Сколько бит можно просмотреть заранее с помощью PeekBits.
+    static constexpr size_t MAX_PEEK_BIT_COUNT = 8;
+
+    /// @brief Следующие count бит потока (не больше MAX_PEEK_BIT_COUNT) без продвижения по нему. В порядке
+    /// MSB_FIRST первый бит - старший, в порядке LSB_FIRST - младший. Биты за концом потока считаются нулевыми.
+    size_t PeekBits(size_t count);
+
+    /// @brief Пропустить count бит, уже просмотренных PeekBits. Бросает ReadException, если поток
+    /// закончился раньше.
+    void SkipBits(size_t count);
+
+    /// @brief Пропустить остаток текущего слова: следующий бит - первый бит нового слова (у потоков байтов - байта).
+    void AlignToWord();
+
+    /// @brief Считать байты, записанные BitWriter::WriteBytes, с границы слова. Бросает ReadException, если
+    /// поток закончился раньше.
+    void ReadBytes(std::span<uint8_t> bytes);
+
+    /// @brief Передать size байт, записанных BitWriter::WriteBytes, с границы слова в текущую позицию
+    /// дескриптора fd. Чтение файла передает их ядру без копирования через буферы процесса. Бросает
+    /// ReadException, если поток закончился раньше, ошибки записи - как std::ios_base::failure.
+    void CopyBytes(int fd, uint64_t size);
+
+    /// @brief Сменить порядок бит. Остаток текущего слова пропускается, следующий бит - первый бит нового слова.
+    void SetBitOrder(BitOrder order);
+    BitOrder GetBitOrder() const;
+
 protected:
     BitReader();
 
@@ -28,9 +60,27 @@ protected:
     /// @param word Слово, которое требуется считать из потока
     virtual bool ReadWord(size_t& output);
 
+    /// @brief Считать до count слов подряд, первое слово - в младших битах. Используется в порядке
+    /// LSB_FIRST, чтобы пополнять буфер одним обращением.
+    /// @return Количество считанных слов, меньше count только в конце потока.
+    virtual size_t ReadWords(size_t& output, size_t count);
+
+    /// @brief Считать байты с границы слова, когда в буфере битов ничего не осталось. По умолчанию - по 8 бит
+    /// через ReadInt.
+    virtual void ReadRawBytes(std::span<uint8_t> bytes);
+
+    /// @brief Передать байты с границы слова в fd, когда в буфере битов ничего не осталось. По умолчанию они
+    /// считываются ReadRawBytes и записываются write.
+    virtual void CopyRawBytes(int fd, uint64_t size);
+
 private:
     size_t buffer_;
     size_t current_pos_;
+    BitOrder order_;
+
+    /// @brief Дочитать в буфер столько целых слов, сколько в нем помещается (порядок LSB_FIRST).
+    void Refill();
+    void DropBits(size_t count);
 };
 
 class BitReaderU8 : public BitReader {
@@ -43,6 +93,7 @@ public:
 protected:
     size_t GetBase() const override;
     bool ReadWord(size_t& output) override;
+    size_t ReadWords(size_t& output, size_t count) override;
 
 private:
     std::vector<uint8_t> data_;
@@ -56,7 +107,30 @@ public:
 protected:
     size_t GetBase() const override;
     bool ReadWord(size_t& output) override;
+    size_t ReadWords(size_t& output, size_t count) override;
 
 private:
     std::unique_ptr<std::istream> is_;
-};
\ No newline at end of file
+};
+
+/// @brief Чтение обычного файла через AsyncFileReader: пока разбирается один фрагмент, следующие уже читаются.
+class BitReaderFile : public BitReader {
+public:
+    explicit BitReaderFile(const std::string& filename, const IoOptions& options = {});
+    /// @brief Чтение открытого дескриптора, например стандартного ввода.
+    explicit BitReaderFile(int fd, const IoOptions& options = {});
+
+protected:
+    size_t GetBase() const override;
+    bool ReadWord(size_t& output) override;
+    size_t ReadWords(size_t& output, size_t count) override;
+    void ReadRawBytes(std::span<uint8_t> bytes) override;
+    void CopyRawBytes(int fd, uint64_t size) override;
+
+private:
+    AsyncFileReader reader_;
+    std::span<const uint8_t> chunk_;
+    size_t position_;
+
+    bool NextChunk();
+};
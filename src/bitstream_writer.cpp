@@ -1,8 +1,31 @@
 #include "bitstream_writer.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <ios>
+#include <ostream>
 #include <stdexcept>
+#include <system_error>
 
-BitWriter::BitWriter() : buffer_(0), buffer_size_(0), closed_(false) {
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t BIT_COUNT = sizeof(size_t) * CHAR_BIT;
+
+int OpenOutputFile(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::ios_base::failure("Cannot open " + filename, std::error_code(errno, std::system_category()));
+    }
+    return fd;
+}
+
+}  // namespace
+
+BitWriter::BitWriter() : buffer_(0), buffer_size_(0), closed_(false), order_(BitOrder::MSB_FIRST) {
 }
 
 BitWriter::~BitWriter() {
@@ -14,12 +37,56 @@ void BitWriter::Close() {
         return;
     }
 
-    if (buffer_size_ != 0) {
+    FlushPartialWord();
+    closed_ = true;
+    Finish();
+}
+
+void BitWriter::FlushPartialWord() {
+    if (buffer_size_ == 0) {
+        return;
+    }
+
+    // В порядке LSB_FIRST старшие биты незаконченного слова и так нулевые.
+    if (order_ == BitOrder::MSB_FIRST) {
         WriteLastWord(buffer_, buffer_size_);
-        buffer_ = 0;
-        buffer_size_ = 0;
+    } else {
+        WriteWord(buffer_);
     }
-    closed_ = true;
+    buffer_ = 0;
+    buffer_size_ = 0;
+}
+
+void BitWriter::AlignToWord() {
+    FlushPartialWord();
+}
+
+void BitWriter::WriteBytes(std::span<const uint8_t> bytes) {
+    if (closed_) {
+        throw std::invalid_argument("Tried write bit to closed stream.");
+    }
+    FlushPartialWord();
+    WriteRawBytes(bytes);
+}
+
+void BitWriter::CopyBytes(int fd, uint64_t offset, uint64_t size) {
+    if (closed_) {
+        throw std::invalid_argument("Tried write bit to closed stream.");
+    }
+    FlushPartialWord();
+    CopyRawBytes(fd, offset, size);
+}
+
+void BitWriter::SetBitOrder(BitOrder order) {
+    if (order == order_) {
+        return;
+    }
+    FlushPartialWord();
+    order_ = order;
+}
+
+BitOrder BitWriter::GetBitOrder() const {
+    return order_;
 }
 
 bool BitWriter::Closed() const {
@@ -31,9 +98,10 @@ void BitWriter::WriteBit(bool bit) {
         throw std::invalid_argument("Tried write bit to closed stream.");
     }
 
-    buffer_ <<= 1;
-    if (bit) {
-        buffer_ |= 1;
+    if (order_ == BitOrder::MSB_FIRST) {
+        buffer_ = (buffer_ << 1) | static_cast<size_t>(bit);
+    } else {
+        buffer_ |= static_cast<size_t>(bit) << buffer_size_;
     }
     ++buffer_size_;
 
@@ -45,8 +113,30 @@ void BitWriter::WriteBit(bool bit) {
 }
 
 void BitWriter::WriteInt(size_t value, size_t size) {
-    for (size_t i = 0; i < size; ++i) {
-        WriteBit((value >> (size - i - 1)) & 1);
+    if (order_ == BitOrder::MSB_FIRST) {
+        for (size_t i = 0; i < size; ++i) {
+            WriteBit((value >> (size - i - 1)) & 1);
+        }
+        return;
+    }
+
+    if (closed_) {
+        throw std::invalid_argument("Tried write bit to closed stream.");
+    }
+    // Младшие биты числа дописываются над уже накопленными, слово выводится по заполнении.
+    while (size != 0) {
+        const size_t count = std::min(size, GetBase() - buffer_size_);
+        const size_t mask = count == BIT_COUNT ? ~size_t{0} : (size_t{1} << count) - 1;
+        buffer_ |= (value & mask) << buffer_size_;
+        buffer_size_ += count;
+        value = count == BIT_COUNT ? 0 : value >> count;
+        size -= count;
+
+        if (buffer_size_ == GetBase()) {
+            WriteWord(buffer_);
+            buffer_size_ = 0;
+            buffer_ = 0;
+        }
     }
 }
 
@@ -60,6 +150,26 @@ void BitWriter::WriteWord(size_t word) {
 void BitWriter::WriteLastWord(size_t word, size_t count) {
 }
 
+void BitWriter::Finish() {
+}
+
+void BitWriter::WriteRawBytes(std::span<const uint8_t> bytes) {
+    for (uint8_t byte : bytes) {
+        WriteInt(byte, CHAR_BIT);
+    }
+}
+
+void BitWriter::CopyRawBytes(int fd, uint64_t offset, uint64_t size) {
+    std::vector<uint8_t> chunk(static_cast<size_t>(std::min<uint64_t>(size, AsyncFileWriter::CHUNK_SIZE)));
+    while (size > 0) {
+        const auto part = std::span(chunk).first(static_cast<size_t>(std::min<uint64_t>(size, chunk.size())));
+        ReadFileRange(fd, part, offset);
+        WriteRawBytes(part);
+        offset += part.size();
+        size -= part.size();
+    }
+}
+
 BitWriterString::BitWriterString() {
 }
 
@@ -97,7 +207,53 @@ void BitWriterU8::WriteLastWord(size_t word, size_t count) {
     data_.push_back(word << (GetBase() - count));
 }
 
-BitWriterStream::BitWriterStream(std::unique_ptr<std::ostream>&& os) : os_(std::move(os)) {
+void BitWriterU8::WriteRawBytes(std::span<const uint8_t> bytes) {
+    data_.insert(data_.end(), bytes.begin(), bytes.end());
+}
+
+BitWriterStream::BitWriterStream(std::unique_ptr<std::ostream>&& os, size_t buffer_size)
+    : BitWriterStream(std::move(os), -1, false, buffer_size) {
+}
+
+BitWriterStream::BitWriterStream(const std::string& filename, size_t buffer_size)
+    : BitWriterStream(nullptr, OpenOutputFile(filename), true, buffer_size) {
+}
+
+BitWriterStream::BitWriterStream(int fd, size_t buffer_size) : BitWriterStream(nullptr, fd, false, buffer_size) {
+}
+
+BitWriterStream::BitWriterStream(std::unique_ptr<std::ostream>&& os, int fd, bool owns_fd, size_t buffer_size)
+    : os_(std::move(os)),
+      fd_(fd),
+      owns_fd_(owns_fd),
+      data_(MakeAlignedBuffer(std::max<size_t>(buffer_size, 1))),
+      capacity_(std::max<size_t>(buffer_size, 1)),
+      size_(0) {
+}
+
+BitWriterStream::~BitWriterStream() {
+    // Деструктор BitWriter уже не вызовет переопределенные WriteWord и Finish, поэтому закрывать нужно здесь.
+    try {
+        Close();
+    } catch (const std::exception&) {
+    }
+    if (owns_fd_ && fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void BitWriterStream::Flush() {
+    Output();
+    if (os_) {
+        os_->flush();
+    }
+}
+
+void BitWriterStream::Sync() {
+    Flush();
+    if (!os_) {
+        SyncFile(fd_);
+    }
 }
 
 size_t BitWriterStream::GetBase() const {
@@ -105,10 +261,68 @@ size_t BitWriterStream::GetBase() const {
 }
 
 void BitWriterStream::WriteWord(size_t word) {
-    os_->write(reinterpret_cast<const char*>(&word), sizeof(uint8_t));
+    if (size_ == capacity_) {
+        Output();
+    }
+    data_[size_++] = static_cast<uint8_t>(word);
 }
 
 void BitWriterStream::WriteLastWord(size_t word, size_t count) {
-    word <<= GetBase() - count;
-    os_->write(reinterpret_cast<const char*>(&word), sizeof(uint8_t));
-}
\ No newline at end of file
+    WriteWord(word << (GetBase() - count));
+}
+
+void BitWriterStream::Finish() {
+    Flush();
+}
+
+void BitWriterStream::WriteRawBytes(std::span<const uint8_t> bytes) {
+    if (bytes.size() <= capacity_ - size_) {
+        std::copy(bytes.begin(), bytes.end(), data_.get() + size_);
+        size_ += bytes.size();
+        return;
+    }
+    Output(bytes);
+}
+
+void BitWriterStream::Output(std::span<const uint8_t> tail) {
+    const std::span<const uint8_t> head(data_.get(), size_);
+    // Буфер считается записанным и при ошибке: повторная попытка из Close не должна записать его дважды.
+    size_ = 0;
+    if (!os_) {
+        WriteAll(fd_, head, tail);
+        return;
+    }
+    os_->write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+    os_->write(reinterpret_cast<const char*>(tail.data()), static_cast<std::streamsize>(tail.size()));
+}
+
+BitWriterFile::BitWriterFile(const std::string& filename, const IoOptions& options)
+    : writer_(filename, options) {
+}
+
+BitWriterFile::BitWriterFile(int fd, const IoOptions& options) : writer_(fd, options) {
+}
+
+size_t BitWriterFile::GetBase() const {
+    return 8;
+}
+
+void BitWriterFile::WriteWord(size_t word) {
+    writer_.Put(static_cast<uint8_t>(word));
+}
+
+void BitWriterFile::WriteLastWord(size_t word, size_t count) {
+    writer_.Put(static_cast<uint8_t>(word << (GetBase() - count)));
+}
+
+void BitWriterFile::Finish() {
+    writer_.Close();
+}
+
+void BitWriterFile::WriteRawBytes(std::span<const uint8_t> bytes) {
+    writer_.Write(bytes);
+}
+
+void BitWriterFile::CopyRawBytes(int fd, uint64_t offset, uint64_t size) {
+    writer_.CopyFrom(fd, offset, size);
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "async_io.hpp"
+#include "bit_order.hpp"
+
 #include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 #include <memory>
@@ -11,6 +16,21 @@ public:
 
     void WriteInt(size_t value, size_t size);
 
+    /// @brief Дописать незаконченное слово нулями: следующий бит начинает новое слово (у потоков байтов - байт).
+    void AlignToWord();
+
+    /// @brief Записать байты с границы слова (см. AlignToWord) без перестановки бит: в потоке байтов они
+    /// лежат как есть в любом порядке бит.
+    void WriteBytes(std::span<const uint8_t> bytes);
+
+    /// @brief Записать с границы слова size байт файла fd, начиная с позиции offset. Запись в файл передает
+    /// их ядру без копирования через буферы процесса. Ошибки чтения бросаются как std::ios_base::failure.
+    void CopyBytes(int fd, uint64_t offset, uint64_t size);
+
+    /// @brief Сменить порядок бит. Незаконченное слово дописывается нулями, следующий бит начинает новое слово.
+    void SetBitOrder(BitOrder order);
+    BitOrder GetBitOrder() const;
+
     void Close();
 
     bool Closed() const;
@@ -34,10 +54,23 @@ protected:
     /// @param count Количество бит в слове.
     virtual void WriteLastWord(size_t word, size_t count);
 
+    /// @brief Вызывается при закрытии потока после последнего слова, чтобы дописать буферизованные данные.
+    virtual void Finish();
+
+    /// @brief Записать байты с границы слова. По умолчанию - по 8 бит через WriteInt.
+    virtual void WriteRawBytes(std::span<const uint8_t> bytes);
+
+    /// @brief Записать байты файла с границы слова. По умолчанию они читаются pread и записываются WriteRawBytes.
+    virtual void CopyRawBytes(int fd, uint64_t offset, uint64_t size);
+
 private:
     size_t buffer_;
     size_t buffer_size_;
     bool closed_;
+    BitOrder order_;
+
+    /// @brief Вывести незаконченное слово, дописав его нулями.
+    void FlushPartialWord();
 };
 
 class BitWriterString : public BitWriter {
@@ -65,20 +98,78 @@ protected:
     size_t GetBase() const override;
     void WriteWord(size_t word) override;
     void WriteLastWord(size_t word, size_t count) override;
+    void WriteRawBytes(std::span<const uint8_t> bytes) override;
 
 private:
     std::vector<uint8_t> data_;
 };
 
+/**
+ * @brief Запись байтов через выровненный буфер размера buffer_size. Заполненный буфер уходит одним вызовом write
+ * в дескриптор или в поток; большие WriteBytes записываются вместе с накопленным буфером одним writev, без
+ * копирования. Ошибки записи в дескриптор бросаются как std::ios_base::failure, ошибки потока - по его маске
+ * exceptions. Деструктор дописывает буфер и молча пропускает ошибки: чтобы их увидеть, нужно вызвать Close.
+ */
 class BitWriterStream final : public BitWriter {
 public:
-    explicit BitWriterStream(std::unique_ptr<std::ostream>&& os);
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+    explicit BitWriterStream(std::unique_ptr<std::ostream>&& os, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    /// @brief Создать или перезаписать файл, дескриптор закрывается деструктором.
+    explicit BitWriterStream(const std::string& filename, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    /// @brief Запись в открытый дескриптор, например в стандартный вывод. Дескриптор не закрывается.
+    explicit BitWriterStream(int fd, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    BitWriterStream(const BitWriterStream&) = delete;
+    BitWriterStream& operator=(const BitWriterStream&) = delete;
+
+    ~BitWriterStream();
+
+    /// @brief Записать накопленные целые байты. Незаконченный байт остается в писателе до следующих бит
+    /// или Close.
+    void Flush();
+
+    /// @brief Flush и ожидание, пока данные дойдут до носителя (fdatasync). Поток только сбрасывается: его
+    /// дескриптор недоступен.
+    void Sync();
 
 protected:
     size_t GetBase() const override;
     void WriteWord(size_t word) override;
     void WriteLastWord(size_t word, size_t count) override;
+    void Finish() override;
+    void WriteRawBytes(std::span<const uint8_t> bytes) override;
 
 private:
     std::unique_ptr<std::ostream> os_;
-};
\ No newline at end of file
+    int fd_;
+    bool owns_fd_;
+    AlignedBuffer data_;
+    size_t capacity_;
+    size_t size_;
+
+    BitWriterStream(std::unique_ptr<std::ostream>&& os, int fd, bool owns_fd, size_t buffer_size);
+
+    /// @brief Записать буфер и за ним tail, буфер после этого пуст.
+    void Output(std::span<const uint8_t> tail = {});
+};
+
+/// @brief Запись файла через AsyncFileWriter: заполненные буферы записываются, пока заполняются следующие.
+/// Ошибки записи бросаются из WriteWord и Close.
+class BitWriterFile final : public BitWriter {
+public:
+    explicit BitWriterFile(const std::string& filename, const IoOptions& options = {});
+    /// @brief Запись в открытый дескриптор, например в стандартный вывод.
+    explicit BitWriterFile(int fd, const IoOptions& options = {});
+
+protected:
+    size_t GetBase() const override;
+    void WriteWord(size_t word) override;
+    void WriteLastWord(size_t word, size_t count) override;
+    void Finish() override;
+    void WriteRawBytes(std::span<const uint8_t> bytes) override;
+    void CopyRawBytes(int fd, uint64_t offset, uint64_t size) override;
+
+private:
+    AsyncFileWriter writer_;
+};
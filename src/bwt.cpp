@@ -0,0 +1,316 @@
+#include "bwt.hpp"
+#include "huffman.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+/// Начала (или концы) корзин: позиции в суффиксном массиве, с которых начинаются суффиксы на символ c.
+std::vector<uint32_t> GetBuckets(const std::vector<uint32_t>& s, size_t alphabet_size, bool end) {
+    std::vector<uint32_t> buckets(alphabet_size, 0);
+    for (uint32_t c : s) {
+        ++buckets[c];
+    }
+
+    uint32_t sum = 0;
+    for (uint32_t& bucket : buckets) {
+        sum += bucket;
+        bucket = end ? sum : sum - bucket;
+    }
+    return buckets;
+}
+
+/// По отсортированным LMS-суффиксам восстанавливает порядок L-суффиксов, затем S-суффиксов.
+void InduceSort(const std::vector<uint32_t>& s, std::vector<uint32_t>& sa, const std::vector<bool>& is_s,
+                size_t alphabet_size) {
+    auto buckets = GetBuckets(s, alphabet_size, false);
+    for (size_t i = 0; i < sa.size(); ++i) {
+        const uint32_t j = sa[i];
+        if (j != EMPTY && j > 0 && !is_s[j - 1]) {
+            sa[buckets[s[j - 1]]++] = j - 1;
+        }
+    }
+
+    buckets = GetBuckets(s, alphabet_size, true);
+    for (size_t i = sa.size(); i-- > 0;) {
+        const uint32_t j = sa[i];
+        if (j != EMPTY && j > 0 && is_s[j - 1]) {
+            sa[--buckets[s[j - 1]]] = j - 1;
+        }
+    }
+}
+
+/// SA-IS (Nong, Zhang, Chan). Строка заканчивается единственным нулевым символом.
+std::vector<uint32_t> SaIs(const std::vector<uint32_t>& s, size_t alphabet_size) {
+    const size_t n = s.size();
+    if (n == 1) {
+        return {0};
+    }
+
+    std::vector<bool> is_s(n);
+    is_s[n - 1] = true;
+    for (size_t i = n - 1; i-- > 0;) {
+        is_s[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && is_s[i + 1]);
+    }
+    const auto is_lms = [&](size_t i) { return i > 0 && is_s[i] && !is_s[i - 1]; };
+
+    // LMS-подстроки равны, если совпадают посимвольно вместе с типами до следующей LMS-позиции.
+    const auto equal_lms = [&](size_t a, size_t b) {
+        for (size_t i = 0;; ++i) {
+            if (s[a + i] != s[b + i] || is_s[a + i] != is_s[b + i]) {
+                return false;
+            }
+            if (i > 0) {
+                const bool a_end = is_lms(a + i);
+                const bool b_end = is_lms(b + i);
+                if (a_end || b_end) {
+                    return a_end && b_end;
+                }
+            }
+        }
+    };
+
+    // Шаг 1: сортировка LMS-подстрок индуцированием от произвольного порядка LMS-позиций.
+    std::vector<uint32_t> sa(n, EMPTY);
+    auto buckets = GetBuckets(s, alphabet_size, true);
+    for (size_t i = 1; i < n; ++i) {
+        if (is_lms(i)) {
+            sa[--buckets[s[i]]] = static_cast<uint32_t>(i);
+        }
+    }
+    InduceSort(s, sa, is_s, alphabet_size);
+
+    // Шаг 2: имена LMS-подстрок. LMS-позиции отстоят друг от друга хотя бы на 2, поэтому имя позиции
+    // pos помещается в sa[m + pos / 2].
+    size_t lms_count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (is_lms(sa[i])) {
+            sa[lms_count++] = sa[i];
+        }
+    }
+    std::fill(sa.begin() + static_cast<std::ptrdiff_t>(lms_count), sa.end(), EMPTY);
+
+    uint32_t names_count = 0;
+    for (size_t i = 0; i < lms_count; ++i) {
+        if (i == 0 || !equal_lms(sa[i - 1], sa[i])) {
+            ++names_count;
+        }
+        sa[lms_count + sa[i] / 2] = names_count - 1;
+    }
+
+    std::vector<uint32_t> reduced;
+    reduced.reserve(lms_count);
+    for (size_t i = lms_count; i < n; ++i) {
+        if (sa[i] != EMPTY) {
+            reduced.push_back(sa[i]);
+        }
+    }
+
+    // Шаг 3: порядок LMS-суффиксов - суффиксный массив сокращенной строки.
+    std::vector<uint32_t> reduced_sa;
+    if (names_count < lms_count) {
+        reduced_sa = SaIs(reduced, names_count);
+    } else {
+        reduced_sa.resize(lms_count);
+        for (size_t i = 0; i < lms_count; ++i) {
+            reduced_sa[reduced[i]] = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<uint32_t> lms_positions;
+    lms_positions.reserve(lms_count);
+    for (size_t i = 1; i < n; ++i) {
+        if (is_lms(i)) {
+            lms_positions.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // Шаг 4: индуцирование от LMS-суффиксов в правильном порядке.
+    std::fill(sa.begin(), sa.end(), EMPTY);
+    buckets = GetBuckets(s, alphabet_size, true);
+    for (size_t i = lms_count; i-- > 0;) {
+        const uint32_t position = lms_positions[reduced_sa[i]];
+        sa[--buckets[s[position]]] = position;
+    }
+    InduceSort(s, sa, is_s, alphabet_size);
+    return sa;
+}
+
+void AppendZeroRun(std::vector<uint16_t>& symbols, size_t run) {
+    while (run > 0) {
+        if (run & 1) {
+            symbols.push_back(BwtEncoder::RUN_A);
+            run = (run - 1) / 2;
+        } else {
+            symbols.push_back(BwtEncoder::RUN_B);
+            run = (run - 2) / 2;
+        }
+    }
+}
+
+void MoveToFront(std::array<uint8_t, 256>& order, size_t rank) {
+    std::rotate(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(rank),
+                order.begin() + static_cast<std::ptrdiff_t>(rank) + 1);
+}
+
+}  // namespace
+
+std::vector<uint32_t> BuildSuffixArray(std::span<const uint8_t> text) {
+    std::vector<uint32_t> s(text.size() + 1, 0);
+    for (size_t i = 0; i < text.size(); ++i) {
+        s[i] = uint32_t{text[i]} + 1;
+    }
+    return SaIs(s, 257);
+}
+
+void BwtEncoder::Encode(std::istream& is, BitWriter& bs) {
+    while (true) {
+        block_.resize(BLOCK_SIZE);
+        is.read(reinterpret_cast<char*>(block_.data()), static_cast<std::streamsize>(block_.size()));
+        block_.resize(static_cast<size_t>(is.gcount()));
+        if (block_.empty()) {
+            break;
+        }
+
+        bs.WriteBit(true);
+        EncodeBlock(bs);
+    }
+    bs.WriteBit(false);
+}
+
+void BwtEncoder::EncodeBlock(BitWriter& bs) {
+    const auto suffix_array = BuildSuffixArray(block_);
+
+    std::array<uint8_t, 256> order;
+    std::iota(order.begin(), order.end(), 0);
+    symbols_.clear();
+    size_t primary_index = 0;
+    size_t zero_run = 0;
+
+    // Последний столбец матрицы циклических сдвигов сразу пропускается через move-to-front и RLE.
+    for (size_t i = 0; i < suffix_array.size(); ++i) {
+        if (suffix_array[i] == 0) {
+            primary_index = i;
+            continue;
+        }
+
+        const uint8_t byte = block_[suffix_array[i] - 1];
+        const auto rank = static_cast<size_t>(std::ranges::find(order, byte) - order.begin());
+        if (rank == 0) {
+            ++zero_run;
+            continue;
+        }
+
+        AppendZeroRun(symbols_, zero_run);
+        zero_run = 0;
+        symbols_.push_back(static_cast<uint16_t>(rank + 1));
+        MoveToFront(order, rank);
+    }
+    AppendZeroRun(symbols_, zero_run);
+
+    std::vector<size_t> frequencies(ALPHABET_SIZE, 0);
+    frequencies[END_OF_BLOCK] = 1;
+    for (uint16_t symbol : symbols_) {
+        ++frequencies[symbol];
+    }
+    const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+
+    bs.WriteInt(primary_index, PRIMARY_INDEX_BIT_COUNT);
+    code.WriteCompact(bs);
+    for (uint16_t symbol : symbols_) {
+        for (bool bit : code.GetCode(symbol)) {
+            bs.WriteBit(bit);
+        }
+    }
+    for (bool bit : code.GetCode(END_OF_BLOCK)) {
+        bs.WriteBit(bit);
+    }
+}
+
+void BwtDecoder::Decode(BitReader& bs, std::ostream& os) {
+    while (bs.ReadBit()) {
+        const size_t primary_index = bs.ReadInt(BwtEncoder::PRIMARY_INDEX_BIT_COUNT);
+        const HuffmanDecoder decoder(HuffmanCode::ReadCompact(bs, BwtEncoder::ALPHABET_SIZE));
+
+        std::array<uint8_t, 256> order;
+        std::iota(order.begin(), order.end(), 0);
+        block_.clear();
+        size_t zero_run = 0;
+        size_t run_digit = 1;
+
+        while (true) {
+            const size_t symbol = decoder.ReadSymbol(bs);
+            if (symbol == BwtEncoder::RUN_A || symbol == BwtEncoder::RUN_B) {
+                zero_run += run_digit << symbol;
+                run_digit <<= 1;
+                if (zero_run > BwtEncoder::BLOCK_SIZE) {
+                    throw BwtFormatError("BWT block is too long.");
+                }
+                continue;
+            }
+
+            if (block_.size() + zero_run > BwtEncoder::BLOCK_SIZE) {
+                throw BwtFormatError("BWT block is too long.");
+            }
+            block_.insert(block_.end(), zero_run, order[0]);
+            zero_run = 0;
+            run_digit = 1;
+
+            if (symbol == BwtEncoder::END_OF_BLOCK) {
+                break;
+            }
+
+            const size_t rank = symbol - 1;
+            block_.push_back(order[rank]);
+            MoveToFront(order, rank);
+        }
+
+        if (block_.size() > BwtEncoder::BLOCK_SIZE || primary_index > block_.size()) {
+            throw BwtFormatError("Invalid BWT block.");
+        }
+        InverseTransform(primary_index);
+        os.write(reinterpret_cast<const char*>(output_.data()), static_cast<std::streamsize>(output_.size()));
+    }
+}
+
+void BwtDecoder::InverseTransform(size_t primary_index) {
+    // Последний столбец матрицы - block_ с символом конца строки на позиции primary_index. Этот символ
+    // меньше всех байтов, поэтому первая строка матрицы начинается с него, а остальные сгруппированы по
+    // первому байту.
+    const size_t n = block_.size();
+    std::array<uint32_t, 256> start{};
+    for (uint8_t byte : block_) {
+        ++start[byte];
+    }
+    uint32_t sum = 1;
+    for (uint32_t& value : start) {
+        const uint32_t count = value;
+        value = sum;
+        sum += count;
+    }
+
+    next_.resize(n + 1);
+    for (size_t row = 0; row <= n; ++row) {
+        if (row == primary_index) {
+            next_[row] = 0;
+            continue;
+        }
+        const uint8_t byte = block_[row < primary_index ? row : row - 1];
+        next_[row] = start[byte]++;
+    }
+
+    output_.resize(n);
+    size_t row = 0;
+    for (size_t i = n; i-- > 0;) {
+        if (row == primary_index) {
+            throw BwtFormatError("Invalid BWT block.");
+        }
+        output_[i] = block_[row < primary_index ? row : row - 1];
+        row = next_[row];
+    }
+}
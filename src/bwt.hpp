@@ -0,0 +1,64 @@
+#pragma once
+
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class BwtFormatError : public std::runtime_error {
+public:
+    inline BwtFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/// @brief Суффиксный массив строки с приписанным в конец символом, меньшим всех байтов, за O(n)
+/// алгоритмом SA-IS. Первый элемент результата всегда равен text.size() (пустой суффикс).
+std::vector<uint32_t> BuildSuffixArray(std::span<const uint8_t> text);
+
+/**
+ * @brief Преобразование Барроуза-Уилера, move-to-front и кодирование серий нулей (как в bzip2) перед
+ * кодом Хаффмана. Вход разбивается на блоки не длиннее BLOCK_SIZE, каждый блок сжимается независимо,
+ * поэтому память ограничена размером блока.
+ *
+ * Формат блока: 1 бит `1`, 32 бита - номер строки с исходным текстом, код Хаффмана над алфавитом
+ * ALPHABET_SIZE в сжатом виде (HuffmanCode::WriteCompact), символы, END_OF_BLOCK. После последнего
+ * блока записывается бит `0`.
+ */
+class BwtEncoder {
+public:
+    static constexpr size_t BLOCK_SIZE = 900 * 1024;
+
+    /// Серии нулей после move-to-front записываются в биективной двоичной системе цифрами RUN_A (1)
+    /// и RUN_B (2), ненулевое значение v записывается символом v + 1.
+    static constexpr size_t RUN_A = 0;
+    static constexpr size_t RUN_B = 1;
+    static constexpr size_t END_OF_BLOCK = 257;
+    static constexpr size_t ALPHABET_SIZE = END_OF_BLOCK + 1;
+    static constexpr size_t PRIMARY_INDEX_BIT_COUNT = 32;
+
+    void Encode(std::istream& is, BitWriter& bs);
+
+private:
+    std::vector<uint8_t> block_;
+    std::vector<uint16_t> symbols_;
+
+    void EncodeBlock(BitWriter& bs);
+};
+
+class BwtDecoder {
+public:
+    void Decode(BitReader& bs, std::ostream& os);
+
+private:
+    std::vector<uint8_t> block_;
+    std::vector<uint32_t> next_;
+    std::vector<uint8_t> output_;
+
+    void InverseTransform(size_t primary_index);
+};
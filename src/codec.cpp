@@ -0,0 +1,172 @@
+#include "codec.hpp"
+#include "huffman.hpp"
+#include "multi_huffman.hpp"
+#include "tans.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+/// Примерная стоимость символа в таблицах: длина кода в сжатом виде и частота tANS.
+constexpr double HUFFMAN_TABLE_BITS_PER_SYMBOL = 6;
+constexpr double TANS_TABLE_BITS_PER_SYMBOL = 12;
+/// Потеря tANS из-за округления частот до размера таблицы.
+constexpr double TANS_OVERHEAD = 1.003;
+
+std::array<size_t, 256> CountBytes(std::span<const uint8_t> block) {
+    std::array<size_t, 256> frequencies{};
+    for (uint8_t byte : block) {
+        ++frequencies[byte];
+    }
+    return frequencies;
+}
+
+}  // namespace
+
+const CodecRegistry& CodecRegistry::Default() {
+    static const CodecRegistry registry = [] {
+        CodecRegistry result;
+        result.Register(std::make_unique<HuffmanCodec>());
+        result.Register(std::make_unique<TansCodec>());
+        result.Register(std::make_unique<StoredCodec>());
+        result.Register(std::make_unique<MultiHuffmanCodec>());
+        return result;
+    }();
+    return registry;
+}
+
+void CodecRegistry::Register(std::unique_ptr<Codec> codec) {
+    if (Find(codec->Id()) != nullptr || Find(codec->Name()) != nullptr) {
+        throw std::invalid_argument("Codec is already registered.");
+    }
+    codecs_.push_back(std::move(codec));
+}
+
+const Codec* CodecRegistry::Find(archive::CodecId id) const {
+    const auto it = std::ranges::find_if(codecs_, [&](const auto& codec) { return codec->Id() == id; });
+    return it == codecs_.end() ? nullptr : it->get();
+}
+
+const Codec* CodecRegistry::Find(std::string_view name) const {
+    const auto it = std::ranges::find_if(codecs_, [&](const auto& codec) { return codec->Name() == name; });
+    return it == codecs_.end() ? nullptr : it->get();
+}
+
+const Codec& CodecRegistry::Choose(const SampleEstimate& estimate) const {
+    return **std::ranges::min_element(
+        codecs_, [&](const auto& lhs, const auto& rhs) { return lhs->Estimate(estimate) < rhs->Estimate(estimate); });
+}
+
+const std::vector<std::unique_ptr<Codec>>& CodecRegistry::Codecs() const {
+    return codecs_;
+}
+
+archive::CodecId HuffmanCodec::Id() const {
+    return archive::CodecId::HUFFMAN;
+}
+
+std::string_view HuffmanCodec::Name() const {
+    return "huffman";
+}
+
+double HuffmanCodec::Estimate(const SampleEstimate& estimate) const {
+    return estimate.huffman_bits * static_cast<double>(estimate.content_size) +
+           HUFFMAN_TABLE_BITS_PER_SYMBOL * static_cast<double>(estimate.used_symbols);
+}
+
+void HuffmanCodec::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const {
+    const auto frequencies = CountBytes(block);
+    const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    code.WriteCompact(bs);
+    for (uint8_t byte : block) {
+        for (bool bit : code.GetCode(byte)) {
+            bs.WriteBit(bit);
+        }
+    }
+}
+
+void HuffmanCodec::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    const HuffmanDecoder decoder(HuffmanCode::ReadCompact(bs, 256));
+    for (uint8_t& byte : block) {
+        byte = static_cast<uint8_t>(decoder.ReadSymbol(bs));
+    }
+}
+
+archive::CodecId TansCodec::Id() const {
+    return archive::CodecId::TANS;
+}
+
+std::string_view TansCodec::Name() const {
+    return "tans";
+}
+
+double TansCodec::Estimate(const SampleEstimate& estimate) const {
+    return TANS_OVERHEAD * estimate.entropy * static_cast<double>(estimate.content_size) +
+           TANS_TABLE_BITS_PER_SYMBOL * static_cast<double>(estimate.used_symbols);
+}
+
+void TansCodec::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const {
+    const auto frequencies = CountBytes(block);
+    const auto table = TansTable::FromFrequencies(frequencies);
+    table.Write(bs);
+    TansEncoder(table).EncodeBlock(block, bs);
+}
+
+void TansCodec::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    try {
+        TansDecoder(TansTable::Read(bs)).DecodeBlock(bs, block);
+    } catch (const TansFormatError& exception) {
+        throw CodecFormatError(exception.what());
+    }
+}
+
+archive::CodecId MultiHuffmanCodec::Id() const {
+    return archive::CodecId::MULTI_HUFFMAN;
+}
+
+std::string_view MultiHuffmanCodec::Name() const {
+    return "multihuffman";
+}
+
+double MultiHuffmanCodec::Estimate(const SampleEstimate& estimate) const {
+    return estimate.huffman_bits * static_cast<double>(estimate.content_size) +
+           HUFFMAN_TABLE_BITS_PER_SYMBOL * static_cast<double>(estimate.used_symbols) *
+               static_cast<double>(MultiHuffmanEncoder::TablesCount(estimate.content_size));
+}
+
+void MultiHuffmanCodec::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const {
+    MultiHuffmanEncoder().EncodeBlock(block, bs);
+}
+
+void MultiHuffmanCodec::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    try {
+        MultiHuffmanDecoder().DecodeBlock(bs, block);
+    } catch (const MultiHuffmanFormatError& exception) {
+        throw CodecFormatError(exception.what());
+    }
+}
+
+archive::CodecId StoredCodec::Id() const {
+    return archive::CodecId::STORED;
+}
+
+std::string_view StoredCodec::Name() const {
+    return "stored";
+}
+
+double StoredCodec::Estimate(const SampleEstimate& estimate) const {
+    return static_cast<double>(archive::BYTE_BIT_COUNT * estimate.content_size);
+}
+
+void StoredCodec::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const {
+    for (uint8_t byte : block) {
+        bs.WriteInt(byte, archive::BYTE_BIT_COUNT);
+    }
+}
+
+void StoredCodec::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    for (uint8_t& byte : block) {
+        byte = static_cast<uint8_t>(bs.ReadInt(archive::BYTE_BIT_COUNT));
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "core.hpp"
+#include "estimate.hpp"
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+class CodecFormatError : public std::runtime_error {
+public:
+    inline CodecFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Кодек независимых блоков содержимого (EntryKind::BLOCKS). Блок кодируется без состояния,
+ * оставшегося от предыдущих блоков, поэтому кодек можно использовать и измерять отдельно от архива.
+ */
+class Codec {
+public:
+    /// Блоки записи не длиннее этого размера; размер блока записывается перед его данными.
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    static constexpr size_t BLOCK_SIZE_BIT_COUNT = 32;
+
+    virtual ~Codec() = default;
+
+    /// @brief Идентификатор, записываемый в архив перед каждым блоком.
+    virtual archive::CodecId Id() const = 0;
+
+    /// @brief Имя кодека для командной строки.
+    virtual std::string_view Name() const = 0;
+
+    /// @brief Примерный размер закодированного блока в битах по оценке его фрагментов.
+    virtual double Estimate(const SampleEstimate& estimate) const = 0;
+
+    /// @brief Закодировать непустой блок.
+    virtual void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const = 0;
+
+    /// @brief Декодировать блок, размер которого известен заранее. Бросает CodecFormatError или
+    /// BitReader::ReadException, если данные повреждены.
+    virtual void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const = 0;
+};
+
+/**
+ * @brief Реестр кодеков по идентификатору и имени. Default() содержит все кодеки этого архиватора.
+ */
+class CodecRegistry {
+public:
+    static const CodecRegistry& Default();
+
+    /// @brief Добавить кодек. Бросает std::invalid_argument, если идентификатор или имя уже заняты.
+    void Register(std::unique_ptr<Codec> codec);
+
+    /// @brief Найти кодек, nullptr - если такого нет.
+    const Codec* Find(archive::CodecId id) const;
+    const Codec* Find(std::string_view name) const;
+
+    /// @brief Кодек с наименьшей оценкой размера блока.
+    const Codec& Choose(const SampleEstimate& estimate) const;
+
+    const std::vector<std::unique_ptr<Codec>>& Codecs() const;
+
+private:
+    std::vector<std::unique_ptr<Codec>> codecs_;
+};
+
+/// @brief Канонический код Хаффмана нулевого порядка: код в сжатом виде (как в версии 2), затем байты блока.
+class HuffmanCodec final : public Codec {
+public:
+    archive::CodecId Id() const override;
+    std::string_view Name() const override;
+    double Estimate(const SampleEstimate& estimate) const override;
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const override;
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const override;
+};
+
+/// @brief Табличный ANS: таблица TansTable, затем блок TansEncoder.
+class TansCodec final : public Codec {
+public:
+    archive::CodecId Id() const override;
+    std::string_view Name() const override;
+    double Estimate(const SampleEstimate& estimate) const override;
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const override;
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const override;
+};
+
+/// @brief Несколько кодов Хаффмана на блок (MultiHuffmanEncoder). Оценка по фрагментам не видит смены
+/// распределения внутри блока и потому не меньше оценки HuffmanCodec: кодек выбирается только явно.
+class MultiHuffmanCodec final : public Codec {
+public:
+    archive::CodecId Id() const override;
+    std::string_view Name() const override;
+    double Estimate(const SampleEstimate& estimate) const override;
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const override;
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const override;
+};
+
+/// @brief Байты блока без сжатия.
+class StoredCodec final : public Codec {
+public:
+    archive::CodecId Id() const override;
+    std::string_view Name() const override;
+    double Estimate(const SampleEstimate& estimate) const override;
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const override;
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const override;
+};
@@ -0,0 +1,204 @@
+#include "context_mixing.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr int32_t MAX_STRETCH = 2047;
+constexpr size_t PROBABILITY_COUNT = size_t{1} << ContextMixingModel::PROBABILITY_BITS;
+constexpr int32_t INITIAL_WEIGHT = 1 << 14;
+constexpr int32_t MAX_WEIGHT = 1 << 22;
+constexpr int32_t WEIGHT_LEARNING_SHIFT = 12;
+constexpr uint16_t COUNTER_BITS = 4;
+constexpr uint16_t COUNTER_LIMIT = 15;
+constexpr uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+/// Логистическая функция 4096 / (1 + e^(-x / 256)), вычисленная интерполяцией по таблице (как в lpaq).
+/// Вычисления целочисленные, поэтому кодировщик и декодер получают одинаковые вероятности на любой машине.
+constexpr int32_t Squash(int32_t x) {
+    constexpr std::array<int32_t, 33> points{1,    2,    3,    6,    10,   16,   27,   45,   73,   120,  194,
+                                             310,  488,  747,  1101, 1546, 2047, 2549, 2994, 3348, 3607, 3785,
+                                             3901, 3975, 4022, 4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094};
+    if (x > MAX_STRETCH) {
+        return static_cast<int32_t>(PROBABILITY_COUNT) - 1;
+    }
+    if (x < -MAX_STRETCH) {
+        return 1;
+    }
+    const int32_t weight = x & 127;
+    const auto index = static_cast<size_t>((x >> 7) + 16);
+    return (points[index] * (128 - weight) + points[index + 1] * weight + 64) >> 7;
+}
+
+/// Обратная к Squash функция ln(p / (1 - p)).
+constexpr std::array<int32_t, PROBABILITY_COUNT> MakeStretchTable() {
+    std::array<int32_t, PROBABILITY_COUNT> table{};
+    size_t next = 0;
+    for (int32_t x = -MAX_STRETCH; x <= MAX_STRETCH; ++x) {
+        const auto value = static_cast<size_t>(Squash(x));
+        for (; next <= value; ++next) {
+            table[next] = x;
+        }
+    }
+    for (; next < PROBABILITY_COUNT; ++next) {
+        table[next] = MAX_STRETCH;
+    }
+    return table;
+}
+
+constexpr auto STRETCH_TABLE = MakeStretchTable();
+
+/// Шаг обновления вероятности 1 / (n + 1.5), где n - сколько раз ячейка уже обновлялась: пока
+/// статистики мало, вероятность быстро подстраивается, потом шаг ограничивается снизу.
+constexpr std::array<int32_t, COUNTER_LIMIT + 1> MakeReciprocalTable() {
+    std::array<int32_t, COUNTER_LIMIT + 1> table{};
+    for (size_t n = 0; n <= COUNTER_LIMIT; ++n) {
+        table[n] = static_cast<int32_t>(65536 * 2 / (2 * n + 3));
+    }
+    return table;
+}
+
+constexpr auto RECIPROCAL_TABLE = MakeReciprocalTable();
+
+/// Граница между интервалами для битов 1 и 0 пропорционально вероятности единицы.
+uint32_t Split(uint32_t low, uint32_t high, uint32_t probability) {
+    return low + static_cast<uint32_t>((uint64_t{high - low} * probability) >> ContextMixingModel::PROBABILITY_BITS);
+}
+
+}  // namespace
+
+ContextMixingModel::ContextMixingModel(size_t order, size_t content_size)
+    : order_(std::min(order, MAX_ORDER)),
+      table_bits_(std::clamp<size_t>(std::bit_width(content_size) + 2, MIN_TABLE_BITS, MAX_TABLE_BITS)),
+      probabilities_((order_ + 1) << table_bits_, 1 << 15),
+      weights_(256 * (order_ + 1), INITIAL_WEIGHT),
+      hashes_(),
+      slots_(),
+      indices_(),
+      inputs_(),
+      history_(0),
+      partial_byte_(1),
+      nibble_(1),
+      prediction_(PROBABILITY_COUNT / 2) {
+    UpdateHashes();
+}
+
+uint32_t ContextMixingModel::Predict() {
+    const int32_t* weights = &weights_[partial_byte_ * (order_ + 1)];
+    int64_t dot = 0;
+    for (size_t i = 0; i <= order_; ++i) {
+        indices_[i] = (i << table_bits_) | (slots_[i] + nibble_);
+        inputs_[i] = STRETCH_TABLE[probabilities_[indices_[i]] >> COUNTER_BITS];
+        dot += int64_t{weights[i]} * inputs_[i];
+    }
+
+    const auto mixed = static_cast<int32_t>(std::clamp<int64_t>(dot >> 16, -MAX_STRETCH, MAX_STRETCH));
+    prediction_ = static_cast<uint32_t>(std::clamp<int32_t>(Squash(mixed), 1, PROBABILITY_COUNT - 1));
+    return prediction_;
+}
+
+void ContextMixingModel::Update(bool bit) {
+    const int32_t error = (static_cast<int32_t>(bit) << PROBABILITY_BITS) - static_cast<int32_t>(prediction_);
+    int32_t* weights = &weights_[partial_byte_ * (order_ + 1)];
+    for (size_t i = 0; i <= order_; ++i) {
+        weights[i] = std::clamp(weights[i] + ((inputs_[i] * error) >> WEIGHT_LEARNING_SHIFT), -MAX_WEIGHT, MAX_WEIGHT);
+
+        // В старших 12 битах ячейки хранится вероятность, в младших - счетчик обновлений.
+        auto& cell = probabilities_[indices_[i]];
+        const int32_t probability = cell >> COUNTER_BITS;
+        const int32_t count = cell & ((1 << COUNTER_BITS) - 1);
+        const int32_t target = bit ? static_cast<int32_t>(PROBABILITY_COUNT) - 1 : 0;
+        const int32_t updated = probability + (((target - probability) * RECIPROCAL_TABLE[count]) >> 16);
+        cell = static_cast<uint16_t>((updated << COUNTER_BITS) | std::min<int32_t>(count + 1, COUNTER_LIMIT));
+    }
+
+    partial_byte_ = (partial_byte_ << 1) | static_cast<uint32_t>(bit);
+    nibble_ = (nibble_ << 1) | static_cast<uint32_t>(bit);
+    if (partial_byte_ >= 256) {
+        history_ = (history_ << 8) | (partial_byte_ & 255);
+        partial_byte_ = 1;
+        UpdateHashes();
+    } else if (nibble_ >= 16) {
+        UpdateSlots();
+    }
+}
+
+void ContextMixingModel::UpdateHashes() {
+    for (size_t i = 0; i <= order_; ++i) {
+        const uint64_t context = (history_ & ((uint64_t{1} << (8 * i)) - 1)) * (MAX_ORDER + 1) + i;
+        hashes_[i] = context * HASH_MULTIPLIER;
+    }
+    UpdateSlots();
+}
+
+void ContextMixingModel::UpdateSlots() {
+    // Каждые 4 бита контекст и уже известные биты байта выбирают группу из 16 соседних ячеек, внутри
+    // которой ячейку выбирают биты текущей половины байта. Так на половину байта приходится одно
+    // обращение к памяти в каждой таблице, а не четыре.
+    for (size_t i = 0; i <= order_; ++i) {
+        const uint64_t hash = (hashes_[i] ^ partial_byte_) * HASH_MULTIPLIER;
+        slots_[i] = (hash >> (64 - table_bits_)) & ~size_t{15};
+    }
+    nibble_ = 1;
+}
+
+ContextMixingEncoder::ContextMixingEncoder(BitWriter& bs, size_t order, size_t content_size)
+    : bs_(bs), model_(order, content_size), low_(0), high_(0xFFFFFFFF) {
+}
+
+void ContextMixingEncoder::Encode(uint8_t byte) {
+    for (size_t i = 8; i-- > 0;) {
+        const bool bit = (byte >> i) & 1;
+        const uint32_t middle = Split(low_, high_, model_.Predict());
+        if (bit) {
+            high_ = middle;
+        } else {
+            low_ = middle + 1;
+        }
+        model_.Update(bit);
+
+        // Старшие байты границ совпали и больше не изменятся.
+        while (((low_ ^ high_) & 0xFF000000) == 0) {
+            bs_.WriteInt(high_ >> 24, 8);
+            low_ <<= 8;
+            high_ = (high_ << 8) | 0xFF;
+        }
+    }
+}
+
+void ContextMixingEncoder::Flush() {
+    // По байту, старший первым, как при нормализации: WriteInt(.., 32) в порядке LSB_FIRST переставил бы байты.
+    for (size_t shift = 32; shift > 0; shift -= 8) {
+        bs_.WriteInt((low_ >> (shift - 8)) & 0xFF, 8);
+    }
+}
+
+ContextMixingDecoder::ContextMixingDecoder(BitReader& bs, size_t order, size_t content_size)
+    : bs_(bs), model_(order, content_size), low_(0), high_(0xFFFFFFFF), code_(0) {
+    for (size_t i = 0; i < 4; ++i) {
+        code_ = (code_ << 8) | static_cast<uint32_t>(bs_.ReadInt(8));
+    }
+}
+
+uint8_t ContextMixingDecoder::Decode() {
+    uint32_t byte = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        const uint32_t middle = Split(low_, high_, model_.Predict());
+        const bool bit = code_ <= middle;
+        if (bit) {
+            high_ = middle;
+        } else {
+            low_ = middle + 1;
+        }
+        model_.Update(bit);
+        byte = (byte << 1) | static_cast<uint32_t>(bit);
+
+        while (((low_ ^ high_) & 0xFF000000) == 0) {
+            low_ <<= 8;
+            high_ = (high_ << 8) | 0xFF;
+            code_ = (code_ << 8) | static_cast<uint32_t>(bs_.ReadInt(8));
+        }
+    }
+    return static_cast<uint8_t>(byte);
+}
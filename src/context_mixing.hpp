@@ -0,0 +1,84 @@
+#pragma once
+
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Адаптивная модель для двоичного арифметического кодирования. Байт кодируется по битам,
+ * вероятность очередного бита смешивается из предсказаний контекстов порядков 0..order (хэши
+ * последних байтов вместе с уже закодированными битами текущего байта). Модель обучается по ходу
+ * кодирования, поэтому таблицы в архив не записываются.
+ */
+class ContextMixingModel {
+public:
+    static constexpr size_t MAX_ORDER = 6;
+    static constexpr size_t ORDER_BIT_COUNT = 3;
+    static constexpr size_t PROBABILITY_BITS = 12;
+
+    /// @param order максимальный порядок контекста
+    /// @param content_size размер кодируемых данных, по нему выбирается размер хэш-таблиц
+    ContextMixingModel(size_t order, size_t content_size);
+
+    /// @brief Вероятность того, что следующий бит равен 1, в единицах 2^-PROBABILITY_BITS.
+    uint32_t Predict();
+    void Update(bool bit);
+
+private:
+    static constexpr size_t MIN_TABLE_BITS = 16;
+    static constexpr size_t MAX_TABLE_BITS = 22;
+
+    size_t order_;
+    size_t table_bits_;
+    std::vector<uint16_t> probabilities_;
+    std::vector<int32_t> weights_;
+    std::array<uint64_t, MAX_ORDER + 1> hashes_;
+    std::array<size_t, MAX_ORDER + 1> slots_;
+    std::array<size_t, MAX_ORDER + 1> indices_;
+    std::array<int32_t, MAX_ORDER + 1> inputs_;
+    uint64_t history_;
+    uint32_t partial_byte_;
+    uint32_t nibble_;
+    uint32_t prediction_;
+
+    void UpdateHashes();
+    void UpdateSlots();
+};
+
+/**
+ * @brief Двоичный арифметический кодировщик (range coder без переносов, как в lpaq) с моделью
+ * ContextMixingModel. Байты результата записываются в поток по 8 бит.
+ */
+class ContextMixingEncoder {
+public:
+    ContextMixingEncoder(BitWriter& bs, size_t order, size_t content_size);
+
+    void Encode(uint8_t byte);
+
+    /// @brief Дописать состояние кодировщика. Вызывается один раз после последнего байта.
+    void Flush();
+
+private:
+    BitWriter& bs_;
+    ContextMixingModel model_;
+    uint32_t low_;
+    uint32_t high_;
+};
+
+class ContextMixingDecoder {
+public:
+    ContextMixingDecoder(BitReader& bs, size_t order, size_t content_size);
+
+    uint8_t Decode();
+
+private:
+    BitReader& bs_;
+    ContextMixingModel model_;
+    uint32_t low_;
+    uint32_t high_;
+    uint32_t code_;
+};
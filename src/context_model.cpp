@@ -0,0 +1,133 @@
+#include "context_model.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+ContextHuffmanModel::ContextHuffmanModel()
+    : histograms_(), codes_(), decoders_(), table_by_context_(), decoder_by_context_(), context_(0) {
+    table_by_context_.fill(0);
+    decoder_by_context_.fill(nullptr);
+}
+
+void ContextHuffmanModel::Count(uint8_t byte) {
+    // Гистограммы нужны только кодировщику, поэтому память под них выделяется при первом обращении.
+    if (histograms_.empty()) {
+        histograms_.resize(CONTEXTS_COUNT);
+    }
+    ++histograms_[context_][byte];
+    context_ = byte;
+}
+
+void ContextHuffmanModel::Build() {
+    histograms_.resize(CONTEXTS_COUNT);
+    Histogram order0;
+    order0.fill(0);
+    for (const auto& histogram : histograms_) {
+        for (size_t i = 0; i < ALPHABET_SIZE; ++i) {
+            order0[i] += histogram[i];
+        }
+    }
+
+    // Контекст получает свою таблицу, только если она вместе с заголовком короче, чем данные,
+    // закодированные общей таблицей нулевого порядка.
+    const auto order0_code = HuffmanCode::FromFrequencies(order0, HuffmanCode::MAX_COMPACT_LENGTH);
+    Histogram shared;
+    shared.fill(0);
+
+    codes_.assign(1, HuffmanCode());
+    for (size_t context = 0; context < CONTEXTS_COUNT; ++context) {
+        const auto& histogram = histograms_[context];
+        table_by_context_[context] = 0;
+
+        auto own_code = HuffmanCode::FromFrequencies(histogram, HuffmanCode::MAX_COMPACT_LENGTH);
+        const size_t own_size = EncodedSize(histogram, own_code) + CompactHeaderSize(own_code);
+        if (own_size < EncodedSize(histogram, order0_code)) {
+            table_by_context_[context] = codes_.size();
+            codes_.push_back(std::move(own_code));
+        } else {
+            for (size_t i = 0; i < ALPHABET_SIZE; ++i) {
+                shared[i] += histogram[i];
+            }
+        }
+    }
+
+    codes_[0] = HuffmanCode::FromFrequencies(shared, HuffmanCode::MAX_COMPACT_LENGTH);
+    context_ = 0;
+}
+
+void ContextHuffmanModel::WriteTables(BitWriter& bs) const {
+    bs.WriteInt(codes_.size(), TABLES_COUNT_BIT_COUNT);
+
+    const size_t index_bit_count = std::bit_width(codes_.size() - 1);
+    for (size_t table : table_by_context_) {
+        bs.WriteInt(table, index_bit_count);
+    }
+
+    for (const auto& code : codes_) {
+        code.WriteCompact(bs);
+    }
+}
+
+void ContextHuffmanModel::ReadTables(BitReader& bs) {
+    const size_t tables_count = bs.ReadInt(TABLES_COUNT_BIT_COUNT);
+    if (tables_count == 0 || tables_count > CONTEXTS_COUNT + 1) {
+        throw HuffmanFormatError("Invalid number of context tables.");
+    }
+
+    const size_t index_bit_count = std::bit_width(tables_count - 1);
+    for (size_t& table : table_by_context_) {
+        table = bs.ReadInt(index_bit_count);
+        if (table >= tables_count) {
+            throw HuffmanFormatError("Invalid context table index.");
+        }
+    }
+
+    decoders_.clear();
+    decoders_.reserve(tables_count);
+    for (size_t i = 0; i < tables_count; ++i) {
+        decoders_.emplace_back(HuffmanCode::ReadCompact(bs, ALPHABET_SIZE));
+    }
+
+    for (size_t context = 0; context < CONTEXTS_COUNT; ++context) {
+        decoder_by_context_[context] = &decoders_[table_by_context_[context]];
+    }
+    context_ = 0;
+}
+
+void ContextHuffmanModel::Encode(BitWriter& bs, uint8_t byte) {
+    for (bool bit : codes_[table_by_context_[context_]].GetCode(byte)) {
+        bs.WriteBit(bit);
+    }
+    context_ = byte;
+}
+
+uint8_t ContextHuffmanModel::Decode(BitReader& bs) {
+    context_ = static_cast<uint8_t>(decoder_by_context_[context_]->ReadSymbol(bs));
+    return context_;
+}
+
+size_t ContextHuffmanModel::TablesCount() const {
+    return std::max(codes_.size(), decoders_.size());
+}
+
+size_t ContextHuffmanModel::CompactHeaderSize(const HuffmanCode& code) {
+    BitWriterU8 counter;
+    code.WriteCompact(counter);
+    counter.Close();
+    return counter.Data().size() * 8;
+}
+
+size_t ContextHuffmanModel::EncodedSize(const Histogram& histogram, const HuffmanCode& code) {
+    size_t size = 0;
+    for (size_t i = 0; i < ALPHABET_SIZE; ++i) {
+        if (histogram[i] == 0) {
+            continue;
+        }
+        if (code.GetLength(i) == 0) {
+            return std::numeric_limits<size_t>::max();
+        }
+        size += histogram[i] * code.GetLength(i);
+    }
+    return size;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "huffman.hpp"
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Контекстная модель первого порядка: символ кодируется таблицей, выбранной по предыдущему
+ * байту. Контексты, для которых своя таблица не окупает заголовок, делят общую таблицу с номером 0.
+ */
+class ContextHuffmanModel {
+public:
+    static constexpr size_t CONTEXTS_COUNT = 256;
+    static constexpr size_t ALPHABET_SIZE = 256;
+    static constexpr size_t TABLES_COUNT_BIT_COUNT = 9;
+
+    ContextHuffmanModel();
+
+    /// @brief Учесть очередной байт при подсчете частот.
+    void Count(uint8_t byte);
+
+    /// @brief Построить таблицы по собранным частотам. После вызова можно кодировать данные
+    /// с начального контекста.
+    void Build();
+
+    void WriteTables(BitWriter& bs) const;
+    void ReadTables(BitReader& bs);
+
+    void Encode(BitWriter& bs, uint8_t byte);
+    uint8_t Decode(BitReader& bs);
+
+    size_t TablesCount() const;
+
+private:
+    using Histogram = std::array<size_t, ALPHABET_SIZE>;
+
+    std::vector<Histogram> histograms_;
+    std::vector<HuffmanCode> codes_;
+    std::vector<HuffmanDecoder> decoders_;
+    std::array<size_t, CONTEXTS_COUNT> table_by_context_;
+    std::array<const HuffmanDecoder*, CONTEXTS_COUNT> decoder_by_context_;
+    uint8_t context_;
+
+    static size_t CompactHeaderSize(const HuffmanCode& code);
+    static size_t EncodedSize(const Histogram& histogram, const HuffmanCode& code);
+};
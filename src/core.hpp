@@ -25,5 +25,88 @@ constexpr Char ONE_MORE_FILE{257};
 constexpr Char ARCHIVE_END{258};
 constexpr size_t CHARS_COUNT{259};
 constexpr size_t ALPHABET_BIT_COUNT{9};
+/// Алфавит записей HUFFMAN и SOLID версии 3: только байты, без служебных символов.
+constexpr size_t BYTES_COUNT{256};
+
+/// Нулевой размер алфавита не встречается в обычном заголовке (служебные символы есть всегда),
+/// поэтому он используется как признак расширенной записи. Сразу за ним следует EntryKind.
+constexpr size_t EXTENDED_ENTRY_MARKER{0};
+constexpr size_t ENTRY_KIND_BIT_COUNT{8};
+constexpr size_t ENTRY_INDEX_BIT_COUNT{32};
+constexpr size_t NAME_LENGTH_BIT_COUNT{32};
+constexpr size_t BYTE_BIT_COUNT{8};
+constexpr size_t SIZE_BIT_COUNT{64};
+constexpr size_t RANGE_COUNT_BIT_COUNT{32};
+
+enum class EntryKind : size_t {
+    /// Обычная запись, описанная в README. Явно в архив не записывается.
+    HUFFMAN = 0,
+    /// Ссылка на ранее записанный файл с тем же содержимым: индекс записи и имя файла.
+    DUPLICATE = 1,
+    /// Группа файлов с общей таблицей кодов: заголовок как у обычной записи, затем файлы
+    /// через ONE_MORE_FILE, группа завершается символом ARCHIVE_END.
+    SOLID = 2,
+    /// Пролог архива версии 2 и выше: 8 бит - версия формата. Файла не содержит.
+    FORMAT = 3,
+    /// Контекстная модель первого порядка: 64 бита - размер содержимого, таблицы ContextHuffmanModel,
+    /// имя файла, содержимое.
+    CONTEXT_HUFFMAN = 4,
+    /// LZ77 с кодами Хаффмана для литералов, длин и расстояний: 5 бит - логарифм размера окна,
+    /// имя файла, блоки Lz77Encoder.
+    LZ77 = 5,
+    /// tANS: 64 бита - размер содержимого, таблица TansTable, имя файла, блоки TansEncoder.
+    TANS = 6,
+    /// Двоичный арифметический кодировщик со смешиванием контекстов: 64 бита - размер содержимого,
+    /// 3 бита - максимальный порядок контекста, имя файла, байты кодировщика ContextMixingEncoder.
+    CONTEXT_MIXING = 7,
+    /// Преобразование Барроуза-Уилера, move-to-front и RLE перед кодом Хаффмана: имя файла, блоки BwtEncoder.
+    BWT = 8,
+    /// Код Хаффмана с RLE-фильтром: код над алфавитом RunLengthSplitter в сжатом виде, имя файла, символы.
+    RUN_LENGTH = 9,
+    /// Содержимое без сжатия: 64 бита - размер содержимого, имя файла, байты по 8 бит.
+    STORED = 10,
+    /// Независимые блоки кодеков из CodecRegistry: имя файла, затем для каждого блока бит 1, 8 бит - CodecId,
+    /// 32 бита - размер блока и данные кодека. После последнего блока записывается бит 0.
+    BLOCKS = 11,
+    /// Код Хаффмана обученной модели: 64 бита - идентификатор HuffmanModel, 64 бита - размер содержимого,
+    /// имя файла, содержимое.
+    MODEL_HUFFMAN = 12,
+    /// LZ77 с окном, заполненным словарем: 5 бит - логарифм размера окна, 64 бита - идентификатор LzDictionary,
+    /// имя файла, блоки Lz77Encoder.
+    LZ77_DICTIONARY = 13,
+    /// Файл с дырами: 64 бита - размер файла, 32 бита - количество участков с данными, для каждого 64 бита -
+    /// смещение и 64 бита - длина, имя файла, затем содержимое участков подряд в виде блоков, как в BLOCKS.
+    /// Остальное содержимое - нули, при распаковке они становятся дырами.
+    SPARSE = 14,
+    /// Содержимое без сжатия с границы байта: 64 бита - размер содержимого, имя файла, нули до границы байта,
+    /// байты содержимого как есть. Файлы копируются в архив и обратно средствами ядра (copy_file_range).
+    RAW = 15,
+};
+
+enum class CodecId : size_t {
+    HUFFMAN = 0,
+    TANS = 1,
+    STORED = 2,
+    /// Несколько кодов Хаффмана с выбором кода для каждой группы байтов (MultiHuffmanEncoder).
+    MULTI_HUFFMAN = 3,
+};
+
+constexpr size_t CODEC_ID_BIT_COUNT{8};
+
+enum class FormatVersion : size_t {
+    /// Формат, описанный в README.
+    V1 = 1,
+    /// Все записи начинаются с EntryKind, длины кодов ограничены HuffmanCode::MAX_COMPACT_LENGTH и
+    /// записываются в сжатом виде (как в deflate).
+    V2 = 2,
+    /// Как версия 2, но записи HUFFMAN и SOLID кодируют только байты (BYTES_COUNT символов): перед именем
+    /// каждого файла записываются 64 бита - размер содержимого и 32 бита - длина имени, имя хранится без сжатия.
+    /// Файлы solid-группы разделяются битом 1, группа завершается битом 0, разделитель записей - один бит.
+    V3 = 3,
+};
+
+constexpr size_t FORMAT_VERSION_BIT_COUNT{8};
+/// Признак в байте версии: все, что следует за прологом, записано в порядке BitOrder::LSB_FIRST.
+constexpr size_t FORMAT_LSB_FIRST_FLAG{0x80};
 
 }  // namespace archive
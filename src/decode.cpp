@@ -1,9 +1,103 @@
 #include "decode.hpp"
 #include "core.hpp"
+#include "async_io.hpp"
 
+#include <algorithm>
 #include <fstream>
+#include <filesystem>
+#include <streambuf>
+#include <system_error>
 
-ArchiveDecoder::ArchiveDecoder(BitReader& bs) : bs_(std::ref(bs)), tree_(), root_(), done_(false) {
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+/// Поток, который пишет содержимое записи в target и дописывает те же байты в конец временного файла.
+class SpoolingBuffer : public std::streambuf {
+public:
+    SpoolingBuffer(std::ostream& target, int spool_fd)
+        : target_(target), spool_fd_(spool_fd), size_(0), chunk_(CHUNK_SIZE) {
+        setp(chunk_.data(), chunk_.data() + chunk_.size());
+    }
+
+    /// @brief Сколько байт передано в target и во временный файл.
+    uint64_t Size() const {
+        return size_;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        Drain();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        Drain();
+        return 0;
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    std::ostream& target_;
+    int spool_fd_;
+    uint64_t size_;
+    std::vector<char> chunk_;
+
+    void Drain() {
+        const auto size = static_cast<size_t>(pptr() - pbase());
+        target_.write(pbase(), static_cast<std::streamsize>(size));
+        WriteAll(spool_fd_, std::span(reinterpret_cast<const uint8_t*>(pbase()), size));
+        size_ += size;
+        setp(chunk_.data(), chunk_.data() + chunk_.size());
+    }
+};
+
+}  // namespace
+
+ArchiveDecoder::ArchiveDecoder(BitReader& bs)
+    : bs_(std::ref(bs)),
+      code_(),
+      format_version_(archive::FormatVersion::V1),
+      done_(false),
+      in_solid_group_(false),
+      entry_kind_(archive::EntryKind::HUFFMAN),
+      duplicate_of_(0),
+      content_size_(0),
+      context_model_(),
+      lz77_window_bits_(0),
+      tans_decoder_(),
+      context_mixing_order_(0),
+      models_(),
+      model_(nullptr),
+      dictionaries_(),
+      dictionary_(nullptr),
+      entries_(),
+      spooled_(),
+      spool_fd_(-1),
+      spool_size_(0),
+      sparse_ranges_() {
+    AddModel(HuffmanModel::Default());
+}
+
+ArchiveDecoder::~ArchiveDecoder() {
+    if (spool_fd_ >= 0) {
+        close(spool_fd_);
+    }
+}
+
+void ArchiveDecoder::AddModel(const HuffmanModel& model) {
+    models_.try_emplace(model.Id(), model);
+}
+
+void ArchiveDecoder::AddDictionary(const LzDictionary& dictionary) {
+    dictionaries_.try_emplace(dictionary.Id(), dictionary);
 }
 
 bool ArchiveDecoder::Done() const {
@@ -13,85 +107,310 @@ bool ArchiveDecoder::Done() const {
 std::string ArchiveDecoder::DecodeFile() {
     DecodeHeader();
     auto name = DecodeName();
-    std::ofstream stream(name, std::ios::binary);
-    DecodeData(stream);
+    if (entry_kind_ == archive::EntryKind::DUPLICATE && spooled_[duplicate_of_]) {
+        MappedOutputFile stream(name, spooled_[duplicate_of_]->size);
+        WriteEntryContent(duplicate_of_, stream);
+        stream.Close();
+        DecodeEntrySeparator();
+    } else if (entry_kind_ == archive::EntryKind::DUPLICATE) {
+        const auto& source = GetDuplicateSource();
+        if (source != name) {
+            std::error_code error;
+            std::filesystem::copy_file(source, name, std::filesystem::copy_options::overwrite_existing, error);
+            if (error) {
+                throw ProcessError("Cannot copy a duplicate entry from the already extracted file.");
+            }
+        }
+        DecodeEntrySeparator();
+    } else if (entry_kind_ == archive::EntryKind::RAW) {
+        DecodeRawFile(name);
+    } else {
+        // Если запись хранит размер содержимого, место под файл выделяется сразу целиком.
+        MappedOutputFile stream(name, HasContentSize() ? content_size_ : 0);
+        DecodeData(stream);
+        stream.Close();
+    }
+
+    entries_.push_back(name);
+    spooled_.emplace_back(std::nullopt);
     return name;
 }
 
+bool ArchiveDecoder::HasContentSize() const {
+    switch (entry_kind_) {
+        case archive::EntryKind::CONTEXT_HUFFMAN:
+        case archive::EntryKind::TANS:
+        case archive::EntryKind::CONTEXT_MIXING:
+        case archive::EntryKind::STORED:
+        case archive::EntryKind::MODEL_HUFFMAN:
+            return true;
+        case archive::EntryKind::HUFFMAN:
+        case archive::EntryKind::SOLID:
+            return format_version_ == archive::FormatVersion::V3;
+        default:
+            return false;
+    }
+}
+
 std::string ArchiveDecoder::Decode(std::ostream& stream) {
     DecodeHeader();
     auto name = DecodeName();
-    DecodeData(stream);
+    if (entry_kind_ == archive::EntryKind::DUPLICATE) {
+        WriteEntryContent(duplicate_of_, stream);
+        DecodeEntrySeparator();
+        spooled_.push_back(spooled_[duplicate_of_]);
+    } else {
+        SpoolingBuffer buffer(stream, Spool());
+        std::ostream spooling_stream(&buffer);
+        spooling_stream.exceptions(std::ios_base::badbit);
+        DecodeData(spooling_stream);
+        spooling_stream.flush();
+        spooled_.emplace_back(FileRange{.offset = spool_size_, .size = buffer.Size()});
+        spool_size_ += buffer.Size();
+    }
+
+    entries_.push_back(name);
     return name;
 }
 
-void ArchiveDecoder::DecodeHeader() {
-    try {
-        size_t alphabet_size = bs_.ReadInt(archive::ALPHABET_BIT_COUNT);
-        std::vector<Char> order(alphabet_size);
-        for (Char& ch : order) {
-            ch = Char{bs_.ReadInt(archive::ALPHABET_BIT_COUNT)};
+void ArchiveDecoder::WriteEntryContent(size_t entry, std::ostream& os) {
+    const auto& content = spooled_[entry];
+    if (!content) {
+        // Запись распакована этим же декодером через DecodeFile, поэтому файл с ее именем - ее содержимое.
+        std::ifstream source(entries_[entry], std::ios::binary);
+        if (!source.is_open()) {
+            throw ProcessError("Cannot open the already extracted file for a duplicate entry.");
+        }
+        if (source.peek() != std::ifstream::traits_type::eof()) {
+            os << source.rdbuf();
         }
+        return;
+    }
 
-        root_.Reset();
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    std::vector<uint8_t> chunk;
+    for (uint64_t offset = content->offset, end = content->offset + content->size; offset < end;) {
+        chunk.resize(static_cast<size_t>(std::min<uint64_t>(end - offset, CHUNK_SIZE)));
+        ReadFileRange(spool_fd_, chunk, offset);
+        os.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        offset += chunk.size();
+    }
+}
 
-        DecodingTreeBuilder builder(tree_);
-        for (size_t len = 1, i = 0; i < order.size(); ++len) {
-            size_t count = bs_.ReadInt(archive::ALPHABET_BIT_COUNT);
-            if (i + count > order.size()) {
-                throw ProcessError("Inconsistency in header.");
-            }
+int ArchiveDecoder::Spool() {
+    if (spool_fd_ >= 0) {
+        return spool_fd_;
+    }
 
-            for (size_t i_first = i; i < i_first + count; ++i) {
-                builder.Push(tree_.EmplaceLeaf(order[i]), len);
+    std::error_code error;
+    auto directory = std::filesystem::temp_directory_path(error);
+    if (error) {
+        directory = "/tmp";
+    }
+    // Файл удаляется сразу после создания и исчезает вместе с последним дескриптором.
+    std::string path = (directory / "archiver-XXXXXX").string();
+    spool_fd_ = mkostemp(path.data(), O_CLOEXEC);
+    if (spool_fd_ < 0) {
+        throw std::ios_base::failure("Cannot create a temporary file in " + directory.string(),
+                                     std::error_code(errno, std::system_category()));
+    }
+    unlink(path.c_str());
+    return spool_fd_;
+}
+
+void ArchiveDecoder::DecodeHeader() {
+    // Внутри solid-группы таблица кодов общая и повторно не записывается.
+    if (in_solid_group_) {
+        return;
+    }
+
+    try {
+        if (format_version_ == archive::FormatVersion::V1) {
+            size_t alphabet_size = bs_.ReadInt(archive::ALPHABET_BIT_COUNT);
+            if (alphabet_size != archive::EXTENDED_ENTRY_MARKER) {
+                entry_kind_ = archive::EntryKind::HUFFMAN;
+                DecodeLegacyCodeTable(alphabet_size);
+                return;
             }
         }
 
-        root_ = builder.Get();
+        DecodeExtendedHeader(static_cast<archive::EntryKind>(bs_.ReadInt(archive::ENTRY_KIND_BIT_COUNT)));
     } catch (const BitReader::ReadException& exception) {
         throw ProcessError("Error while reading file-header.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ProcessError("Incorrectly defined huffman tree.");
     }
 }
 
-ArchiveDecoder::DecodingTreeBuilder::DecodingTreeBuilder(DecodingTree& tree) : stack_(), tree_(std::ref(tree)) {
+void ArchiveDecoder::DecodeCodeTable() {
+    if (format_version_ == archive::FormatVersion::V1) {
+        DecodeLegacyCodeTable(bs_.ReadInt(archive::ALPHABET_BIT_COUNT));
+    } else if (format_version_ == archive::FormatVersion::V2) {
+        code_ = HuffmanDecoder(HuffmanCode::ReadCompact(bs_, archive::CHARS_COUNT));
+    } else {
+        code_ = HuffmanDecoder(HuffmanCode::ReadCompact(bs_, archive::BYTES_COUNT));
+    }
 }
 
-void ArchiveDecoder::DecodingTreeBuilder::Push(DecodingTree::Iterator vertex, size_t length) {
-    if (!stack_.empty() && stack_.back().second == length) {
-        if (length == 0) {
-            throw ProcessError("Incorrectly defined huffman tree.");
+void ArchiveDecoder::DecodeLegacyCodeTable(size_t alphabet_size) {
+    std::vector<size_t> order(alphabet_size);
+    for (size_t& ch : order) {
+        ch = bs_.ReadInt(archive::ALPHABET_BIT_COUNT);
+        if (ch >= archive::CHARS_COUNT) {
+            throw ProcessError("Inconsistency in header.");
         }
+    }
 
-        auto previous = stack_.back().first;
-        stack_.pop_back();
-        Push(tree_.Unite(previous, vertex), length - 1);
-    } else {
-        stack_.emplace_back(vertex, length);
+    std::vector<size_t> count_by_length;
+    for (size_t i = 0; i < order.size();) {
+        size_t count = bs_.ReadInt(archive::ALPHABET_BIT_COUNT);
+        if (i + count > order.size()) {
+            throw ProcessError("Inconsistency in header.");
+        }
+
+        count_by_length.push_back(count);
+        i += count;
     }
+
+    code_ = HuffmanDecoder(std::move(order), count_by_length);
 }
 
-ArchiveDecoder::DecodingTree::Iterator ArchiveDecoder::DecodingTreeBuilder::Get() {
-    if (stack_.size() != 1 || stack_[0].second != 0) {
-        throw ProcessError("Incorrectly defined huffman tree.");
+void ArchiveDecoder::DecodeExtendedHeader(archive::EntryKind kind) {
+    entry_kind_ = kind;
+    switch (entry_kind_) {
+        case archive::EntryKind::HUFFMAN:
+            if (format_version_ == archive::FormatVersion::V1) {
+                throw ProcessError("Unknown entry kind.");
+            }
+            DecodeCodeTable();
+            break;
+        case archive::EntryKind::DUPLICATE:
+            duplicate_of_ = bs_.ReadInt(archive::ENTRY_INDEX_BIT_COUNT);
+            GetDuplicateSource();
+            break;
+        case archive::EntryKind::SOLID:
+            DecodeCodeTable();
+            in_solid_group_ = true;
+            break;
+        case archive::EntryKind::CONTEXT_HUFFMAN:
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            context_model_.ReadTables(bs_);
+            break;
+        case archive::EntryKind::LZ77:
+        case archive::EntryKind::LZ77_DICTIONARY:
+            lz77_window_bits_ = bs_.ReadInt(Lz77Parameters::WINDOW_BITS_BIT_COUNT);
+            if (lz77_window_bits_ < Lz77Parameters::MIN_WINDOW_BITS ||
+                lz77_window_bits_ > Lz77Parameters::MAX_WINDOW_BITS) {
+                throw ProcessError("Invalid LZ77 window size.");
+            }
+            dictionary_ = nullptr;
+            if (kind == archive::EntryKind::LZ77_DICTIONARY) {
+                const auto dictionary = dictionaries_.find(bs_.ReadInt(LzDictionary::ID_BIT_COUNT));
+                if (dictionary == dictionaries_.end()) {
+                    throw ProcessError("The archive was created with an unknown dictionary.");
+                }
+                dictionary_ = &dictionary->second;
+            }
+            break;
+        case archive::EntryKind::TANS:
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            try {
+                tans_decoder_ = TansDecoder(TansTable::Read(bs_));
+            } catch (const TansFormatError& exception) {
+                throw ProcessError("Incorrectly defined tANS table.");
+            }
+            break;
+        case archive::EntryKind::CONTEXT_MIXING:
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            context_mixing_order_ = bs_.ReadInt(ContextMixingModel::ORDER_BIT_COUNT);
+            if (context_mixing_order_ > ContextMixingModel::MAX_ORDER) {
+                throw ProcessError("Invalid context mixing order.");
+            }
+            break;
+        case archive::EntryKind::BWT:
+            break;
+        case archive::EntryKind::RUN_LENGTH:
+            code_ = HuffmanDecoder(HuffmanCode::ReadCompact(bs_, RunLengthSplitter::ALPHABET_SIZE));
+            break;
+        case archive::EntryKind::STORED:
+        case archive::EntryKind::RAW:
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            break;
+        case archive::EntryKind::BLOCKS:
+            break;
+        case archive::EntryKind::SPARSE: {
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            const size_t count = bs_.ReadInt(archive::RANGE_COUNT_BIT_COUNT);
+            sparse_ranges_.clear();
+            uint64_t end = 0;
+            for (size_t i = 0; i < count; ++i) {
+                const uint64_t offset = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+                const uint64_t size = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+                // Участки идут по возрастанию, не пересекаются и не выходят за размер файла.
+                if (size == 0 || offset < end || offset > content_size_ || size > content_size_ - offset) {
+                    throw ProcessError("Invalid sparse file ranges.");
+                }
+                sparse_ranges_.push_back(FileRange{.offset = offset, .size = size});
+                end = offset + size;
+            }
+            break;
+        }
+        case archive::EntryKind::MODEL_HUFFMAN: {
+            const auto model = models_.find(bs_.ReadInt(HuffmanModel::ID_BIT_COUNT));
+            if (model == models_.end()) {
+                throw ProcessError("The archive was created with an unknown model.");
+            }
+            model_ = &model->second;
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+            break;
+        }
+        case archive::EntryKind::FORMAT: {
+            // Пролог может стоять только в начале архива и файла не содержит.
+            if (!entries_.empty() || format_version_ != archive::FormatVersion::V1) {
+                throw ProcessError("Unexpected format version record.");
+            }
+
+            const size_t version = bs_.ReadInt(archive::FORMAT_VERSION_BIT_COUNT);
+            format_version_ = static_cast<archive::FormatVersion>(version & ~archive::FORMAT_LSB_FIRST_FLAG);
+            if (format_version_ != archive::FormatVersion::V2 && format_version_ != archive::FormatVersion::V3) {
+                throw ProcessError("Unsupported format version.");
+            }
+            if ((version & archive::FORMAT_LSB_FIRST_FLAG) != 0) {
+                bs_.SetBitOrder(BitOrder::LSB_FIRST);
+            }
+            DecodeHeader();
+            break;
+        }
+        default:
+            throw ProcessError("Unknown entry kind.");
     }
+}
 
-    return stack_[0].first;
+const std::string& ArchiveDecoder::GetDuplicateSource() const {
+    if (duplicate_of_ >= entries_.size()) {
+        throw ProcessError("A duplicate entry refers to a missing entry.");
+    }
+    return entries_[duplicate_of_];
 }
 
 archive::Char ArchiveDecoder::ReadCharacter() {
-    auto curret_node = root_;
-    while (!curret_node.IsLeaf()) {
-        const bool bit = bs_.ReadBit();
-        if (bit) {
-            curret_node = curret_node.Right();
-        } else {
-            curret_node = curret_node.Left();
-        }
-    }
-    return *curret_node;
+    return Char{code_.ReadSymbol(bs_)};
 }
 
 std::string ArchiveDecoder::DecodeName() {
+    if (entry_kind_ != archive::EntryKind::HUFFMAN && entry_kind_ != archive::EntryKind::SOLID) {
+        return DecodeRawName();
+    }
+    if (format_version_ == archive::FormatVersion::V3) {
+        // Перед именем каждого файла, в том числе внутри solid-группы, записан размер его содержимого.
+        try {
+            content_size_ = bs_.ReadInt(archive::SIZE_BIT_COUNT);
+        } catch (const BitReader::ReadException& exception) {
+            throw ProcessError("Error while reading file-header.");
+        }
+        return DecodeRawName();
+    }
+
     try {
         std::string name;
 
@@ -115,6 +434,55 @@ std::string ArchiveDecoder::DecodeName() {
 }
 
 void ArchiveDecoder::DecodeData(std::ostream& os) {
+    if (entry_kind_ == archive::EntryKind::CONTEXT_HUFFMAN) {
+        DecodeContextData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::LZ77 || entry_kind_ == archive::EntryKind::LZ77_DICTIONARY) {
+        DecodeLz77Data(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::TANS) {
+        DecodeTansData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::CONTEXT_MIXING) {
+        DecodeContextMixingData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::BWT) {
+        DecodeBwtData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::MODEL_HUFFMAN) {
+        DecodeModelData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::BLOCKS) {
+        DecodeBlocksData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::SPARSE) {
+        DecodeSparseData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::RAW) {
+        DecodeRawData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::STORED) {
+        DecodeStoredData(os);
+        return;
+    }
+    if (entry_kind_ == archive::EntryKind::RUN_LENGTH) {
+        DecodeRunLengthData(os);
+        return;
+    }
+    if (format_version_ == archive::FormatVersion::V3) {
+        DecodeSizedData(os);
+        return;
+    }
+
     try {
         while (true) {
             Char ch = ReadCharacter();
@@ -123,7 +491,12 @@ void ArchiveDecoder::DecodeData(std::ostream& os) {
             }
 
             if (ch == archive::ARCHIVE_END) {
-                done_ = true;
+                if (in_solid_group_) {
+                    in_solid_group_ = false;
+                    DecodeEntrySeparator();
+                } else {
+                    done_ = true;
+                }
                 break;
             } else if (ch == archive::ONE_MORE_FILE) {
                 break;
@@ -134,4 +507,286 @@ void ArchiveDecoder::DecodeData(std::ostream& os) {
     } catch (const BitReader::ReadException& exception) {
         throw ProcessError("Error while reading file-content.");
     }
+}
+
+void ArchiveDecoder::DecodeContextData(std::ostream& os) {
+    try {
+        for (size_t i = 0; i < content_size_; ++i) {
+            os << static_cast<char>(context_model_.Decode(bs_));
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeLz77Data(std::ostream& os) {
+    try {
+        Lz77Decoder(lz77_window_bits_)
+            .Decode(bs_, os, dictionary_ != nullptr ? dictionary_->Content() : std::span<const uint8_t>());
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ProcessError("Incorrectly defined huffman tree.");
+    } catch (const Lz77FormatError& exception) {
+        throw ProcessError("Invalid LZ77 match.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeTansData(std::ostream& os) {
+    try {
+        std::vector<uint8_t> block;
+        for (size_t left = content_size_; left > 0;) {
+            block.resize(std::min(left, TansEncoder::BLOCK_SIZE));
+            tans_decoder_.DecodeBlock(bs_, block);
+            os.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+            left -= block.size();
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeContextMixingData(std::ostream& os) {
+    try {
+        ContextMixingDecoder decoder(bs_, context_mixing_order_, content_size_);
+        for (size_t i = 0; i < content_size_; ++i) {
+            os << static_cast<char>(decoder.Decode());
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeBwtData(std::ostream& os) {
+    try {
+        BwtDecoder().Decode(bs_, os);
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ProcessError("Incorrectly defined huffman tree.");
+    } catch (const BwtFormatError& exception) {
+        throw ProcessError("Invalid BWT block.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeRunLengthData(std::ostream& os) {
+    try {
+        RunLengthDecoder(code_).Decode(bs_, os);
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    } catch (const RunLengthFormatError& exception) {
+        throw ProcessError("Invalid run in file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeStoredData(std::ostream& os) {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    try {
+        std::vector<char> chunk;
+        for (size_t left = content_size_; left > 0;) {
+            chunk.resize(std::min(left, CHUNK_SIZE));
+            for (char& byte : chunk) {
+                byte = static_cast<char>(bs_.ReadInt(archive::BYTE_BIT_COUNT));
+            }
+            os.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            left -= chunk.size();
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeRawData(std::ostream& os) {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    // Нули до границы байта записаны и перед пустым содержимым.
+    bs_.AlignToWord();
+    try {
+        std::vector<uint8_t> chunk;
+        for (size_t left = content_size_; left > 0;) {
+            chunk.resize(std::min(left, CHUNK_SIZE));
+            bs_.ReadBytes(chunk);
+            os.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+            left -= chunk.size();
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeRawFile(const std::string& name) {
+    const int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::ios_base::failure("Cannot open " + name, std::error_code(errno, std::system_category()));
+    }
+    // Содержимое из файла архива передает ядро, минуя буферы процесса.
+    try {
+        bs_.CopyBytes(fd, content_size_);
+    } catch (const BitReader::ReadException& exception) {
+        close(fd);
+        throw ProcessError("Error while reading file-content.");
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    if (close(fd) != 0) {
+        throw std::ios_base::failure("Cannot close " + name, std::error_code(errno, std::system_category()));
+    }
+
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeBlocksData(std::ostream& os) {
+    DecodeBlocks([&os](std::span<const uint8_t> data) {
+        os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    });
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeSparseData(std::ostream& os) {
+    // В распаковываемом файле дыры пропускаются, в остальные потоки вместо них записываются нули.
+    auto* file = dynamic_cast<MappedOutputFile*>(&os);
+    uint64_t position = 0;
+    const auto skip_to = [&](uint64_t offset) {
+        if (file != nullptr) {
+            file->Skip(offset - position);
+        } else {
+            static const std::vector<char> zeros(1 << 16);
+            for (uint64_t left = offset - position; left > 0;) {
+                const auto size = static_cast<size_t>(std::min<uint64_t>(left, zeros.size()));
+                os.write(zeros.data(), static_cast<std::streamsize>(size));
+                left -= size;
+            }
+        }
+        position = offset;
+    };
+
+    size_t range = 0;
+    DecodeBlocks([&](std::span<const uint8_t> data) {
+        while (!data.empty()) {
+            if (range == sparse_ranges_.size()) {
+                throw ProcessError("Sparse file data does not match its ranges.");
+            }
+            const FileRange& current = sparse_ranges_[range];
+            skip_to(std::max(position, current.offset));
+            const uint64_t range_left = current.offset + current.size - position;
+            const auto size = static_cast<size_t>(std::min<uint64_t>(data.size(), range_left));
+            os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+            position += size;
+            data = data.subspan(size);
+            if (position == current.offset + current.size) {
+                ++range;
+            }
+        }
+    });
+    if (range != sparse_ranges_.size()) {
+        throw ProcessError("Sparse file data does not match its ranges.");
+    }
+    skip_to(content_size_);
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeBlocks(const std::function<void(std::span<const uint8_t>)>& consume) {
+    try {
+        std::vector<uint8_t> block;
+        while (bs_.ReadBit()) {
+            const auto id = static_cast<archive::CodecId>(bs_.ReadInt(archive::CODEC_ID_BIT_COUNT));
+            const Codec* codec = CodecRegistry::Default().Find(id);
+            if (codec == nullptr) {
+                throw ProcessError("Unknown codec.");
+            }
+
+            const size_t size = bs_.ReadInt(Codec::BLOCK_SIZE_BIT_COUNT);
+            if (size == 0 || size > Codec::BLOCK_SIZE) {
+                throw ProcessError("Invalid block size.");
+            }
+            block.resize(size);
+            codec->DecodeBlock(bs_, block);
+            consume(block);
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ProcessError("Incorrectly defined huffman tree.");
+    } catch (const CodecFormatError& exception) {
+        throw ProcessError("Invalid codec block.");
+    }
+}
+
+void ArchiveDecoder::DecodeModelData(std::ostream& os) {
+    DecodeBytes(model_->GetDecoder(), os);
+    DecodeEntrySeparator();
+}
+
+void ArchiveDecoder::DecodeSizedData(std::ostream& os) {
+    DecodeBytes(code_, os);
+    if (!in_solid_group_) {
+        DecodeEntrySeparator();
+        return;
+    }
+
+    try {
+        in_solid_group_ = bs_.ReadBit();
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading entry separator.");
+    }
+    if (!in_solid_group_) {
+        DecodeEntrySeparator();
+    }
+}
+
+void ArchiveDecoder::DecodeBytes(const HuffmanDecoder& decoder, std::ostream& os) {
+    // Количество байтов известно, поэтому цикл не проверяет служебные символы.
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    try {
+        std::vector<char> chunk;
+        for (size_t left = content_size_; left > 0;) {
+            chunk.resize(std::min(left, CHUNK_SIZE));
+            for (char& byte : chunk) {
+                byte = static_cast<char>(decoder.ReadSymbol(bs_));
+            }
+            os.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            left -= chunk.size();
+        }
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-content.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ProcessError("Incorrectly defined huffman tree.");
+    }
+}
+
+std::string ArchiveDecoder::DecodeRawName() {
+    try {
+        size_t length = bs_.ReadInt(archive::NAME_LENGTH_BIT_COUNT);
+        std::string name;
+        for (size_t i = 0; i < length; ++i) {
+            name.push_back(static_cast<char>(bs_.ReadInt(archive::BYTE_BIT_COUNT)));
+        }
+        return name;
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading file-name.");
+    }
+}
+
+void ArchiveDecoder::DecodeEntrySeparator() {
+    try {
+        done_ = !bs_.ReadBit();
+    } catch (const BitReader::ReadException& exception) {
+        throw ProcessError("Error while reading entry separator.");
+    }
 }
\ No newline at end of file
@@ -2,9 +2,25 @@
 
 #include "core.hpp"
 #include "bitstream_reader.hpp"
-#include "binary_forest.hpp"
+#include "huffman.hpp"
+#include "context_model.hpp"
+#include "lz77.hpp"
+#include "tans.hpp"
+#include "context_mixing.hpp"
+#include "bwt.hpp"
+#include "rle.hpp"
+#include "codec.hpp"
+#include "model.hpp"
+#include "dictionary.hpp"
+#include "async_io.hpp"
 
 #include <exception>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 class ArchiveDecoder {
 public:
@@ -15,41 +31,82 @@ public:
     };
 
     ArchiveDecoder(BitReader& bs);
+    ~ArchiveDecoder();
+
+    ArchiveDecoder(const ArchiveDecoder&) = delete;
+    ArchiveDecoder& operator=(const ArchiveDecoder&) = delete;
+
+    /// @brief Сделать модель доступной записям EntryKind::MODEL_HUFFMAN. Встроенная модель
+    /// HuffmanModel::Default() доступна всегда.
+    void AddModel(const HuffmanModel& model);
+
+    /// @brief Сделать словарь доступным записям EntryKind::LZ77_DICTIONARY.
+    void AddDictionary(const LzDictionary& dictionary);
 
     bool Done() const;
 
+    /// @brief Распаковать следующую запись в поток. Содержимое записей при этом копируется во временный файл:
+    /// файлов с ними не остается, а записи EntryKind::DUPLICATE берут содержимое из него.
     std::string Decode(std::ostream& ostream);
     std::string DecodeFile();
 
 private:
     using Char = archive::Char;
 
-    struct CharUnite {
-        inline Char operator()(Char lhs, Char rhs) {
-            return Char{0};
-        }
-    };
-
-    using DecodingTree = BinaryForest<Char, CharUnite>;
-
     BitReader& bs_;
-    DecodingTree tree_;
-    DecodingTree::Iterator root_;
+    HuffmanDecoder code_;
+    archive::FormatVersion format_version_;
     bool done_;
+    bool in_solid_group_;
+    archive::EntryKind entry_kind_;
+    size_t duplicate_of_;
+    size_t content_size_;
+    ContextHuffmanModel context_model_;
+    size_t lz77_window_bits_;
+    TansDecoder tans_decoder_;
+    size_t context_mixing_order_;
+    std::unordered_map<uint64_t, HuffmanModel> models_;
+    const HuffmanModel* model_;
+    std::unordered_map<uint64_t, LzDictionary> dictionaries_;
+    const LzDictionary* dictionary_;
+    std::vector<std::string> entries_;
+    /// Участок spool_fd_ с содержимым каждой записи из entries_; пусто - запись распакована DecodeFile в файл.
+    std::vector<std::optional<FileRange>> spooled_;
+    /// Безымянный временный файл, создается при первом вызове Decode.
+    int spool_fd_;
+    uint64_t spool_size_;
+    /// Участки с данными записи EntryKind::SPARSE, размер файла - в content_size_.
+    std::vector<FileRange> sparse_ranges_;
 
     void DecodeHeader();
+    /// @brief Записан ли размер содержимого текущей записи в content_size_ до начала содержимого.
+    bool HasContentSize() const;
+    void DecodeExtendedHeader(archive::EntryKind kind);
+    void DecodeCodeTable();
+    void DecodeLegacyCodeTable(size_t alphabet_size);
     std::string DecodeName();
+    std::string DecodeRawName();
     void DecodeData(std::ostream& ostream);
+    void DecodeContextData(std::ostream& ostream);
+    void DecodeLz77Data(std::ostream& ostream);
+    void DecodeTansData(std::ostream& ostream);
+    void DecodeContextMixingData(std::ostream& ostream);
+    void DecodeBwtData(std::ostream& ostream);
+    void DecodeRunLengthData(std::ostream& ostream);
+    void DecodeStoredData(std::ostream& ostream);
+    void DecodeRawData(std::ostream& ostream);
+    void DecodeRawFile(const std::string& name);
+    void DecodeBlocksData(std::ostream& ostream);
+    void DecodeSparseData(std::ostream& ostream);
+    /// @brief Прочитать блоки EntryKind::BLOCKS и SPARSE и передать их содержимое consume.
+    void DecodeBlocks(const std::function<void(std::span<const uint8_t>)>& consume);
+    void DecodeModelData(std::ostream& ostream);
+    void DecodeSizedData(std::ostream& ostream);
+    void DecodeBytes(const HuffmanDecoder& decoder, std::ostream& ostream);
+    void DecodeEntrySeparator();
+    const std::string& GetDuplicateSource() const;
+    /// @brief Записать в ostream содержимое уже распакованной записи entry.
+    void WriteEntryContent(size_t entry, std::ostream& ostream);
+    int Spool();
     Char ReadCharacter();
-
-    class DecodingTreeBuilder {
-    public:
-        DecodingTreeBuilder(DecodingTree& tree);
-        void Push(DecodingTree::Iterator vertex, size_t length);
-        DecodingTree::Iterator Get();
-
-    private:
-        std::vector<std::pair<DecodingTree::Iterator, size_t>> stack_;
-        DecodingTree& tree_;
-    };
 };
@@ -0,0 +1,149 @@
+#include "dictionary.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+namespace {
+
+/// Длина подстрок, для которых считается, во скольких образцах они встречаются.
+constexpr size_t KMER_SIZE = 8;
+/// Длина фрагментов, из которых собирается словарь.
+constexpr size_t SEGMENT_SIZE = 64;
+constexpr size_t HASH_BITS = 20;
+constexpr uint32_t NO_HASH = std::numeric_limits<uint32_t>::max();
+
+uint32_t HashKmer(const uint8_t* data) {
+    uint64_t value = 0;
+    std::memcpy(&value, data, KMER_SIZE);
+    return static_cast<uint32_t>((value * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+struct Segment {
+    size_t begin;
+    size_t size;
+    size_t score;
+};
+
+}  // namespace
+
+LzDictionary::LzDictionary(std::vector<uint8_t> content) : content_(std::move(content)), id_(0) {
+    Hasher128 hasher;
+    hasher.Update(std::string_view(reinterpret_cast<const char*>(content_.data()), content_.size()));
+    id_ = hasher.Finish().low;
+}
+
+LzDictionary LzDictionary::FromContent(std::vector<uint8_t> content) {
+    if (content.empty()) {
+        throw DictionaryFormatError("The dictionary is empty.");
+    }
+    if (content.size() > MAX_SIZE) {
+        throw DictionaryFormatError("The dictionary is too large.");
+    }
+    return LzDictionary(std::move(content));
+}
+
+LzDictionary LzDictionary::Train(std::span<const std::vector<uint8_t>> samples, size_t size) {
+    if (size == 0 || size > MAX_SIZE) {
+        throw std::invalid_argument("Invalid dictionary size.");
+    }
+
+    // Вес подстроки - в скольких образцах, кроме одного, она встречается. Подстрока из единственного
+    // образца другим файлам не поможет.
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> hashes;
+    std::vector<uint32_t> weights(size_t{1} << HASH_BITS, 0);
+    std::vector<size_t> last_sample(size_t{1} << HASH_BITS, std::numeric_limits<size_t>::max());
+    for (size_t index = 0; index < samples.size(); ++index) {
+        const size_t begin = data.size();
+        data.insert(data.end(), samples[index].begin(), samples[index].end());
+        // Подстроки, пересекающие границу образцов, не учитываются.
+        hashes.resize(data.size(), NO_HASH);
+        for (size_t position = begin; position + KMER_SIZE <= data.size(); ++position) {
+            const uint32_t hash = HashKmer(&data[position]);
+            hashes[position] = hash;
+            if (last_sample[hash] != index) {
+                last_sample[hash] = index;
+                ++weights[hash];
+            }
+        }
+    }
+    for (uint32_t& weight : weights) {
+        weight -= weight > 0;
+    }
+
+    // Образцы делятся на эпохи по числу фрагментов словаря, из каждой эпохи берется фрагмент с наибольшей
+    // суммой весов различных подстрок. Выбранные подстроки больше не учитываются, чтобы словарь
+    // не повторял сам себя.
+    const size_t epochs_count = std::max<size_t>(1, size / SEGMENT_SIZE);
+    const size_t epoch_size = std::max(SEGMENT_SIZE, (data.size() + epochs_count - 1) / epochs_count);
+    std::vector<uint16_t> in_segment(size_t{1} << HASH_BITS, 0);
+    std::vector<Segment> segments;
+    for (size_t epoch_begin = 0; epoch_begin < data.size(); epoch_begin += epoch_size) {
+        const size_t epoch_end = std::min(data.size(), epoch_begin + epoch_size);
+        size_t score = 0;
+        const auto add = [&](size_t position) {
+            if (in_segment[hashes[position]]++ == 0) {
+                score += weights[hashes[position]];
+            }
+        };
+        const auto remove = [&](size_t position) {
+            if (--in_segment[hashes[position]] == 0) {
+                score -= weights[hashes[position]];
+            }
+        };
+
+        Segment best{.begin = 0, .size = 0, .score = 0};
+        size_t segment_begin = epoch_begin;
+        for (size_t position = epoch_begin; position < epoch_end; ++position) {
+            if (hashes[position] == NO_HASH) {
+                for (; segment_begin < position; ++segment_begin) {
+                    remove(segment_begin);
+                }
+                segment_begin = position + 1;
+                continue;
+            }
+            add(position);
+            if (position - segment_begin > SEGMENT_SIZE - KMER_SIZE) {
+                remove(segment_begin++);
+            }
+            if (score > best.score) {
+                best = Segment{.begin = segment_begin, .size = position + KMER_SIZE - segment_begin, .score = score};
+            }
+        }
+        for (; segment_begin < epoch_end; ++segment_begin) {
+            remove(segment_begin);
+        }
+
+        if (best.score != 0) {
+            for (size_t position = best.begin; position + KMER_SIZE <= best.begin + best.size; ++position) {
+                weights[hashes[position]] = 0;
+            }
+            segments.push_back(best);
+        }
+    }
+    if (segments.empty()) {
+        throw std::invalid_argument("The samples have no common fragments.");
+    }
+
+    std::ranges::stable_sort(segments, {}, &Segment::score);
+    std::vector<uint8_t> content;
+    for (const Segment& segment : segments) {
+        const auto begin = data.begin() + static_cast<std::ptrdiff_t>(segment.begin);
+        content.insert(content.end(), begin, begin + static_cast<std::ptrdiff_t>(segment.size));
+    }
+    if (content.size() > size) {
+        content.erase(content.begin(), content.end() - static_cast<std::ptrdiff_t>(size));
+    }
+    return LzDictionary(std::move(content));
+}
+
+uint64_t LzDictionary::Id() const {
+    return id_;
+}
+
+std::span<const uint8_t> LzDictionary::Content() const {
+    return content_;
+}
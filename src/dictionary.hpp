@@ -0,0 +1,49 @@
+#pragma once
+
+#include "lz77.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class DictionaryFormatError : public std::runtime_error {
+public:
+    inline DictionaryFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Словарь LZ77 (EntryKind::LZ77_DICTIONARY): байты, которыми заполняется окно перед первым байтом
+ * файла. Небольшие похожие файлы (JSON, конфигурации) почти не сжимаются по отдельности, потому что окно
+ * пусто; со словарем совпадения находятся уже в начале файла. Запись ссылается на словарь по
+ * идентификатору, сам словарь в архив не записывается. Файл словаря содержит только его байты.
+ */
+class LzDictionary {
+public:
+    static constexpr size_t DEFAULT_SIZE = 1 << 15;
+    static constexpr size_t MAX_SIZE = size_t{1} << Lz77Parameters::MAX_WINDOW_BITS;
+    static constexpr size_t ID_BIT_COUNT = 64;
+    /// Из каждого обучающего файла берется не больше этого количества байт.
+    static constexpr size_t MAX_SAMPLE_SIZE = 1 << 20;
+
+    /// @brief Словарь из готовых байтов. Бросает DictionaryFormatError, если словарь пуст или длиннее MAX_SIZE.
+    static LzDictionary FromContent(std::vector<uint8_t> content);
+
+    /// @brief Собрать словарь не длиннее size из фрагментов, общих для наибольшего числа образцов. Самые
+    /// полезные фрагменты стоят в конце словаря, ближе к содержимому файла. Бросает std::invalid_argument,
+    /// если у образцов нет общих фрагментов.
+    static LzDictionary Train(std::span<const std::vector<uint8_t>> samples, size_t size = DEFAULT_SIZE);
+
+    /// @brief Идентификатор словаря - отпечаток его байтов.
+    uint64_t Id() const;
+
+    std::span<const uint8_t> Content() const;
+
+private:
+    std::vector<uint8_t> content_;
+    uint64_t id_;
+
+    explicit LzDictionary(std::vector<uint8_t> content);
+};
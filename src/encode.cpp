@@ -1,95 +1,877 @@
 #include "encode.hpp"
+#include "async_io.hpp"
 #include "core.hpp"
-#include "binary_forest.hpp"
-#include "priority_queue.hpp"
 #include "bitstream_writer.hpp"
+#include "context_model.hpp"
 
 #include <algorithm>
 #include <vector>
 #include <numeric>
 #include <fstream>
 #include <cassert>
+#include <span>
+#include <streambuf>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/// Примерная стоимость одного символа в таблице кода Хаффмана.
+constexpr double TABLE_BITS_PER_SYMBOL = 12;
+/// Доля покрытых совпадениями байтов, начиная с которой выбирается LZ77. На маленьких файлах
+/// две таблицы LZ77 не окупаются.
+constexpr double LZ77_MATCH_DENSITY = 0.3;
+constexpr size_t LZ77_MIN_SIZE = 1024;
+/// Потеря кода Хаффмана относительно энтропии (бит на байт), начиная с которой выбирается tANS.
+constexpr double TANS_REDUNDANCY = 0.1;
+
+/// Поток из участков файла с данными, идущих подряд: дыры между ними пропускаются.
+class DataRangesBuffer : public std::streambuf {
+public:
+    DataRangesBuffer(std::unique_ptr<std::istream> stream, std::span<const FileRange> ranges)
+        : stream_(std::move(stream)), ranges_(ranges), range_(0), left_(0), chunk_(CHUNK_SIZE) {
+    }
+
+protected:
+    int_type underflow() override {
+        while (left_ == 0) {
+            if (range_ == ranges_.size()) {
+                return traits_type::eof();
+            }
+            stream_->clear();
+            stream_->seekg(static_cast<std::streamoff>(ranges_[range_].offset));
+            left_ = ranges_[range_++].size;
+        }
+
+        const auto size = static_cast<std::streamsize>(std::min<uint64_t>(left_, chunk_.size()));
+        stream_->read(chunk_.data(), size);
+        if (stream_->gcount() != size) {
+            throw std::ios_base::failure("The file was truncated while reading.");
+        }
+        left_ -= static_cast<uint64_t>(size);
+        setg(chunk_.data(), chunk_.data(), chunk_.data() + size);
+        return traits_type::to_int_type(chunk_.front());
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    std::unique_ptr<std::istream> stream_;
+    std::span<const FileRange> ranges_;
+    size_t range_;
+    /// Сколько байт текущего участка еще не прочитано.
+    uint64_t left_;
+    std::vector<char> chunk_;
+};
+
+/// Поднимает флаг, если область видимости покидается из-за исключения: запись осталась недописанной.
+class FailureFlag {
+public:
+    explicit FailureFlag(bool& failed) : failed_(failed), exceptions_(std::uncaught_exceptions()) {
+    }
 
-ArchiveEncoder::CharFrequency ArchiveEncoder::CharFrequencyCombiner::operator()(const CharFrequency& lhs,
-                                                                                const CharFrequency& rhs) {
-    return CharFrequency{.occurrences_count = lhs.occurrences_count + rhs.occurrences_count,
-                         .character = std::min(lhs.character, rhs.character)};
+    ~FailureFlag() {
+        if (std::uncaught_exceptions() > exceptions_) {
+            failed_ = true;
+        }
+    }
+
+private:
+    bool& failed_;
+    int exceptions_;
+};
+
+}  // namespace
+
+EncodingMethod ChooseEncodingMethod(const SampleEstimate& estimate, const SelectionPolicy& policy) {
+    if (policy.repetitive_method != EncodingMethod::HUFFMAN && estimate.match_density >= LZ77_MATCH_DENSITY &&
+        estimate.content_size >= LZ77_MIN_SIZE) {
+        return policy.repetitive_method;
+    }
+
+    const auto size = static_cast<double>(estimate.content_size);
+    const double huffman_bits =
+        estimate.huffman_bits * size + TABLE_BITS_PER_SYMBOL * static_cast<double>(estimate.used_symbols);
+    if (huffman_bits >= policy.stored_ratio * archive::BYTE_BIT_COUNT * size) {
+        return EncodingMethod::STORED;
+    }
+    if (estimate.huffman_bits - estimate.entropy >= TANS_REDUNDANCY) {
+        return EncodingMethod::TANS;
+    }
+    return EncodingMethod::HUFFMAN;
 }
 
-bool ArchiveEncoder::HuffmanIteratorCompareGreater::operator()(const HuffmanTree::Iterator& lhs,
-                                                               const HuffmanTree::Iterator& rhs) const {
-    return std::tie(lhs->occurrences_count, lhs->character) > std::tie(rhs->occurrences_count, rhs->character);
+EncoderOptions EncoderOptions::FromLevel(size_t level) {
+    if (level < MIN_LEVEL || level > MAX_LEVEL) {
+        throw std::invalid_argument("Unknown compression level.");
+    }
+
+    EncoderOptions options;
+    if (level <= 2) {
+        options.block_mode = true;
+        options.block_codec = std::nullopt;
+        options.block_size = level == 1 ? Codec::BLOCK_SIZE : Codec::BLOCK_SIZE / 4;
+        options.selection.stored_ratio = level == 1 ? 0.9 : 0.95;
+        return options;
+    }
+
+    // Уровни 3-7 отличаются только глубиной поиска LZ77 и размером окна.
+    constexpr std::array<size_t, 5> CHAIN_DEPTHS{4, 8, 16, 32, 64};
+    options.method = EncodingMethod::AUTO;
+    options.lz77.chain_depth = CHAIN_DEPTHS[std::min<size_t>(level, 7) - 3];
+    options.lz77.window_bits = level >= 7 ? 18 : 16;
+    options.selection.stored_ratio = level <= 4 ? 0.97 : level <= 6 ? 0.98 : 0.99;
+    if (level == 8) {
+        options.selection.repetitive_method = EncodingMethod::BWT;
+    } else if (level == 9) {
+        options.selection.repetitive_method = EncodingMethod::CONTEXT_MIXING;
+        options.context_mixing_order = ContextMixingModel::MAX_ORDER;
+    }
+    return options;
 }
 
-ArchiveEncoder::ArchiveEncoder(BitWriter& bs)
-    : bs_(std::ref(bs)), tree_(), root_(), codes_(), order_(), first_file_(true) {
+ArchiveEncoder::ArchiveEncoder(BitWriter& bs, EncoderOptions options)
+    : bs_(std::ref(bs)),
+      options_(options),
+      code_(),
+      first_file_(true),
+      last_entry_extended_(false),
+      entry_failed_(false),
+      entries_count_(0),
+      source_by_digest_(),
+      current_open_(),
+      lz77_encoder_(options_.lz77) {
+    if (options_.bit_order != BitOrder::MSB_FIRST && options_.format_version == archive::FormatVersion::V1) {
+        throw std::invalid_argument("The bit order can be changed only in format version 2 and above.");
+    }
 }
 
 ArchiveEncoder::~ArchiveEncoder() {
-    if (!bs_.Closed()) {
+    if (!bs_.Closed() && !entry_failed_) {
         Close();
     }
 }
 
 void ArchiveEncoder::Encode(const std::string_view filename, std::unique_ptr<std::istream> is) {
-    // Требуется для того, чтобы при вызове функции извне пользователь мог самостоятельно
-    // не следить за тем, какой файл будет последним.
-    if (!first_file_) {
-        WriteCharacter(archive::ONE_MORE_FILE);
-        root_.Reset();
-    } else {
-        first_file_ = false;
+    FailureFlag failure(entry_failed_);
+    current_open_ = nullptr;
+    EncodeEntry(filename, is);
+}
+
+void ArchiveEncoder::Encode(const std::string& filename, const StreamOpener& open) {
+    FailureFlag failure(entry_failed_);
+    auto stream = open(filename);
+    current_open_ = open;
+    EncodeEntry(filename, stream);
+}
+
+void ArchiveEncoder::EncodeEntry(std::string_view filename, std::unique_ptr<std::istream>& is) {
+    BeginEntry();
+
+    if (options_.block_mode) {
+        EncodeBlocks(filename, is);
+        return;
     }
 
-    auto char_frequency = ArchiveEncoder::CalculateCharFrequencyArray(filename, is);
-    GenerateHuffmanTree(char_frequency);
+    EncodingMethod method = options_.method;
+    if (method == EncodingMethod::AUTO) {
+        const auto estimate = SampleEstimate::FromStream(*is);
+        method = ChooseEncodingMethod(estimate, options_.selection);
+        // Совпадения со словарем по фрагментам не оцениваются, а словарь обучен на похожих файлах.
+        if (options_.dictionary && options_.selection.repetitive_method == EncodingMethod::LZ77 &&
+            method != EncodingMethod::STORED) {
+            method = EncodingMethod::LZ77;
+        }
+        if (options_.selection_listener) {
+            options_.selection_listener(filename, estimate, method);
+        }
+    }
 
-    for (auto& code : codes_) {
-        code.clear();
+    if (method == EncodingMethod::CONTEXT_HUFFMAN) {
+        EncodeContextHuffman(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::LZ77) {
+        EncodeLz77(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::TANS) {
+        EncodeTans(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::CONTEXT_MIXING) {
+        EncodeContextMixing(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::BWT) {
+        EncodeBwt(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::STORED) {
+        EncodeStored(filename, is);
+        return;
+    }
+    if (method == EncodingMethod::RAW) {
+        EncodeRaw(filename, is);
+        return;
+    }
+    if (options_.model) {
+        EncodeWithModel(filename, is);
+        return;
+    }
+    if (options_.run_length_filter) {
+        EncodeRunLength(filename, is);
+        return;
+    }
+    if (options_.format_version == archive::FormatVersion::V3) {
+        EncodeByteHuffman(filename, is);
+        return;
     }
 
-    tree_.ProvidePaths(root_, [&](const CharFrequency& char_frequency, const HuffmanTree::BinaryString& binary_string) {
-        codes_[char_frequency.character] = binary_string;
-    });
+    Hasher128 hasher;
+    auto char_frequency = ArchiveEncoder::CalculateCharFrequencyArray(filename, is, hasher);
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *is)) {
+        return;
+    }
 
-    СonvertHuffmanCodeToCanonicalForm();
+    GenerateCodes(char_frequency);
+    if (options_.format_version != archive::FormatVersion::V1) {
+        WriteExtendedHeader(archive::EntryKind::HUFFMAN);
+    }
     EncodeHeader();
     EncodeData(filename, is);
+    last_entry_extended_ = false;
 }
 
 void ArchiveEncoder::EncodeFile(const std::string& filename) {
+    FailureFlag failure(entry_failed_);
+    if (options_.sparse_files && AsyncFileReader::IsRegularFile(filename)) {
+        auto layout = ReadFileLayout(filename);
+        if (layout.DataSize() < layout.size && layout.data.size() < (uint64_t{1} << archive::RANGE_COUNT_BIT_COUNT)) {
+            EncodeSparse(filename, layout);
+            return;
+        }
+    }
+    if (options_.method == EncodingMethod::RAW && !options_.block_mode && AsyncFileReader::IsRegularFile(filename)) {
+        EncodeRawFile(filename);
+        return;
+    }
+    Encode(filename, [this](const std::string& name) { return OpenFile(name); });
+}
+
+void ArchiveEncoder::SetMethod(EncodingMethod method) {
+    options_.method = method;
+}
+
+void ArchiveEncoder::EncodeSolid(const std::vector<std::string>& filenames, const StreamOpener& open) {
+    FailureFlag failure(entry_failed_);
+    CharFrequencyArray char_frequency;
+    std::ranges::fill(char_frequency, 0);
+
+    // Файлы, содержимое которых уже встречалось, в группу не попадают и записываются ссылками после нее.
+    std::vector<const std::string*> group;
+    std::vector<std::pair<const std::string*, size_t>> duplicates;
+    for (const auto& filename : filenames) {
+        auto stream = open(filename);
+        Hasher128 hasher;
+        // В версии 3 имена не кодируются и в частоты не входят.
+        const bool byte_code = options_.format_version == archive::FormatVersion::V3;
+        auto file_frequency = CalculateCharFrequencyArray(byte_code ? std::string_view() : filename, stream, hasher);
+
+        const auto digest = hasher.Finish();
+        if (const auto original = FindDuplicate(digest, *stream)) {
+            duplicates.emplace_back(&filename, *original);
+            continue;
+        }
+
+        AddDuplicateSource(digest, entries_count_++, filename, open);
+        group.push_back(&filename);
+        for (size_t i = 0; i < archive::CHARS_COUNT; ++i) {
+            char_frequency[i] += file_frequency[i];
+        }
+    }
+
+    if (!group.empty() && options_.format_version == archive::FormatVersion::V3) {
+        BeginEntry();
+        code_ = HuffmanCode::FromFrequencies(std::span(char_frequency).first(archive::BYTES_COUNT),
+                                             HuffmanCode::MAX_COMPACT_LENGTH);
+        WriteExtendedHeader(archive::EntryKind::SOLID);
+        code_.WriteCompact(bs_);
+        for (const auto* filename : group) {
+            if (filename != group.front()) {
+                bs_.WriteBit(true);
+            }
+            auto stream = open(*filename);
+            EncodeSized(*filename, *stream, StreamSize(*stream), code_);
+        }
+        bs_.WriteBit(false);
+    } else if (!group.empty()) {
+        BeginEntry();
+        GenerateCodes(char_frequency);
+        WriteExtendedHeader(archive::EntryKind::SOLID);
+        EncodeHeader();
+        for (const auto* filename : group) {
+            if (filename != group.front()) {
+                WriteCharacter(archive::ONE_MORE_FILE);
+            }
+            auto stream = open(*filename);
+            EncodeData(*filename, stream);
+        }
+        WriteCharacter(archive::ARCHIVE_END);
+    }
+
+    // Ссылки занимают номера записей так же, как в TryEncodeDuplicate.
+    for (const auto& [filename, original_entry] : duplicates) {
+        BeginEntry();
+        ++entries_count_;
+        EncodeDuplicate(*filename, original_entry);
+    }
+}
+
+void ArchiveEncoder::EncodeSolidFiles(const std::vector<std::string>& filenames) {
+    EncodeSolid(filenames, [this](const std::string& filename) { return OpenFile(filename); });
+}
+
+std::unique_ptr<std::istream> ArchiveEncoder::OpenFile(const std::string& filename) const {
+    // Обычные файлы читаются с упреждением; остальные (каналы, устройства) нельзя читать с произвольного места.
+    if (AsyncFileReader::IsRegularFile(filename)) {
+        auto stream = std::make_unique<AsyncInputFile>(filename, options_.input);
+        stream->exceptions(std::ios_base::badbit);
+        return stream;
+    }
+
     auto stream = std::make_unique<std::ifstream>();
     stream->exceptions(std::ofstream::badbit);
     stream->open(filename, std::ios::binary);
-    Encode(filename, std::move(stream));
+    return stream;
+}
+
+uint64_t ArchiveEncoder::StreamSize(std::istream& stream) {
+    stream.clear();
+    stream.seekg(0, std::ios::end);
+    const auto size = stream.tellg();
+    if (!stream || size < 0) {
+        throw std::ios_base::failure("Cannot determine the size of the file.");
+    }
+    stream.seekg(0);
+    return static_cast<uint64_t>(size);
 }
 
 void ArchiveEncoder::Close() {
     assert(!first_file_);
-    WriteCharacter(archive::ARCHIVE_END);
+    WriteEntrySeparator(false);
     bs_.Close();
 }
 
+void ArchiveEncoder::BeginEntry() {
+    // Требуется для того, чтобы при вызове функции извне пользователь мог самостоятельно
+    // не следить за тем, какой файл будет последним.
+    if (!first_file_) {
+        WriteEntrySeparator(true);
+        return;
+    }
+
+    first_file_ = false;
+    if (options_.format_version != archive::FormatVersion::V1) {
+        // Пролог читается декодером первой версии, поэтому записывается с признаком расширенной записи.
+        bs_.WriteInt(archive::EXTENDED_ENTRY_MARKER, archive::ALPHABET_BIT_COUNT);
+        bs_.WriteInt(static_cast<size_t>(archive::EntryKind::FORMAT), archive::ENTRY_KIND_BIT_COUNT);
+        const size_t flags = options_.bit_order == BitOrder::LSB_FIRST ? archive::FORMAT_LSB_FIRST_FLAG : 0;
+        bs_.WriteInt(static_cast<size_t>(options_.format_version) | flags, archive::FORMAT_VERSION_BIT_COUNT);
+        bs_.SetBitOrder(options_.bit_order);
+    }
+}
+
+void ArchiveEncoder::WriteEntrySeparator(bool one_more_file) {
+    // После расширенной записи таблицы кодов нет, поэтому разделитель записывается одним битом.
+    if (last_entry_extended_) {
+        bs_.WriteBit(one_more_file);
+    } else {
+        WriteCharacter(one_more_file ? archive::ONE_MORE_FILE : archive::ARCHIVE_END);
+    }
+}
+
+void ArchiveEncoder::WriteExtendedHeader(archive::EntryKind kind) {
+    // Начиная со второй версии формата все записи начинаются с типа, и признак не нужен.
+    if (options_.format_version == archive::FormatVersion::V1) {
+        bs_.WriteInt(archive::EXTENDED_ENTRY_MARKER, archive::ALPHABET_BIT_COUNT);
+    }
+    bs_.WriteInt(static_cast<size_t>(kind), archive::ENTRY_KIND_BIT_COUNT);
+    // Признак поднимается вместе с заголовком, а не после содержимого, и не зависит от того, дописана ли запись.
+    // Запись HUFFMAN версии 2 разделяется символом кода и сбрасывает его сама.
+    last_entry_extended_ = true;
+}
+
+void ArchiveEncoder::WriteRawName(std::string_view filename) {
+    bs_.WriteInt(filename.size(), archive::NAME_LENGTH_BIT_COUNT);
+    for (uint8_t byte : filename) {
+        bs_.WriteInt(byte, archive::BYTE_BIT_COUNT);
+    }
+}
+
+void ArchiveEncoder::EncodeDuplicate(std::string_view filename, size_t original_entry) {
+    WriteExtendedHeader(archive::EntryKind::DUPLICATE);
+    bs_.WriteInt(original_entry, archive::ENTRY_INDEX_BIT_COUNT);
+    WriteRawName(filename);
+}
+
+std::optional<size_t> ArchiveEncoder::FindDuplicate(const Digest128& digest, std::istream& stream) const {
+    const auto source = source_by_digest_.find(digest);
+    if (source == source_by_digest_.end()) {
+        return std::nullopt;
+    }
+
+    // Отпечатки разных файлов могут совпасть, поэтому ссылка пишется только на побайтно равный файл.
+    std::vector<char> expected(Codec::BLOCK_SIZE);
+    std::vector<char> actual(Codec::BLOCK_SIZE);
+    try {
+        auto original = source->second.open(source->second.filename);
+        stream.clear();
+        stream.seekg(0);
+        while (true) {
+            original->read(expected.data(), static_cast<std::streamsize>(expected.size()));
+            stream.read(actual.data(), static_cast<std::streamsize>(actual.size()));
+            const auto count = original->gcount();
+            if (count != stream.gcount() || !std::equal(expected.begin(), expected.begin() + count, actual.begin())) {
+                return std::nullopt;
+            }
+            if (count == 0) {
+                return source->second.entry;
+            }
+        }
+    } catch (const std::ios_base::failure&) {
+        // Файл, который нельзя прочитать заново, не годится для ссылки; текущий файл записывается целиком.
+        return std::nullopt;
+    }
+}
+
+void ArchiveEncoder::AddDuplicateSource(const Digest128& digest, size_t entry, std::string_view filename,
+                                        const StreamOpener& open) {
+    if (open) {
+        source_by_digest_.try_emplace(digest, DuplicateSource{entry, std::string(filename), open});
+    }
+}
+
+bool ArchiveEncoder::TryEncodeDuplicate(std::string_view filename, const Digest128& digest, std::istream& stream) {
+    const size_t entry = entries_count_++;
+    if (const auto original = FindDuplicate(digest, stream)) {
+        EncodeDuplicate(filename, *original);
+        return true;
+    }
+
+    AddDuplicateSource(digest, entry, filename, current_open_);
+    return false;
+}
+
+void ArchiveEncoder::EncodeContextHuffman(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    ContextHuffmanModel model;
+    Hasher128 hasher;
+    size_t size = 0;
+
+    stream->clear();
+    stream->seekg(0);
+    uint8_t byte = 0;
+    while (stream->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t))) {
+        model.Count(byte);
+        hasher.Update(byte);
+        ++size;
+    }
+
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    model.Build();
+    WriteExtendedHeader(archive::EntryKind::CONTEXT_HUFFMAN);
+    bs_.WriteInt(size, archive::SIZE_BIT_COUNT);
+    model.WriteTables(bs_);
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    while (stream->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t))) {
+        model.Encode(bs_, byte);
+    }
+}
+
+void ArchiveEncoder::EncodeLz77(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    Hasher128 hasher;
+    stream->clear();
+    stream->seekg(0);
+    uint8_t byte = 0;
+    while (stream->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t))) {
+        hasher.Update(byte);
+    }
+
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    const auto& dictionary = options_.dictionary;
+    WriteExtendedHeader(dictionary ? archive::EntryKind::LZ77_DICTIONARY : archive::EntryKind::LZ77);
+    bs_.WriteInt(options_.lz77.window_bits, Lz77Parameters::WINDOW_BITS_BIT_COUNT);
+    if (dictionary) {
+        bs_.WriteInt(dictionary->Id(), LzDictionary::ID_BIT_COUNT);
+    }
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    lz77_encoder_.Encode(*stream, bs_, dictionary ? dictionary->Content() : std::span<const uint8_t>());
+}
+
+void ArchiveEncoder::EncodeTans(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    // Имя записывается отдельно, поэтому частоты считаются только по содержимому.
+    Hasher128 hasher;
+    const auto char_frequency = CalculateCharFrequencyArray({}, stream, hasher);
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    const auto frequencies = std::span(char_frequency).first(TansTable::ALPHABET_SIZE);
+    const auto table = TansTable::FromFrequencies(frequencies);
+    WriteExtendedHeader(archive::EntryKind::TANS);
+    bs_.WriteInt(std::accumulate(frequencies.begin(), frequencies.end(), size_t{0}), archive::SIZE_BIT_COUNT);
+    table.Write(bs_);
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    TansEncoder encoder(table);
+    std::vector<uint8_t> block(TansEncoder::BLOCK_SIZE);
+    while (stream->read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size())) ||
+           stream->gcount() > 0) {
+        encoder.EncodeBlock(std::span(block).first(static_cast<size_t>(stream->gcount())), bs_);
+    }
+}
+
+void ArchiveEncoder::EncodeContextMixing(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    Hasher128 hasher;
+    const auto char_frequency = CalculateCharFrequencyArray({}, stream, hasher);
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    const size_t size = std::accumulate(char_frequency.begin(), char_frequency.begin() + 256, size_t{0});
+    WriteExtendedHeader(archive::EntryKind::CONTEXT_MIXING);
+    bs_.WriteInt(size, archive::SIZE_BIT_COUNT);
+    bs_.WriteInt(options_.context_mixing_order, ContextMixingModel::ORDER_BIT_COUNT);
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    ContextMixingEncoder encoder(bs_, options_.context_mixing_order, size);
+    uint8_t byte = 0;
+    while (stream->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t))) {
+        encoder.Encode(byte);
+    }
+    encoder.Flush();
+}
+
+void ArchiveEncoder::EncodeBwt(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    Hasher128 hasher;
+    CalculateCharFrequencyArray({}, stream, hasher);
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    WriteExtendedHeader(archive::EntryKind::BWT);
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    BwtEncoder().Encode(*stream, bs_);
+}
+
+void ArchiveEncoder::EncodeRunLength(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    std::vector<char> chunk(CHUNK_SIZE);
+    const auto for_each_chunk = [&](auto&& process) {
+        stream->clear();
+        stream->seekg(0);
+        while (stream->read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || stream->gcount() > 0) {
+            process(std::span(reinterpret_cast<const uint8_t*>(chunk.data()), static_cast<size_t>(stream->gcount())));
+        }
+    };
+
+    Hasher128 hasher;
+    std::vector<size_t> frequencies(RunLengthSplitter::ALPHABET_SIZE, 0);
+    const auto count = [&](size_t symbol, const ValueBucket&) { ++frequencies[symbol]; };
+    RunLengthSplitter splitter;
+    for_each_chunk([&](std::span<const uint8_t> data) {
+        hasher.Update(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()));
+        splitter.Feed(data, count);
+    });
+    splitter.Finish(count);
+
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    WriteExtendedHeader(archive::EntryKind::RUN_LENGTH);
+    code.WriteCompact(bs_);
+    WriteRawName(filename);
+
+    const auto write = [&](size_t symbol, const ValueBucket& bucket) {
+        for (bool bit : code.GetCode(symbol)) {
+            bs_.WriteBit(bit);
+        }
+        bs_.WriteInt(bucket.extra, bucket.extra_bit_count);
+    };
+    for_each_chunk([&](std::span<const uint8_t> data) { splitter.Feed(data, write); });
+    splitter.Finish(write);
+}
+
+void ArchiveEncoder::EncodeStored(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    std::vector<char> chunk(CHUNK_SIZE);
+
+    Hasher128 hasher;
+    size_t size = 0;
+    stream->clear();
+    stream->seekg(0);
+    while (stream->read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || stream->gcount() > 0) {
+        hasher.Update(std::string_view(chunk.data(), static_cast<size_t>(stream->gcount())));
+        size += static_cast<size_t>(stream->gcount());
+    }
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    WriteExtendedHeader(archive::EntryKind::STORED);
+    bs_.WriteInt(size, archive::SIZE_BIT_COUNT);
+    WriteRawName(filename);
+
+    stream->clear();
+    stream->seekg(0);
+    while (stream->read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || stream->gcount() > 0) {
+        for (char byte : std::span(chunk).first(static_cast<size_t>(stream->gcount()))) {
+            bs_.WriteInt(static_cast<uint8_t>(byte), archive::BYTE_BIT_COUNT);
+        }
+    }
+}
+
+void ArchiveEncoder::EncodeRaw(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    const uint64_t size = StreamSize(*stream);
+    WriteRawHeader(filename, size);
+    // Выравнивание есть и у пустой записи: декодер пропускает его до содержимого в любом случае.
+    bs_.AlignToWord();
+
+    std::vector<char> chunk(1 << 16);
+    for (uint64_t left = size; left > 0;) {
+        const auto count = static_cast<size_t>(std::min<uint64_t>(left, chunk.size()));
+        if (!stream->read(chunk.data(), static_cast<std::streamsize>(count))) {
+            throw std::ios_base::failure("The file was truncated while reading.");
+        }
+        bs_.WriteBytes(std::span(reinterpret_cast<const uint8_t*>(chunk.data()), count));
+        left -= count;
+    }
+}
+
+void ArchiveEncoder::EncodeRawFile(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status {};
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        const int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::ios_base::failure("Cannot open " + filename, std::error_code(error, std::system_category()));
+    }
+
+    BeginEntry();
+    WriteRawHeader(filename, static_cast<uint64_t>(status.st_size));
+    try {
+        bs_.CopyBytes(fd, 0, static_cast<uint64_t>(status.st_size));
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+void ArchiveEncoder::WriteRawHeader(std::string_view filename, uint64_t size) {
+    // Содержимое копирует ядро, и процесс его не видит; отдельный проход ради отпечатка отменил бы выигрыш
+    // от copy_file_range, поэтому запись RAW не может стать источником ссылки.
+    ++entries_count_;
+    WriteExtendedHeader(archive::EntryKind::RAW);
+    bs_.WriteInt(size, archive::SIZE_BIT_COUNT);
+    WriteRawName(filename);
+}
+
+void ArchiveEncoder::EncodeBlocks(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    std::vector<char> chunk(Codec::BLOCK_SIZE);
+    Hasher128 hasher;
+    stream->clear();
+    stream->seekg(0);
+    while (stream->read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || stream->gcount() > 0) {
+        hasher.Update(std::string_view(chunk.data(), static_cast<size_t>(stream->gcount())));
+    }
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    stream->clear();
+    stream->seekg(0);
+    WriteExtendedHeader(archive::EntryKind::BLOCKS);
+    WriteRawName(filename);
+    WriteBlocks(*stream);
+}
+
+void ArchiveEncoder::EncodeStream(std::string_view filename, std::unique_ptr<std::istream> stream) {
+    FailureFlag failure(entry_failed_);
+    // Первый фрагмент читается до заголовка: поток, из которого читать нельзя (например, каталог), не оставляет
+    // в архиве начатой записи.
+    stream->peek();
+    BeginEntry();
+    // Канал нельзя перечитать ни чтобы найти совпадение до заголовка, ни чтобы сравнить с ним следующий файл,
+    // поэтому ссылок на эту запись нет.
+    ++entries_count_;
+    WriteExtendedHeader(archive::EntryKind::BLOCKS);
+    WriteRawName(filename);
+    WriteBlocks(*stream);
+}
+
+void ArchiveEncoder::EncodeSparse(const std::string& filename, const FileLayout& layout) {
+    // Файл открывается и начинает читаться до заголовка, чтобы ошибка не оставила начатой записи.
+    DataRangesBuffer buffer(OpenFile(filename), layout.data);
+    std::istream stream(&buffer);
+    stream.exceptions(std::ios_base::badbit);
+    stream.peek();
+
+    BeginEntry();
+    // Отпечаток всего содержимого потребовал бы прочитать дыры, поэтому ссылок на такие записи нет.
+    ++entries_count_;
+    WriteExtendedHeader(archive::EntryKind::SPARSE);
+    bs_.WriteInt(layout.size, archive::SIZE_BIT_COUNT);
+    bs_.WriteInt(layout.data.size(), archive::RANGE_COUNT_BIT_COUNT);
+    for (const FileRange& range : layout.data) {
+        bs_.WriteInt(range.offset, archive::SIZE_BIT_COUNT);
+        bs_.WriteInt(range.size, archive::SIZE_BIT_COUNT);
+    }
+    WriteRawName(filename);
+    WriteBlocks(stream);
+}
+
+void ArchiveEncoder::WriteBlocks(std::istream& stream) {
+    const auto& registry = CodecRegistry::Default();
+    const Codec* fixed_codec = nullptr;
+    if (options_.block_codec) {
+        fixed_codec = registry.Find(*options_.block_codec);
+        if (fixed_codec == nullptr) {
+            throw std::invalid_argument("Unknown codec.");
+        }
+    }
+
+    if (options_.block_size == 0 || options_.block_size > Codec::BLOCK_SIZE) {
+        throw std::invalid_argument("Invalid block size.");
+    }
+    std::vector<uint8_t> block(options_.block_size);
+    const auto read_block = [&] {
+        stream.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+        return std::span(block).first(static_cast<size_t>(stream.gcount()));
+    };
+
+    for (auto data = read_block(); !data.empty(); data = read_block()) {
+        const Codec* codec = fixed_codec;
+        if (codec == nullptr) {
+            const auto estimate = SampleEstimate::FromBlock(data);
+            codec = &registry.Choose(estimate);
+            const double stored_bits = static_cast<double>(archive::BYTE_BIT_COUNT * data.size());
+            if (codec->Estimate(estimate) >= options_.selection.stored_ratio * stored_bits) {
+                codec = registry.Find(archive::CodecId::STORED);
+            }
+        }
+        bs_.WriteBit(true);
+        bs_.WriteInt(static_cast<size_t>(codec->Id()), archive::CODEC_ID_BIT_COUNT);
+        bs_.WriteInt(data.size(), Codec::BLOCK_SIZE_BIT_COUNT);
+        codec->EncodeBlock(data, bs_);
+    }
+    bs_.WriteBit(false);
+}
+
+void ArchiveEncoder::EncodeWithModel(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    const uint64_t size = StreamSize(*stream);
+    WriteExtendedHeader(archive::EntryKind::MODEL_HUFFMAN);
+    bs_.WriteInt(options_.model->Id(), HuffmanModel::ID_BIT_COUNT);
+
+    // Отпечаток считается в том же проходе, поэтому ссылкой может стать только следующий такой же файл.
+    const size_t entry = entries_count_++;
+    Hasher128 hasher;
+    EncodeSized(filename, *stream, size, options_.model->GetCode(), &hasher);
+    AddDuplicateSource(hasher.Finish(), entry, filename, current_open_);
+}
+
+void ArchiveEncoder::EncodeByteHuffman(std::string_view filename, std::unique_ptr<std::istream>& stream) {
+    const uint64_t size = StreamSize(*stream);
+    // Имя записывается отдельно, поэтому частоты считаются только по содержимому.
+    Hasher128 hasher;
+    const auto char_frequency = CalculateCharFrequencyArray({}, stream, hasher);
+    if (TryEncodeDuplicate(filename, hasher.Finish(), *stream)) {
+        return;
+    }
+
+    code_ = HuffmanCode::FromFrequencies(std::span(char_frequency).first(archive::BYTES_COUNT),
+                                         HuffmanCode::MAX_COMPACT_LENGTH);
+    WriteExtendedHeader(archive::EntryKind::HUFFMAN);
+    code_.WriteCompact(bs_);
+    EncodeSized(filename, *stream, size, code_);
+}
+
+void ArchiveEncoder::EncodeSized(std::string_view filename, std::istream& stream, uint64_t size,
+                                 const HuffmanCode& code, Hasher128* hasher) {
+    bs_.WriteInt(size, archive::SIZE_BIT_COUNT);
+    WriteRawName(filename);
+
+    // Размер известен заранее, поэтому байты кодируются без служебных символов.
+    stream.clear();
+    stream.seekg(0);
+    std::vector<char> chunk(1 << 16);
+    uint64_t written = 0;
+    while (written < size && (stream.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) ||
+                              stream.gcount() > 0)) {
+        const auto data = std::span(chunk).first(
+            static_cast<size_t>(std::min<uint64_t>(size - written, static_cast<uint64_t>(stream.gcount()))));
+        if (hasher != nullptr) {
+            hasher->Update(std::string_view(data.data(), data.size()));
+        }
+        for (char byte : data) {
+            for (bool bit : code.GetCode(static_cast<uint8_t>(byte))) {
+                bs_.WriteBit(bit);
+            }
+        }
+        written += data.size();
+    }
+    if (written != size) {
+        throw std::ios_base::failure("The file was truncated while it was being archived.");
+    }
+}
+
 void ArchiveEncoder::WriteCharacter(Char ch) {
-    for (auto bit : codes_[ch]) {
+    for (auto bit : code_.GetCode(ch)) {
         bs_.WriteBit(bit);
     }
 }
 
 void ArchiveEncoder::EncodeHeader() {
-    bs_.WriteInt(order_.size(), archive::ALPHABET_BIT_COUNT);
-    for (size_t ch : order_) {
-        bs_.WriteInt(ch, archive::ALPHABET_BIT_COUNT);
+    if (options_.format_version != archive::FormatVersion::V1) {
+        code_.WriteCompact(bs_);
+        return;
     }
 
-    size_t max_symbol_code_size = 0;
-    for (size_t ch : order_) {
-        max_symbol_code_size = std::max(max_symbol_code_size, codes_[ch].size());
+    const auto& order = code_.GetOrder();
+    bs_.WriteInt(order.size(), archive::ALPHABET_BIT_COUNT);
+    for (size_t ch : order) {
+        bs_.WriteInt(ch, archive::ALPHABET_BIT_COUNT);
     }
 
-    std::vector<size_t> symbol_count_with_code_size(max_symbol_code_size);
-    for (size_t ch : order_) {
-        ++symbol_count_with_code_size[codes_[ch].size() - 1];
+    std::vector<size_t> symbol_count_with_code_size(code_.MaxLength());
+    for (size_t ch : order) {
+        ++symbol_count_with_code_size[code_.GetLength(ch) - 1];
     }
 
     for (size_t count : symbol_count_with_code_size) {
@@ -111,29 +893,16 @@ void ArchiveEncoder::EncodeData(std::string_view filename, std::unique_ptr<std::
     }
 }
 
-void ArchiveEncoder::GenerateHuffmanTree(const CharFrequencyArray& distribution) {
-    PriorityQueue<HuffmanTree::Iterator, HuffmanIteratorCompareGreater> queue;
-    for (size_t i = 0; i < archive::CHARS_COUNT; ++i) {
-        if (distribution[i] == 0) {
-            continue;
-        }
-
-        queue.Emplace(tree_.EmplaceLeaf(CharFrequency{.occurrences_count = distribution[i], .character = Char{i}}));
-    }
-
-    while (queue.Size() > 1) {
-        auto a = queue.Top();
-        queue.Pop();
-        auto b = queue.Top();
-        queue.Pop();
-        queue.Emplace(tree_.Unite(a, b));
-    }
-
-    root_ = queue.Top();
+void ArchiveEncoder::GenerateCodes(const CharFrequencyArray& distribution) {
+    const size_t max_length = options_.format_version == archive::FormatVersion::V1
+                                  ? HuffmanCode::UNLIMITED_LENGTH
+                                  : HuffmanCode::MAX_COMPACT_LENGTH;
+    code_ = HuffmanCode::FromFrequencies(distribution, max_length);
 }
 
 ArchiveEncoder::CharFrequencyArray ArchiveEncoder::CalculateCharFrequencyArray(const std::string_view filename,
-                                                                               std::unique_ptr<std::istream>& stream) {
+                                                                               std::unique_ptr<std::istream>& stream,
+                                                                               Hasher128& hasher) {
     CharFrequencyArray char_frequency;
     std::ranges::fill(char_frequency, 0);
 
@@ -150,46 +919,8 @@ ArchiveEncoder::CharFrequencyArray ArchiveEncoder::CalculateCharFrequencyArray(c
     uint8_t byte = 0;
     while (stream->read(reinterpret_cast<char*>(&byte), sizeof(uint8_t))) {
         ++char_frequency[byte];
+        hasher.Update(byte);
     }
 
     return char_frequency;
 }
-
-void ArchiveEncoder::СonvertHuffmanCodeToCanonicalForm() {
-    order_.clear();
-    for (size_t i = 0; i < archive::CHARS_COUNT; ++i) {
-        if (!codes_[i].empty()) {
-            order_.push_back(i);
-        }
-    }
-
-    std::ranges::sort(order_, [&](size_t lhs, size_t rhs) {
-        auto x = codes_[lhs].size() <=> codes_[rhs].size();
-        if (x != std::strong_ordering::equal) {
-            return x < 0;
-        }
-        return lhs < rhs;
-    });
-
-    std::vector<bool> current;
-    for (size_t i : order_) {
-        if (!current.empty()) {
-            if (current.size() > codes_[i].size()) {
-                current.resize(codes_[i].size());
-            }
-
-            size_t j = current.size() - 1;
-            while (current[j]) {
-                current[j] = false;
-                --j;
-            }
-            current[j] = true;
-        }
-
-        while (current.size() < codes_[i].size()) {
-            current.push_back(false);
-        }
-
-        codes_[i] = current;
-    }
-}
\ No newline at end of file
@@ -2,54 +2,229 @@
 
 #include "core.hpp"
 #include "bitstream_writer.hpp"
-#include "binary_forest.hpp"
+#include "async_io.hpp"
+#include "huffman.hpp"
+#include "hash.hpp"
+#include "lz77.hpp"
+#include "tans.hpp"
+#include "context_mixing.hpp"
+#include "bwt.hpp"
+#include "rle.hpp"
+#include "estimate.hpp"
+#include "codec.hpp"
+#include "model.hpp"
+#include "dictionary.hpp"
 
 #include <string>
 #include <string_view>
 #include <memory>
 #include <array>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+enum class EncodingMethod {
+    /// Код Хаффмана нулевого порядка, как описано в README.
+    HUFFMAN,
+    /// Контекстная модель первого порядка (EntryKind::CONTEXT_HUFFMAN).
+    CONTEXT_HUFFMAN,
+    /// LZ77 с поиском по хэш-цепочкам (EntryKind::LZ77).
+    LZ77,
+    /// Табличный ANS (EntryKind::TANS).
+    TANS,
+    /// Адаптивный арифметический кодировщик со смешиванием контекстов (EntryKind::CONTEXT_MIXING).
+    CONTEXT_MIXING,
+    /// Преобразование Барроуза-Уилера перед кодом Хаффмана (EntryKind::BWT).
+    BWT,
+    /// Содержимое без сжатия (EntryKind::STORED).
+    STORED,
+    /// Содержимое без сжатия с границы байта (EntryKind::RAW): файлы копирует ядро, минуя буферы процесса.
+    RAW,
+    /// Выбор между STORED, HUFFMAN, TANS и LZ77 для каждой записи по оценке SampleEstimate.
+    AUTO,
+};
+
+/// @brief Параметры выбора способа кодирования по оценке SampleEstimate.
+struct SelectionPolicy {
+    /// @brief Содержимое записывается без сжатия, если оценка сжатого размера больше этой доли исходного.
+    double stored_ratio = 0.98;
+
+    /// @brief Способ для содержимого с большим количеством повторов: LZ77, BWT или CONTEXT_MIXING.
+    /// HUFFMAN - повторы не учитываются.
+    EncodingMethod repetitive_method = EncodingMethod::LZ77;
+};
+
+/// @brief Выбрать способ кодирования по оценке фрагментов содержимого: policy.repetitive_method для данных
+/// с большим количеством повторов, STORED - если код Хаффмана вместе с таблицей не окупается, TANS - если
+/// код Хаффмана заметно длиннее энтропии, иначе HUFFMAN.
+EncodingMethod ChooseEncodingMethod(const SampleEstimate& estimate, const SelectionPolicy& policy = {});
+
+struct EncoderOptions {
+    static constexpr size_t MIN_LEVEL = 1;
+    static constexpr size_t MAX_LEVEL = 9;
+
+    /// @brief Настройки уровня сжатия: 1-2 - блоки с выбором Хаффмана, tANS или хранения без сжатия,
+    /// 3-7 - выбор способа для каждого файла с LZ77 все большей глубины поиска, 8 - BWT, 9 - смешивание
+    /// контекстов для данных с повторами. С ростом уровня растет и порог, ниже которого данные не сжимаются.
+    static EncoderOptions FromLevel(size_t level);
+
+    /// @brief Версия формата создаваемого архива.
+    archive::FormatVersion format_version = archive::FormatVersion::V1;
+
+    /// @brief Порядок бит после пролога. BitOrder::LSB_FIRST отмечается в прологе и поэтому требует версии
+    /// формата 2 или выше.
+    BitOrder bit_order = BitOrder::MSB_FIRST;
+
+    /// @brief Способ кодирования содержимого файлов. На solid-группы не влияет.
+    EncodingMethod method = EncodingMethod::HUFFMAN;
+
+    /// @brief Размер окна и глубина поиска для EncodingMethod::LZ77.
+    Lz77Parameters lz77 = {};
+
+    /// @brief Словарь, которым заполняется окно LZ77 перед каждым файлом (EntryKind::LZ77_DICTIONARY).
+    /// Действует на все записи, кодируемые LZ77. В режиме EncodingMethod::AUTO с LZ77 для данных с повторами
+    /// словарем кодируются все записи, кроме STORED.
+    std::optional<LzDictionary> dictionary = std::nullopt;
+
+    /// @brief Максимальный порядок контекста для EncodingMethod::CONTEXT_MIXING.
+    size_t context_mixing_order = 4;
+
+    /// @brief Заменять серии одинаковых байтов символами повтора (EntryKind::RUN_LENGTH). Действует
+    /// только на EncodingMethod::HUFFMAN.
+    bool run_length_filter = false;
+
+    /// @brief Кодировать содержимое обученной моделью (EntryKind::MODEL_HUFFMAN) за один проход. Действует
+    /// только на EncodingMethod::HUFFMAN; совпадение с уже записанным файлом при этом не ищется, но следующие
+    /// файлы с тем же содержимым записываются ссылками.
+    std::optional<HuffmanModel> model = std::nullopt;
+
+    /// @brief Кодировать содержимое независимыми блоками кодеков из CodecRegistry (EntryKind::BLOCKS)
+    /// вместо method.
+    bool block_mode = false;
+
+    /// @brief Кодек блоков в режиме block_mode. Пустое значение - кодек выбирается для каждого блока
+    /// по CodecRegistry::Choose.
+    std::optional<archive::CodecId> block_codec = archive::CodecId::HUFFMAN;
+
+    /// @brief Размер блоков в режиме block_mode, не больше Codec::BLOCK_SIZE.
+    size_t block_size = Codec::BLOCK_SIZE;
+
+    /// @brief Выбор способа в режиме EncodingMethod::AUTO и кодека блоков, если block_codec пуст.
+    SelectionPolicy selection = {};
+
+    /// @brief Вызывается для каждой записи в режиме EncodingMethod::AUTO с выбранным способом.
+    std::function<void(std::string_view filename, const SampleEstimate& estimate, EncodingMethod method)>
+        selection_listener = {};
+
+    /// @brief Записывать файлы с дырами в EncodeFile записями EntryKind::SPARSE: кодируются только участки
+    /// с данными, кодеком block_codec, как в block_mode.
+    bool sparse_files = false;
+
+    /// @brief Чтение файлов в EncodeFile и EncodeSolidFiles, в том числе политика page cache.
+    IoOptions input = {};
+};
 
 class ArchiveEncoder {
 public:
-    explicit ArchiveEncoder(BitWriter& bs);
+    explicit ArchiveEncoder(BitWriter& bs, EncoderOptions options = {});
+    /// @brief Завершить архив, если этого не сделал Close. Если запись не удалось дописать из-за исключения,
+    /// архив не завершается: разделитель после недописанной записи его все равно не исправит.
     ~ArchiveEncoder();
 
+    /// @brief Функция, открывающая поток с содержимым файла по его имени.
+    using StreamOpener = std::function<std::unique_ptr<std::istream>(const std::string& filename)>;
+
+    /// @brief Закодировать содержимое потока. Поток нельзя открыть заново, поэтому следующие файлы с тем же
+    /// содержимым не записываются ссылками на эту запись.
     void Encode(const std::string_view filename, std::unique_ptr<std::istream> istream);
+    /// @brief Закодировать файл, открытый функцией open. Она же открывает его снова, если у одного из следующих
+    /// файлов совпадет отпечаток, поэтому должна оставаться пригодной до конца работы кодировщика.
+    void Encode(const std::string& filename, const StreamOpener& open);
     void EncodeFile(const std::string& filename);
-    void Close();
 
-private:
-    struct CharFrequency {
-        size_t occurrences_count;
-        archive::Char character;
-    };
+    /// @brief Закодировать поток, который нельзя перечитать (канал, стандартный ввод), за один проход
+    /// записью EntryKind::BLOCKS с кодеком block_codec независимо от block_mode и method. В памяти хранится
+    /// один блок; совпадение с уже записанными файлами не ищется, и ссылок на эту запись нет.
+    void EncodeStream(std::string_view filename, std::unique_ptr<std::istream> stream);
 
-    struct CharFrequencyCombiner {
-        CharFrequency operator()(const CharFrequency& lhs, const CharFrequency& rhs);
-    };
+    /// @brief Сменить способ кодирования для следующих записей. Способ записывается в каждой записи,
+    /// поэтому в одном архиве можно смешивать разные способы.
+    void SetMethod(EncodingMethod method);
+
+    /// @brief Закодировать группу файлов в solid-режиме: одна таблица кодов на всю группу, файлы
+    /// записываются друг за другом через ONE_MORE_FILE без повторных заголовков. Каждый файл
+    /// открывается дважды (подсчет частот и кодирование), одновременно открыт не более чем один.
+    /// @param filenames имена файлов группы
+    /// @param open функция, открывающая файл; как и в Encode, она нужна до конца работы кодировщика
+    void EncodeSolid(const std::vector<std::string>& filenames, const StreamOpener& open);
+    void EncodeSolidFiles(const std::vector<std::string>& filenames);
+
+    void Close();
 
+private:
     using CharFrequencyArray = std::array<size_t, archive::CHARS_COUNT>;
-    using HuffmanTree = BinaryForest<CharFrequency, CharFrequencyCombiner>;
     using Char = archive::Char;
-    using CharCodesArray = std::array<HuffmanTree::BinaryString, archive::CHARS_COUNT>;
-
-    struct HuffmanIteratorCompareGreater {
-        bool operator()(const HuffmanTree::Iterator& lhs, const HuffmanTree::Iterator& rhs) const;
-    };
 
     BitWriter& bs_;
-    HuffmanTree tree_;
-    HuffmanTree::Iterator root_;
-    CharCodesArray codes_;
-    std::vector<size_t> order_;
+    EncoderOptions options_;
+    HuffmanCode code_;
     bool first_file_;
+    bool last_entry_extended_;
+    /// Одна из записей не дописана из-за исключения.
+    bool entry_failed_;
+    size_t entries_count_;
+    /// @brief Записанный файл, на который могут ссылаться следующие записи EntryKind::DUPLICATE.
+    struct DuplicateSource {
+        size_t entry;
+        std::string filename;
+        StreamOpener open;
+    };
+    std::unordered_map<Digest128, DuplicateSource, Digest128Hash> source_by_digest_;
+    /// Открывает заново файл текущей записи; пусто, если его нельзя открыть заново.
+    StreamOpener current_open_;
+    /// Один кодировщик на все записи: его буферы не выделяются заново для каждого небольшого файла.
+    Lz77Encoder lz77_encoder_;
 
     void WriteCharacter(Char ch);
+    void BeginEntry();
+    void WriteEntrySeparator(bool one_more_file);
+    void WriteExtendedHeader(archive::EntryKind kind);
+    void WriteRawName(std::string_view filename);
     void EncodeHeader();
     void EncodeData(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeDuplicate(std::string_view filename, size_t original_entry);
+    /// @brief Номер ранее записанного файла с тем же содержимым, что у stream. Одного совпадения отпечатка
+    /// для этого мало: содержимое сравнивается с файлом побайтно.
+    std::optional<size_t> FindDuplicate(const Digest128& digest, std::istream& stream) const;
+    /// @brief Запомнить запись entry как файл, на который можно ссылаться, если его можно открыть заново.
+    void AddDuplicateSource(const Digest128& digest, size_t entry, std::string_view filename, const StreamOpener& open);
+    bool TryEncodeDuplicate(std::string_view filename, const Digest128& digest, std::istream& stream);
+    void EncodeEntry(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeContextHuffman(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeLz77(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeTans(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeContextMixing(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeBwt(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeRunLength(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeStored(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeRaw(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeRawFile(const std::string& filename);
+    void WriteRawHeader(std::string_view filename, uint64_t size);
+    void EncodeBlocks(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeSparse(const std::string& filename, const FileLayout& layout);
+    /// @brief Записать блоки EntryKind::BLOCKS и SPARSE до конца потока и завершающий бит 0.
+    void WriteBlocks(std::istream& stream);
+    void EncodeWithModel(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeByteHuffman(std::string_view filename, std::unique_ptr<std::istream>& stream);
+    void EncodeSized(std::string_view filename, std::istream& stream, uint64_t size, const HuffmanCode& code,
+                     Hasher128* hasher = nullptr);
+    void GenerateCodes(const CharFrequencyArray& distribution);
 
+    std::unique_ptr<std::istream> OpenFile(const std::string& filename) const;
+    /// @brief Размер содержимого потока, который можно перемотать. Бросает std::ios_base::failure, если поток
+    /// не открыт или его размер не узнать.
+    static uint64_t StreamSize(std::istream& stream);
     static CharFrequencyArray CalculateCharFrequencyArray(const std::string_view filename,
-                                                          std::unique_ptr<std::istream>& stream);
-    void GenerateHuffmanTree(const CharFrequencyArray& distribution);
-    void СonvertHuffmanCodeToCanonicalForm();
+                                                          std::unique_ptr<std::istream>& stream, Hasher128& hasher);
 };
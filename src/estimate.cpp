@@ -0,0 +1,112 @@
+#include "estimate.hpp"
+#include "huffman.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <span>
+#include <vector>
+
+namespace {
+
+constexpr size_t HASH_LENGTH = 4;
+constexpr size_t HASH_BITS = 12;
+/// Более короткие совпадения встречаются случайно даже в несжимаемых данных из небольшого алфавита.
+constexpr size_t MIN_MATCH = 6;
+
+/// Количество байтов фрагмента, покрытых жадно найденными совпадениями с более ранними позициями.
+size_t CountMatchedBytes(std::span<const uint8_t> sample) {
+    std::array<uint32_t, size_t{1} << HASH_BITS> head{};
+    size_t matched = 0;
+    size_t position = 0;
+    while (position + HASH_LENGTH <= sample.size()) {
+        uint32_t value = 0;
+        std::memcpy(&value, sample.data() + position, sizeof(value));
+        const size_t hash = (value * 2654435761u) >> (32 - HASH_BITS);
+        const size_t candidate = head[hash];
+        head[hash] = static_cast<uint32_t>(position + 1);
+
+        size_t length = 0;
+        if (candidate != 0) {
+            while (position + length < sample.size() && sample[candidate - 1 + length] == sample[position + length]) {
+                ++length;
+            }
+        }
+        if (length >= MIN_MATCH) {
+            matched += length;
+            position += length;
+        } else {
+            ++position;
+        }
+    }
+    return matched;
+}
+
+/// Оценка по SAMPLES_COUNT фрагментам: с начала, с конца и равномерно между ними; маленькое содержимое
+/// просматривается целиком. sample_at(offset) возвращает не более SAMPLE_SIZE байт с позиции offset.
+template <typename SampleAt>
+SampleEstimate EstimateSamples(size_t content_size, SampleAt&& sample_at) {
+    SampleEstimate estimate;
+    estimate.content_size = content_size;
+
+    const size_t step = content_size > SampleEstimate::SAMPLES_COUNT * SampleEstimate::SAMPLE_SIZE
+                            ? (content_size - SampleEstimate::SAMPLE_SIZE) / (SampleEstimate::SAMPLES_COUNT - 1)
+                            : SampleEstimate::SAMPLE_SIZE;
+    std::vector<size_t> frequencies(256, 0);
+    size_t matched = 0;
+    for (size_t i = 0; i < SampleEstimate::SAMPLES_COUNT && i * step < content_size; ++i) {
+        const std::span<const uint8_t> data = sample_at(i * step);
+        for (uint8_t byte : data) {
+            ++frequencies[byte];
+        }
+        matched += CountMatchedBytes(data);
+        estimate.sampled_size += data.size();
+    }
+
+    if (estimate.sampled_size == 0) {
+        return estimate;
+    }
+
+    const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    const auto total = static_cast<double>(estimate.sampled_size);
+    for (size_t symbol = 0; symbol < frequencies.size(); ++symbol) {
+        if (frequencies[symbol] == 0) {
+            continue;
+        }
+        const double probability = static_cast<double>(frequencies[symbol]) / total;
+        ++estimate.used_symbols;
+        estimate.entropy -= probability * std::log2(probability);
+        estimate.huffman_bits += probability * static_cast<double>(std::max<size_t>(code.GetLengths()[symbol], 1));
+    }
+    estimate.match_density = static_cast<double>(matched) / total;
+    return estimate;
+}
+
+}  // namespace
+
+SampleEstimate SampleEstimate::FromStream(std::istream& is) {
+    is.clear();
+    is.seekg(0, std::ios::end);
+    const auto end = is.tellg();
+    if (!is || end < 0) {
+        throw std::ios_base::failure("Cannot determine the size of the file.");
+    }
+    const auto content_size = static_cast<size_t>(end);
+
+    std::vector<uint8_t> sample(SAMPLE_SIZE);
+    return EstimateSamples(content_size, [&](size_t offset) {
+        is.clear();
+        is.seekg(static_cast<std::streamoff>(offset));
+        is.read(reinterpret_cast<char*>(sample.data()), static_cast<std::streamsize>(sample.size()));
+        return std::span(sample).first(static_cast<size_t>(is.gcount()));
+    });
+}
+
+SampleEstimate SampleEstimate::FromBlock(std::span<const uint8_t> block) {
+    return EstimateSamples(block.size(), [&](size_t offset) {
+        return block.subspan(offset, std::min(SAMPLE_SIZE, block.size() - offset));
+    });
+}
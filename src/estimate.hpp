@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <span>
+
+/**
+ * @brief Оценка сжимаемости содержимого по нескольким небольшим фрагментам, равномерно взятым из потока.
+ * Полный подсчет частот и кодирование при этом не выполняются.
+ */
+struct SampleEstimate {
+    static constexpr size_t SAMPLES_COUNT = 4;
+    static constexpr size_t SAMPLE_SIZE = 4096;
+
+    /// @brief Размер всего содержимого в байтах.
+    size_t content_size = 0;
+    /// @brief Сколько байт было просмотрено.
+    size_t sampled_size = 0;
+    /// @brief Количество различных байтов во фрагментах.
+    size_t used_symbols = 0;
+    /// @brief Энтропия нулевого порядка, бит на байт.
+    double entropy = 0;
+    /// @brief Средняя длина кода Хаффмана, построенного по фрагментам, бит на байт.
+    double huffman_bits = 0;
+    /// @brief Доля байтов, покрытых совпадениями длины не меньше 6 внутри фрагмента.
+    double match_density = 0;
+
+    /// @brief Оценить содержимое потока. Поток читается с начала, после вызова позиция не определена.
+    /// Если размер потока узнать нельзя, бросает std::ios_base::failure.
+    static SampleEstimate FromStream(std::istream& is);
+
+    /// @brief Оценить блок, уже находящийся в памяти.
+    static SampleEstimate FromBlock(std::span<const uint8_t> block);
+};
@@ -0,0 +1,98 @@
+#include "hash.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t C1 = 0x87c37b91114253d5ULL;
+constexpr uint64_t C2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t RotateLeft(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+inline uint64_t FinalMix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+inline uint64_t LoadLittleEndian(const uint8_t* data, size_t count) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < count; ++i) {
+        value |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline uint64_t MixK1(uint64_t k1) {
+    k1 *= C1;
+    k1 = RotateLeft(k1, 31);
+    k1 *= C2;
+    return k1;
+}
+
+inline uint64_t MixK2(uint64_t k2) {
+    k2 *= C2;
+    k2 = RotateLeft(k2, 33);
+    k2 *= C1;
+    return k2;
+}
+
+}  // namespace
+
+Hasher128::Hasher128(uint64_t seed) : h1_(seed), h2_(seed), block_(), block_size_(0), length_(0) {
+}
+
+void Hasher128::Update(uint8_t byte) {
+    block_[block_size_++] = byte;
+    ++length_;
+    if (block_size_ == BLOCK_SIZE) {
+        ProcessBlock();
+        block_size_ = 0;
+    }
+}
+
+void Hasher128::Update(std::string_view data) {
+    for (uint8_t byte : data) {
+        Update(byte);
+    }
+}
+
+void Hasher128::ProcessBlock() {
+    h1_ ^= MixK1(LoadLittleEndian(block_.data(), 8));
+    h1_ = RotateLeft(h1_, 27);
+    h1_ += h2_;
+    h1_ = h1_ * 5 + 0x52dce729;
+
+    h2_ ^= MixK2(LoadLittleEndian(block_.data() + 8, 8));
+    h2_ = RotateLeft(h2_, 31);
+    h2_ += h1_;
+    h2_ = h2_ * 5 + 0x38495ab5;
+}
+
+Digest128 Hasher128::Finish() const {
+    uint64_t h1 = h1_;
+    uint64_t h2 = h2_;
+
+    if (block_size_ > 8) {
+        h2 ^= MixK2(LoadLittleEndian(block_.data() + 8, block_size_ - 8));
+    }
+    if (block_size_ > 0) {
+        h1 ^= MixK1(LoadLittleEndian(block_.data(), std::min<size_t>(block_size_, 8)));
+    }
+
+    h1 ^= length_;
+    h2 ^= length_;
+    h1 += h2;
+    h2 += h1;
+    h1 = FinalMix(h1);
+    h2 = FinalMix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return Digest128{.low = h1, .high = h2};
+}
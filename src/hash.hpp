@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// @brief 128-битный отпечаток содержимого.
+struct Digest128 {
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const Digest128& another) const = default;
+};
+
+struct Digest128Hash {
+    inline size_t operator()(const Digest128& digest) const {
+        return digest.low;
+    }
+};
+
+/**
+ * @brief Потоковая реализация MurmurHash3 (x64, 128 бит). Данные можно подавать по одному байту,
+ * поэтому отпечаток удобно считать в том же проходе, что и гистограмму символов.
+ */
+class Hasher128 {
+public:
+    explicit Hasher128(uint64_t seed = 0);
+
+    void Update(uint8_t byte);
+    void Update(std::string_view data);
+
+    /// @brief Получить отпечаток всех поданных на вход данных. Состояние хэшера не меняется.
+    Digest128 Finish() const;
+
+private:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    void ProcessBlock();
+
+    uint64_t h1_;
+    uint64_t h2_;
+    std::array<uint8_t, BLOCK_SIZE> block_;
+    size_t block_size_;
+    uint64_t length_;
+};
@@ -0,0 +1,398 @@
+#include "huffman.hpp"
+#include "binary_forest.hpp"
+#include "priority_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+
+namespace {
+
+constexpr size_t CODE_LENGTH_ALPHABET_SIZE = 19;
+constexpr size_t REPEAT_PREVIOUS = 16;
+constexpr size_t REPEAT_ZERO_SHORT = 17;
+constexpr size_t REPEAT_ZERO_LONG = 18;
+constexpr size_t CODE_LENGTH_CODE_MAX_LENGTH = 7;
+constexpr size_t CODE_LENGTH_CODE_LENGTH_BIT_COUNT = 3;
+constexpr size_t CODE_LENGTH_CODES_COUNT_BIT_COUNT = 4;
+constexpr size_t MIN_CODE_LENGTH_CODES_COUNT = 4;
+
+/// Порядок, в котором записываются длины вспомогательного кода: редкие длины в конце, и их можно не писать.
+constexpr std::array<size_t, CODE_LENGTH_ALPHABET_SIZE> CODE_LENGTH_ORDER{16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                                          11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+struct RepeatRule {
+    size_t extra_bit_count;
+    size_t min_repeat;
+    size_t max_repeat;
+};
+
+constexpr RepeatRule GetRepeatRule(size_t symbol) {
+    switch (symbol) {
+        case REPEAT_PREVIOUS:
+            return RepeatRule{.extra_bit_count = 2, .min_repeat = 3, .max_repeat = 6};
+        case REPEAT_ZERO_SHORT:
+            return RepeatRule{.extra_bit_count = 3, .min_repeat = 3, .max_repeat = 10};
+        case REPEAT_ZERO_LONG:
+            return RepeatRule{.extra_bit_count = 7, .min_repeat = 11, .max_repeat = 138};
+        default:
+            return RepeatRule{.extra_bit_count = 0, .min_repeat = 1, .max_repeat = 1};
+    }
+}
+
+struct CodeLengthItem {
+    size_t symbol;
+    size_t repeat;
+};
+
+struct SymbolFrequency {
+    size_t occurrences_count;
+    size_t symbol;
+};
+
+struct SymbolFrequencyCombiner {
+    SymbolFrequency operator()(const SymbolFrequency& lhs, const SymbolFrequency& rhs) {
+        return SymbolFrequency{.occurrences_count = lhs.occurrences_count + rhs.occurrences_count,
+                               .symbol = std::min(lhs.symbol, rhs.symbol)};
+    }
+};
+
+using HuffmanTree = BinaryForest<SymbolFrequency, SymbolFrequencyCombiner>;
+
+/// @brief Младшие count бит value в обратном порядке.
+size_t ReverseBits(size_t value, size_t count) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; ++i) {
+        result = (result << 1) | ((value >> i) & 1);
+    }
+    return result;
+}
+
+struct HuffmanIteratorCompareGreater {
+    bool operator()(const HuffmanTree::Iterator& lhs, const HuffmanTree::Iterator& rhs) const {
+        return std::tie(lhs->occurrences_count, lhs->symbol) > std::tie(rhs->occurrences_count, rhs->symbol);
+    }
+};
+
+}  // namespace
+
+HuffmanCode::HuffmanCode() : lengths_(), codes_(), order_() {
+}
+
+HuffmanCode HuffmanCode::FromFrequencies(std::span<const size_t> frequencies, size_t max_length) {
+    std::vector<size_t> weights(frequencies.begin(), frequencies.end());
+
+    // Код из одного символа нельзя записать в виде полного бора, поэтому добавляется фиктивный символ.
+    size_t used_symbols = weights.size() - std::ranges::count(weights, 0);
+    for (size_t i = 0; i < weights.size() && used_symbols < 2; ++i) {
+        if (weights[i] == 0) {
+            weights[i] = 1;
+            ++used_symbols;
+        }
+    }
+
+    auto lengths = BuildLengths(weights);
+    while (!lengths.empty() && std::ranges::max(lengths) > max_length) {
+        for (size_t& weight : weights) {
+            if (weight != 0) {
+                weight = weight / 2 + 1;
+            }
+        }
+        lengths = BuildLengths(weights);
+    }
+
+    return FromLengths(std::move(lengths));
+}
+
+HuffmanCode HuffmanCode::FromLengths(std::vector<size_t> lengths) {
+    HuffmanCode code;
+    code.lengths_ = std::move(lengths);
+    code.codes_.resize(code.lengths_.size());
+
+    for (size_t i = 0; i < code.lengths_.size(); ++i) {
+        if (code.lengths_[i] != 0) {
+            code.order_.push_back(i);
+        }
+    }
+
+    std::ranges::stable_sort(code.order_,
+                             [&](size_t lhs, size_t rhs) { return code.lengths_[lhs] < code.lengths_[rhs]; });
+
+    Code current;
+    for (size_t symbol : code.order_) {
+        if (!current.empty()) {
+            size_t j = current.size() - 1;
+            while (j != 0 && current[j]) {
+                current[j] = false;
+                --j;
+            }
+            current[j] = true;
+        }
+
+        current.resize(code.lengths_[symbol], false);
+        code.codes_[symbol] = current;
+    }
+
+    return code;
+}
+
+void HuffmanCode::WriteCompact(BitWriter& bs) const {
+    std::vector<CodeLengthItem> items;
+    auto push_repeats = [&](size_t symbol, size_t& run) {
+        const auto rule = GetRepeatRule(symbol);
+        while (run >= rule.min_repeat) {
+            const size_t repeat = std::min(run, rule.max_repeat);
+            items.push_back(CodeLengthItem{.symbol = symbol, .repeat = repeat});
+            run -= repeat;
+        }
+    };
+
+    for (size_t i = 0; i < lengths_.size();) {
+        const size_t length = lengths_[i];
+        size_t run = 1;
+        while (i + run < lengths_.size() && lengths_[i + run] == length) {
+            ++run;
+        }
+        i += run;
+
+        if (length == 0) {
+            push_repeats(REPEAT_ZERO_LONG, run);
+            push_repeats(REPEAT_ZERO_SHORT, run);
+        } else {
+            items.push_back(CodeLengthItem{.symbol = length, .repeat = 1});
+            --run;
+            push_repeats(REPEAT_PREVIOUS, run);
+        }
+
+        for (; run != 0; --run) {
+            items.push_back(CodeLengthItem{.symbol = length, .repeat = 1});
+        }
+    }
+
+    std::array<size_t, CODE_LENGTH_ALPHABET_SIZE> frequencies{};
+    for (const auto& item : items) {
+        ++frequencies[item.symbol];
+    }
+    const auto code_length_code = FromFrequencies(frequencies, CODE_LENGTH_CODE_MAX_LENGTH);
+
+    size_t codes_count = CODE_LENGTH_ALPHABET_SIZE;
+    while (codes_count > MIN_CODE_LENGTH_CODES_COUNT &&
+           code_length_code.GetLength(CODE_LENGTH_ORDER[codes_count - 1]) == 0) {
+        --codes_count;
+    }
+
+    bs.WriteInt(codes_count - MIN_CODE_LENGTH_CODES_COUNT, CODE_LENGTH_CODES_COUNT_BIT_COUNT);
+    for (size_t i = 0; i < codes_count; ++i) {
+        bs.WriteInt(code_length_code.GetLength(CODE_LENGTH_ORDER[i]), CODE_LENGTH_CODE_LENGTH_BIT_COUNT);
+    }
+
+    for (const auto& item : items) {
+        for (bool bit : code_length_code.GetCode(item.symbol)) {
+            bs.WriteBit(bit);
+        }
+
+        const auto rule = GetRepeatRule(item.symbol);
+        bs.WriteInt(item.repeat - rule.min_repeat, rule.extra_bit_count);
+    }
+}
+
+HuffmanCode HuffmanCode::ReadCompact(BitReader& bs, size_t alphabet_size) {
+    const size_t codes_count = bs.ReadInt(CODE_LENGTH_CODES_COUNT_BIT_COUNT) + MIN_CODE_LENGTH_CODES_COUNT;
+    std::vector<size_t> code_length_lengths(CODE_LENGTH_ALPHABET_SIZE, 0);
+    for (size_t i = 0; i < codes_count; ++i) {
+        code_length_lengths[CODE_LENGTH_ORDER[i]] = bs.ReadInt(CODE_LENGTH_CODE_LENGTH_BIT_COUNT);
+    }
+    const HuffmanDecoder code_length_decoder(FromLengths(std::move(code_length_lengths)));
+
+    std::vector<size_t> lengths;
+    lengths.reserve(alphabet_size);
+    while (lengths.size() < alphabet_size) {
+        const size_t symbol = code_length_decoder.ReadSymbol(bs);
+        const auto rule = GetRepeatRule(symbol);
+        const size_t repeat = bs.ReadInt(rule.extra_bit_count) + rule.min_repeat;
+
+        size_t length = symbol;
+        if (symbol == REPEAT_PREVIOUS) {
+            if (lengths.empty()) {
+                throw HuffmanFormatError("Nothing to repeat in code lengths.");
+            }
+            length = lengths.back();
+        } else if (symbol == REPEAT_ZERO_SHORT || symbol == REPEAT_ZERO_LONG) {
+            length = 0;
+        }
+
+        if (lengths.size() + repeat > alphabet_size) {
+            throw HuffmanFormatError("Too many code lengths.");
+        }
+        lengths.insert(lengths.end(), repeat, length);
+    }
+
+    return FromLengths(std::move(lengths));
+}
+
+size_t HuffmanCode::AlphabetSize() const {
+    return lengths_.size();
+}
+
+size_t HuffmanCode::MaxLength() const {
+    return order_.empty() ? 0 : lengths_[order_.back()];
+}
+
+size_t HuffmanCode::GetLength(size_t symbol) const {
+    return lengths_[symbol];
+}
+
+const HuffmanCode::Code& HuffmanCode::GetCode(size_t symbol) const {
+    return codes_[symbol];
+}
+
+const std::vector<size_t>& HuffmanCode::GetLengths() const {
+    return lengths_;
+}
+
+const std::vector<size_t>& HuffmanCode::GetOrder() const {
+    return order_;
+}
+
+std::vector<size_t> HuffmanCode::BuildLengths(std::span<const size_t> frequencies) {
+    HuffmanTree tree;
+    PriorityQueue<HuffmanTree::Iterator, HuffmanIteratorCompareGreater> queue;
+    for (size_t i = 0; i < frequencies.size(); ++i) {
+        if (frequencies[i] != 0) {
+            queue.Emplace(tree.EmplaceLeaf(SymbolFrequency{.occurrences_count = frequencies[i], .symbol = i}));
+        }
+    }
+
+    std::vector<size_t> lengths(frequencies.size(), 0);
+    if (queue.Empty()) {
+        return lengths;
+    }
+
+    while (queue.Size() > 1) {
+        auto a = queue.Top();
+        queue.Pop();
+        auto b = queue.Top();
+        queue.Pop();
+        queue.Emplace(tree.Unite(a, b));
+    }
+
+    tree.ProvidePaths(queue.Top(), [&](const SymbolFrequency& leaf, const HuffmanTree::BinaryString& path) {
+        lengths[leaf.symbol] = path.size();
+    });
+
+    return lengths;
+}
+
+HuffmanDecoder::HuffmanDecoder()
+    : symbols_(), count_(), first_code_(), first_index_(), table_(), reversed_table_() {
+}
+
+HuffmanDecoder::HuffmanDecoder(const HuffmanCode& code) : HuffmanDecoder() {
+    symbols_ = code.GetOrder();
+
+    std::vector<size_t> count_by_length(code.MaxLength(), 0);
+    for (size_t symbol : symbols_) {
+        ++count_by_length[code.GetLength(symbol) - 1];
+    }
+    Build(count_by_length);
+}
+
+HuffmanDecoder::HuffmanDecoder(std::vector<size_t> order, const std::vector<size_t>& count_by_length)
+    : HuffmanDecoder() {
+    symbols_ = std::move(order);
+    Build(count_by_length);
+}
+
+void HuffmanDecoder::Build(const std::vector<size_t>& count_by_length) {
+    constexpr size_t MAX_SUPPORTED_LENGTH = std::numeric_limits<size_t>::digits - 1;
+    if (count_by_length.size() > MAX_SUPPORTED_LENGTH) {
+        throw HuffmanFormatError("Huffman code is too long.");
+    }
+
+    count_.assign(count_by_length.size() + 1, 0);
+    first_code_.assign(count_by_length.size() + 1, 0);
+    first_index_.assign(count_by_length.size() + 1, 0);
+
+    size_t code = 0;
+    size_t index = 0;
+    for (size_t length = 1; length < count_.size(); ++length) {
+        code <<= 1;
+        first_code_[length] = code;
+        first_index_[length] = index;
+        count_[length] = count_by_length[length - 1];
+
+        code += count_[length];
+        index += count_[length];
+        if (code > (size_t{1} << length) || index > symbols_.size()) {
+            throw HuffmanFormatError("Incorrectly defined huffman tree.");
+        }
+    }
+
+    // Код обязан быть полным: каждая последовательность бит является префиксом какого-то кода.
+    if (index != symbols_.size() || symbols_.empty() || code != (size_t{1} << (count_.size() - 1))) {
+        throw HuffmanFormatError("Incorrectly defined huffman tree.");
+    }
+
+    // Код длины length занимает в таблице все 2^(TABLE_BITS - length) строк, начинающихся с него.
+    table_.assign(size_t{1} << TABLE_BITS, TableEntry{.symbol = 0, .length = 0});
+    for (size_t length = 1; length < count_.size() && length <= TABLE_BITS; ++length) {
+        for (size_t i = 0; i < count_[length]; ++i) {
+            const TableEntry entry{.symbol = static_cast<uint32_t>(symbols_[first_index_[length] + i]),
+                                   .length = static_cast<uint32_t>(length)};
+            const size_t first_row = (first_code_[length] + i) << (TABLE_BITS - length);
+            std::fill_n(table_.begin() + static_cast<std::ptrdiff_t>(first_row), size_t{1} << (TABLE_BITS - length),
+                        entry);
+        }
+    }
+    reversed_table_.resize(table_.size());
+    for (size_t row = 0; row < table_.size(); ++row) {
+        reversed_table_[ReverseBits(row, TABLE_BITS)] = table_[row];
+    }
+}
+
+size_t HuffmanDecoder::ReadSymbol(BitReader& bs) const {
+    size_t code = 0;
+    size_t length = 1;
+    if (!table_.empty()) {
+        const bool reversed = bs.GetBitOrder() == BitOrder::LSB_FIRST;
+        const size_t bits = bs.PeekBits(TABLE_BITS);
+        const TableEntry& entry = (reversed ? reversed_table_ : table_)[bits];
+        if (entry.length != 0) {
+            bs.SkipBits(entry.length);
+            return entry.symbol;
+        }
+
+        // Код длиннее таблицы: первые TABLE_BITS его бит уже известны.
+        bs.SkipBits(TABLE_BITS);
+        code = reversed ? ReverseBits(bits, TABLE_BITS) : bits;
+        length = TABLE_BITS + 1;
+    }
+
+    for (; length < count_.size(); ++length) {
+        code = (code << 1) | static_cast<size_t>(bs.ReadBit());
+
+        // Для кодов меньше first_code_[length] вычитание переполняется, и проверка не проходит.
+        const size_t offset = code - first_code_[length];
+        if (offset < count_[length]) {
+            return symbols_[first_index_[length] + offset];
+        }
+    }
+
+    throw HuffmanFormatError("Invalid huffman code.");
+}
+
+size_t ValueBucket::ReadValue(size_t code, BitReader& bs) {
+    if (code < 4) {
+        return code;
+    }
+    const size_t extra_bit_count = code / 2 - 1;
+    const size_t base = (2 | (code & 1)) << extra_bit_count;
+    return base + bs.ReadInt(extra_bit_count);
+}
+
+void ValueBucket::Write(BitWriter& bs, const HuffmanCode& huffman_code, size_t offset) const {
+    for (bool bit : huffman_code.GetCode(offset + code)) {
+        bs.WriteBit(bit);
+    }
+    bs.WriteInt(extra, extra_bit_count);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class HuffmanFormatError : public std::runtime_error {
+public:
+    inline HuffmanFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Канонический код Хаффмана над алфавитом произвольного размера. Символы с нулевой длиной
+ * кода в код не входят.
+ */
+class HuffmanCode {
+public:
+    using Code = std::vector<bool>;
+
+    static constexpr size_t UNLIMITED_LENGTH = std::numeric_limits<size_t>::max();
+
+    /// Максимальная длина кода, которую можно записать с помощью WriteCompact.
+    static constexpr size_t MAX_COMPACT_LENGTH = 15;
+
+    HuffmanCode();
+
+    /// @brief Построить код по частотам символов. Бор строится так, как описано в README, поэтому
+    /// без ограничения на длину результат совпадает с кодом из формата архива.
+    /// @param frequencies частоты символов, размер задает размер алфавита
+    /// @param max_length ограничение на длину кода. Пока оно нарушается, частоты делятся пополам.
+    static HuffmanCode FromFrequencies(std::span<const size_t> frequencies, size_t max_length = UNLIMITED_LENGTH);
+
+    /// @brief Восстановить канонический код по длинам кодов символов.
+    static HuffmanCode FromLengths(std::vector<size_t> lengths);
+
+    /// @brief Записать длины кодов как в deflate: длины сжимаются RLE (символы 16-18) и кодируются
+    /// вспомогательным кодом Хаффмана, длины которого записываются по 3 бита.
+    void WriteCompact(BitWriter& bs) const;
+
+    /// @brief Прочитать код, записанный с помощью WriteCompact.
+    /// @param alphabet_size размер алфавита (в поток не записывается)
+    static HuffmanCode ReadCompact(BitReader& bs, size_t alphabet_size);
+
+    size_t AlphabetSize() const;
+    size_t MaxLength() const;
+    size_t GetLength(size_t symbol) const;
+    const Code& GetCode(size_t symbol) const;
+    const std::vector<size_t>& GetLengths() const;
+
+    /// @brief Символы, входящие в код, в порядке следования канонических кодов.
+    const std::vector<size_t>& GetOrder() const;
+
+private:
+    std::vector<size_t> lengths_;
+    std::vector<Code> codes_;
+    std::vector<size_t> order_;
+
+    static std::vector<size_t> BuildLengths(std::span<const size_t> frequencies);
+};
+
+/**
+ * @brief Декодер канонического кода Хаффмана. Таблицы строятся за O(размер алфавита), символ
+ * читается за O(длина кода) без обхода бора.
+ */
+class HuffmanDecoder {
+public:
+    HuffmanDecoder();
+    explicit HuffmanDecoder(const HuffmanCode& code);
+
+    /// @brief Построить декодер по списку символов в порядке следования канонических кодов.
+    /// @param order символы
+    /// @param count_by_length i-й элемент - количество символов с длиной кода i+1
+    HuffmanDecoder(std::vector<size_t> order, const std::vector<size_t>& count_by_length);
+
+    /// @brief Прочитать очередной символ из потока. Бросает BitReader::ReadException, если
+    /// поток закончился.
+    size_t ReadSymbol(BitReader& bs) const;
+
+private:
+    /// Коды не длиннее TABLE_BITS читаются одним обращением к таблице по следующим битам потока.
+    static constexpr size_t TABLE_BITS = BitReader::MAX_PEEK_BIT_COUNT;
+
+    struct TableEntry {
+        uint32_t symbol;
+        uint32_t length;
+    };
+
+    std::vector<size_t> symbols_;
+    std::vector<size_t> count_;
+    std::vector<size_t> first_code_;
+    std::vector<size_t> first_index_;
+    std::vector<TableEntry> table_;
+    /// Та же таблица для порядка BitOrder::LSB_FIRST: строка - перевернутые биты кода.
+    std::vector<TableEntry> reversed_table_;
+
+    void Build(const std::vector<size_t>& count_by_length);
+};
+
+/**
+ * @brief Группа, в которую попадает значение при кодировании кодом Хаффмана с дополнительными битами
+ * (как расстояния в deflate): значения 0-3 имеют собственные коды, дальше на каждую степень двойки
+ * приходится два кода, а младшие биты значения записываются без сжатия.
+ */
+struct ValueBucket {
+    size_t code;
+    size_t extra_bit_count;
+    size_t extra;
+
+    static constexpr ValueBucket FromValue(size_t value) {
+        if (value < 4) {
+            return ValueBucket{.code = value, .extra_bit_count = 0, .extra = 0};
+        }
+        const size_t high_bit = std::bit_width(value) - 1;
+        const size_t extra_bit_count = high_bit - 1;
+        return ValueBucket{.code = 2 * high_bit + ((value >> extra_bit_count) & 1),
+                           .extra_bit_count = extra_bit_count,
+                           .extra = value & ((size_t{1} << extra_bit_count) - 1)};
+    }
+
+    /// @brief Количество кодов, достаточное для значений от 0 до max_value.
+    static constexpr size_t Count(size_t max_value) {
+        return FromValue(max_value).code + 1;
+    }
+
+    /// @brief Прочитать дополнительные биты и восстановить значение по уже прочитанному коду.
+    static size_t ReadValue(size_t code, BitReader& bs);
+
+    /// @brief Записать код группы (символ offset + code) и дополнительные биты.
+    void Write(BitWriter& bs, const HuffmanCode& huffman_code, size_t offset) const;
+};
@@ -0,0 +1,268 @@
+#include "lz77.hpp"
+#include "huffman.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 3;
+constexpr size_t MAX_MATCH = 258;
+constexpr size_t HASH_BITS = 16;
+constexpr size_t READ_SIZE = 1 << 16;
+
+constexpr size_t LITERALS_COUNT = 256;
+constexpr size_t END_OF_BLOCK = LITERALS_COUNT;
+constexpr size_t FIRST_LENGTH_SYMBOL = END_OF_BLOCK + 1;
+
+constexpr size_t LENGTH_SYMBOLS_COUNT = ValueBucket::Count(MAX_MATCH - MIN_MATCH);
+constexpr size_t LITERAL_LENGTH_ALPHABET_SIZE = FIRST_LENGTH_SYMBOL + LENGTH_SYMBOLS_COUNT;
+
+size_t DistanceAlphabetSize(size_t window_bits) {
+    return ValueBucket::Count((size_t{1} << window_bits) - 1);
+}
+
+size_t Hash(const uint8_t* data) {
+    const uint32_t value = (uint32_t{data[0]} << 16) | (uint32_t{data[1]} << 8) | data[2];
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+}  // namespace
+
+Lz77Encoder::Lz77Encoder(Lz77Parameters parameters)
+    : parameters_(parameters),
+      buffer_(),
+      buffer_start_(0),
+      head_(),
+      prev_(),
+      tokens_(),
+      primed_dictionary_(),
+      primed_head_(),
+      primed_prev_() {
+}
+
+void Lz77Encoder::Encode(std::istream& is, BitWriter& bs, std::span<const uint8_t> dictionary) {
+    const size_t window_size = size_t{1} << parameters_.window_bits;
+    dictionary = dictionary.last(std::min(dictionary.size(), window_size));
+    buffer_.assign(dictionary.begin(), dictionary.end());
+    buffer_start_ = 0;
+    if (dictionary.empty()) {
+        head_.assign(size_t{1} << HASH_BITS, 0);
+        prev_.assign(window_size, 0);
+    } else if (std::ranges::equal(dictionary, primed_dictionary_)) {
+        head_ = primed_head_;
+        prev_ = primed_prev_;
+    } else {
+        // Хэш-цепочки словаря строятся один раз для всех файлов, кодируемых с тем же словарем.
+        head_.assign(size_t{1} << HASH_BITS, 0);
+        prev_.assign(window_size, 0);
+        for (size_t position = 0; position < dictionary.size(); ++position) {
+            Insert(position);
+        }
+        primed_dictionary_.assign(dictionary.begin(), dictionary.end());
+        primed_head_ = head_;
+        primed_prev_ = prev_;
+    }
+    // Последним позициям словаря для хэша нужны байты содержимого.
+    size_t unhashed = dictionary.size() - std::min(dictionary.size(), MIN_MATCH - 1);
+
+    while (true) {
+        // Из предыдущих блоков сохраняется ровно одно окно - дальше совпадения не ищутся.
+        if (buffer_.size() > window_size) {
+            const size_t dropped = buffer_.size() - window_size;
+            buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(dropped));
+            buffer_start_ += dropped;
+        }
+
+        // Блок читается частями, чтобы для небольшого файла не заполнять буфер на весь BLOCK_SIZE.
+        const size_t block_begin = buffer_.size();
+        while (buffer_.size() - block_begin < BLOCK_SIZE) {
+            const size_t filled = buffer_.size();
+            buffer_.resize(filled + std::min(READ_SIZE, block_begin + BLOCK_SIZE - filled));
+            is.read(reinterpret_cast<char*>(buffer_.data() + filled),
+                    static_cast<std::streamsize>(buffer_.size() - filled));
+            buffer_.resize(filled + static_cast<size_t>(is.gcount()));
+            if (!is) {
+                break;
+            }
+        }
+        if (buffer_.size() == block_begin) {
+            break;
+        }
+
+        for (; unhashed < dictionary.size(); ++unhashed) {
+            Insert(unhashed);
+        }
+
+        ParseBlock(block_begin);
+        bs.WriteBit(true);
+        WriteBlock(bs);
+    }
+
+    bs.WriteBit(false);
+}
+
+void Lz77Encoder::ParseBlock(size_t block_begin) {
+    const size_t window_size = size_t{1} << parameters_.window_bits;
+    const size_t end = buffer_.size();
+    tokens_.clear();
+
+    size_t position = block_begin;
+    while (position < end) {
+        const size_t max_length = std::min(MAX_MATCH, end - position);
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if (max_length >= MIN_MATCH) {
+            const size_t absolute = buffer_start_ + position;
+            size_t candidate = head_[Hash(&buffer_[position])];
+            for (size_t depth = 0; candidate != 0 && depth < parameters_.chain_depth; ++depth) {
+                const size_t match = candidate - 1;
+                const size_t distance = absolute - match;
+                if (distance > window_size) {
+                    break;
+                }
+
+                const uint8_t* source = &buffer_[match - buffer_start_];
+                const uint8_t* target = &buffer_[position];
+                if (source[best_length] == target[best_length]) {
+                    size_t length = 0;
+                    while (length < max_length && source[length] == target[length]) {
+                        ++length;
+                    }
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = distance;
+                        if (length == max_length) {
+                            break;
+                        }
+                    }
+                }
+
+                const size_t next = prev_[match & (window_size - 1)];
+                if (next == 0 || next > match) {
+                    break;
+                }
+                candidate = next;
+            }
+        }
+
+        if (best_length >= MIN_MATCH) {
+            tokens_.push_back(Token{.length = static_cast<uint32_t>(best_length),
+                                    .value = static_cast<uint32_t>(best_distance)});
+            for (size_t i = 0; i < best_length; ++i) {
+                Insert(position + i);
+            }
+            position += best_length;
+        } else {
+            tokens_.push_back(Token{.length = 0, .value = buffer_[position]});
+            Insert(position);
+            ++position;
+        }
+    }
+}
+
+void Lz77Encoder::Insert(size_t position) {
+    if (buffer_.size() - position < MIN_MATCH) {
+        return;
+    }
+    const size_t absolute = buffer_start_ + position;
+    const size_t hash = Hash(&buffer_[position]);
+    prev_[absolute & (prev_.size() - 1)] = head_[hash];
+    head_[hash] = absolute + 1;
+}
+
+void Lz77Encoder::WriteBlock(BitWriter& bs) const {
+    const size_t distance_alphabet_size = DistanceAlphabetSize(parameters_.window_bits);
+    std::vector<size_t> literal_length_frequencies(LITERAL_LENGTH_ALPHABET_SIZE, 0);
+    std::vector<size_t> distance_frequencies(distance_alphabet_size, 0);
+
+    literal_length_frequencies[END_OF_BLOCK] = 1;
+    for (const Token& token : tokens_) {
+        if (token.length == 0) {
+            ++literal_length_frequencies[token.value];
+        } else {
+            ++literal_length_frequencies[FIRST_LENGTH_SYMBOL + ValueBucket::FromValue(token.length - MIN_MATCH).code];
+            ++distance_frequencies[ValueBucket::FromValue(token.value - 1).code];
+        }
+    }
+
+    const auto literal_length_code =
+        HuffmanCode::FromFrequencies(literal_length_frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    const auto distance_code = HuffmanCode::FromFrequencies(distance_frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+    literal_length_code.WriteCompact(bs);
+    distance_code.WriteCompact(bs);
+
+    for (const Token& token : tokens_) {
+        if (token.length == 0) {
+            for (bool bit : literal_length_code.GetCode(token.value)) {
+                bs.WriteBit(bit);
+            }
+        } else {
+            ValueBucket::FromValue(token.length - MIN_MATCH).Write(bs, literal_length_code, FIRST_LENGTH_SYMBOL);
+            ValueBucket::FromValue(token.value - 1).Write(bs, distance_code, 0);
+        }
+    }
+
+    for (bool bit : literal_length_code.GetCode(END_OF_BLOCK)) {
+        bs.WriteBit(bit);
+    }
+}
+
+Lz77Decoder::Lz77Decoder(size_t window_bits) : window_bits_(window_bits), window_(), position_(0), output_() {
+    if (window_bits < Lz77Parameters::MIN_WINDOW_BITS || window_bits > Lz77Parameters::MAX_WINDOW_BITS) {
+        throw Lz77FormatError("Invalid LZ77 window size.");
+    }
+}
+
+void Lz77Decoder::Decode(BitReader& bs, std::ostream& os, std::span<const uint8_t> dictionary) {
+    const size_t window_size = size_t{1} << window_bits_;
+    const size_t distance_alphabet_size = DistanceAlphabetSize(window_bits_);
+    dictionary = dictionary.last(std::min(dictionary.size(), window_size));
+    window_.assign(window_size, 0);
+    std::ranges::copy(dictionary, window_.begin());
+    position_ = dictionary.size();
+    output_.clear();
+    output_.reserve(OUTPUT_BUFFER_SIZE);
+
+    while (bs.ReadBit()) {
+        const HuffmanDecoder literal_length_decoder(HuffmanCode::ReadCompact(bs, LITERAL_LENGTH_ALPHABET_SIZE));
+        const HuffmanDecoder distance_decoder(HuffmanCode::ReadCompact(bs, distance_alphabet_size));
+
+        while (true) {
+            const size_t symbol = literal_length_decoder.ReadSymbol(bs);
+            if (symbol < LITERALS_COUNT) {
+                Put(static_cast<uint8_t>(symbol), os);
+                continue;
+            }
+            if (symbol == END_OF_BLOCK) {
+                break;
+            }
+
+            const size_t length = MIN_MATCH + ValueBucket::ReadValue(symbol - FIRST_LENGTH_SYMBOL, bs);
+            const size_t distance = 1 + ValueBucket::ReadValue(distance_decoder.ReadSymbol(bs), bs);
+            if (length > MAX_MATCH || distance > window_size || distance > position_) {
+                throw Lz77FormatError("Invalid LZ77 match.");
+            }
+            // Источник может перекрываться с копируемым фрагментом, поэтому копирование побайтовое.
+            for (size_t i = 0; i < length; ++i) {
+                Put(window_[(position_ - distance) & (window_size - 1)], os);
+            }
+        }
+    }
+
+    Flush(os);
+}
+
+void Lz77Decoder::Put(uint8_t byte, std::ostream& os) {
+    window_[position_ & (window_.size() - 1)] = byte;
+    ++position_;
+    output_.push_back(static_cast<char>(byte));
+    if (output_.size() == OUTPUT_BUFFER_SIZE) {
+        Flush(os);
+    }
+}
+
+void Lz77Decoder::Flush(std::ostream& os) {
+    os.write(output_.data(), static_cast<std::streamsize>(output_.size()));
+    output_.clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class Lz77FormatError : public std::runtime_error {
+public:
+    inline Lz77FormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+struct Lz77Parameters {
+    static constexpr size_t MIN_WINDOW_BITS = 8;
+    static constexpr size_t MAX_WINDOW_BITS = 24;
+    static constexpr size_t WINDOW_BITS_BIT_COUNT = 5;
+
+    /// @brief Логарифм размера окна: совпадения ищутся не дальше 2^window_bits байт назад.
+    size_t window_bits = 16;
+
+    /// @brief Сколько кандидатов из хэш-цепочки проверяется для каждой позиции.
+    size_t chain_depth = 32;
+};
+
+/**
+ * @brief LZ77 с поиском совпадений по хэш-цепочкам. Вход разбивается на блоки по BLOCK_SIZE байт,
+ * для каждого блока строятся два канонических кода Хаффмана (как в deflate): для литералов и длин
+ * совпадений и для расстояний. Окно переходит через границы блоков, память ограничена размером
+ * блока и окна.
+ *
+ * Формат блока: 1 бит `1`, коды в сжатом виде (HuffmanCode::WriteCompact), токены, END_OF_BLOCK.
+ * После последнего блока записывается бит `0`.
+ *
+ * Окно можно заранее заполнить словарем (LzDictionary): совпадения ищутся в нем так же, как в уже
+ * закодированных байтах. Декодировщику нужен тот же словарь.
+ */
+class Lz77Encoder {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    explicit Lz77Encoder(Lz77Parameters parameters);
+
+    /// @brief Закодировать поток. Из словаря используются последние 2^window_bits байт.
+    void Encode(std::istream& is, BitWriter& bs, std::span<const uint8_t> dictionary = {});
+
+private:
+    struct Token {
+        uint32_t length;
+        uint32_t value;
+    };
+
+    Lz77Parameters parameters_;
+    std::vector<uint8_t> buffer_;
+    size_t buffer_start_;
+    std::vector<size_t> head_;
+    std::vector<size_t> prev_;
+    std::vector<Token> tokens_;
+    std::vector<uint8_t> primed_dictionary_;
+    std::vector<size_t> primed_head_;
+    std::vector<size_t> primed_prev_;
+
+    void ParseBlock(size_t block_begin);
+    void Insert(size_t position);
+    void WriteBlock(BitWriter& bs) const;
+};
+
+class Lz77Decoder {
+public:
+    explicit Lz77Decoder(size_t window_bits);
+
+    void Decode(BitReader& bs, std::ostream& os, std::span<const uint8_t> dictionary = {});
+
+private:
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+    size_t window_bits_;
+    std::vector<uint8_t> window_;
+    size_t position_;
+    std::vector<char> output_;
+
+    void Put(uint8_t byte, std::ostream& os);
+    void Flush(std::ostream& os);
+};
@@ -0,0 +1,101 @@
+#include "model.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+/// Длины кодов встроенной модели, обученной на исходных текстах архиватора и README (ASCII и русский текст
+/// в UTF-8). Байты, которых не было в выборке, получили самые длинные коды.
+constexpr std::array<uint8_t, HuffmanModel::ALPHABET_SIZE> DEFAULT_LENGTHS{
+    15, 15, 14, 14, 14, 14, 14, 14, 14, 14, 5, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    3, 11, 8, 10, 14, 13, 9, 11, 6, 6, 10, 9, 7, 9, 7, 8,
+    9, 9, 9, 10, 10, 11, 10, 9, 9, 11, 6, 7, 8, 7, 8, 13,
+    11, 8, 8, 8, 9, 7, 9, 10, 9, 8, 14, 11, 8, 9, 8, 8,
+    9, 10, 8, 8, 8, 9, 10, 9, 11, 11, 11, 10, 13, 10, 12, 6,
+    10, 5, 7, 6, 6, 4, 7, 8, 7, 5, 12, 9, 6, 7, 5, 5,
+    7, 10, 5, 5, 4, 6, 8, 9, 8, 8, 8, 8, 11, 8, 13, 14,
+    8, 8, 7, 9, 10, 10, 11, 10, 11, 11, 13, 9, 10, 12, 11, 9,
+    13, 12, 12, 13, 12, 13, 14, 13, 13, 14, 12, 13, 13, 12, 13, 12,
+    12, 12, 13, 13, 13, 12, 13, 14, 13, 14, 14, 14, 14, 13, 14, 13,
+    7, 9, 8, 10, 8, 7, 10, 9, 7, 10, 8, 8, 8, 8, 7, 9,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    4, 5, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 13, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14
+};
+
+/// Длины задают полный префиксный код: сумма 2^-length равна единице.
+constexpr bool IsCompleteCode(const std::array<uint8_t, HuffmanModel::ALPHABET_SIZE>& lengths) {
+    uint64_t sum = 0;
+    for (uint8_t length : lengths) {
+        if (length == 0 || length > HuffmanCode::MAX_COMPACT_LENGTH) {
+            return false;
+        }
+        sum += uint64_t{1} << (HuffmanCode::MAX_COMPACT_LENGTH - length);
+    }
+    return sum == uint64_t{1} << HuffmanCode::MAX_COMPACT_LENGTH;
+}
+
+static_assert(IsCompleteCode(DEFAULT_LENGTHS));
+
+}  // namespace
+
+HuffmanModel::HuffmanModel(HuffmanCode code) : code_(std::move(code)), decoder_(code_), id_(0) {
+    Hasher128 hasher;
+    for (size_t length : code_.GetLengths()) {
+        hasher.Update(static_cast<uint8_t>(length));
+    }
+    id_ = hasher.Finish().low;
+}
+
+const HuffmanModel& HuffmanModel::Default() {
+    static const HuffmanModel model(
+        HuffmanCode::FromLengths(std::vector<size_t>(DEFAULT_LENGTHS.begin(), DEFAULT_LENGTHS.end())));
+    return model;
+}
+
+HuffmanModel HuffmanModel::Train(std::span<const size_t> frequencies) {
+    if (frequencies.size() != ALPHABET_SIZE) {
+        throw std::invalid_argument("A model is trained on byte frequencies.");
+    }
+
+    // Единица к каждой частоте оставляет код для байтов, которых не было в выборке.
+    std::vector<size_t> weights(frequencies.begin(), frequencies.end());
+    for (size_t& weight : weights) {
+        ++weight;
+    }
+    return HuffmanModel(HuffmanCode::FromFrequencies(weights, HuffmanCode::MAX_COMPACT_LENGTH));
+}
+
+void HuffmanModel::Write(BitWriter& bs) const {
+    code_.WriteCompact(bs);
+}
+
+HuffmanModel HuffmanModel::Read(BitReader& bs) {
+    try {
+        auto code = HuffmanCode::ReadCompact(bs, ALPHABET_SIZE);
+        if (std::ranges::count(code.GetLengths(), 0) != 0) {
+            throw ModelFormatError("The model does not cover all bytes.");
+        }
+        return HuffmanModel(std::move(code));
+    } catch (const BitReader::ReadException& exception) {
+        throw ModelFormatError("The model is truncated.");
+    } catch (const HuffmanFormatError& exception) {
+        throw ModelFormatError("Incorrectly defined model code.");
+    }
+}
+
+uint64_t HuffmanModel::Id() const {
+    return id_;
+}
+
+const HuffmanCode& HuffmanModel::GetCode() const {
+    return code_;
+}
+
+const HuffmanDecoder& HuffmanModel::GetDecoder() const {
+    return decoder_;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "huffman.hpp"
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+class ModelFormatError : public std::runtime_error {
+public:
+    inline ModelFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Заранее обученный код Хаффмана над байтами (EntryKind::MODEL_HUFFMAN). Запись ссылается на модель
+ * по идентификатору, поэтому частоты не считаются, а таблица не записывается в каждую запись. Модель
+ * кодирует любой байт, даже не встречавшийся при обучении.
+ */
+class HuffmanModel {
+public:
+    static constexpr size_t ALPHABET_SIZE = 256;
+    static constexpr size_t ID_BIT_COUNT = 64;
+
+    /// @brief Встроенная модель, известная любому декодеру. Построена по исходным текстам и README.
+    static const HuffmanModel& Default();
+
+    /// @brief Построить модель по частотам байтов обучающей выборки.
+    static HuffmanModel Train(std::span<const size_t> frequencies);
+
+    /// @brief Записать модель в файл: длины кодов в сжатом виде (как в версии 2).
+    void Write(BitWriter& bs) const;
+    static HuffmanModel Read(BitReader& bs);
+
+    /// @brief Идентификатор модели - отпечаток длин кодов.
+    uint64_t Id() const;
+
+    const HuffmanCode& GetCode() const;
+    const HuffmanDecoder& GetDecoder() const;
+
+private:
+    HuffmanCode code_;
+    HuffmanDecoder decoder_;
+    uint64_t id_;
+
+    explicit HuffmanModel(HuffmanCode code);
+};
@@ -0,0 +1,203 @@
+#include "multi_huffman.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+using ByteFrequencies = std::array<size_t, MultiHuffmanEncoder::ALPHABET_SIZE>;
+using ByteLengths = std::array<size_t, MultiHuffmanEncoder::ALPHABET_SIZE>;
+
+size_t GroupsCount(size_t block_size) {
+    return (block_size + MultiHuffmanEncoder::GROUP_SIZE - 1) / MultiHuffmanEncoder::GROUP_SIZE;
+}
+
+std::span<const uint8_t> Group(std::span<const uint8_t> block, size_t group) {
+    const size_t begin = group * MultiHuffmanEncoder::GROUP_SIZE;
+    return block.subspan(begin, std::min(MultiHuffmanEncoder::GROUP_SIZE, block.size() - begin));
+}
+
+/// @brief Коды по частотам групп, выбравших их. Единица к частоте каждого байта блока оставляет ему код
+/// во всех таблицах.
+std::vector<HuffmanCode> BuildCodes(std::span<const uint8_t> block, const std::vector<uint8_t>& selectors,
+                                    size_t tables_count, const ByteFrequencies& block_frequencies) {
+    std::vector<ByteFrequencies> frequencies(tables_count);
+    for (ByteFrequencies& table_frequencies : frequencies) {
+        for (size_t byte = 0; byte < MultiHuffmanEncoder::ALPHABET_SIZE; ++byte) {
+            table_frequencies[byte] = block_frequencies[byte] != 0;
+        }
+    }
+    for (size_t group = 0; group < selectors.size(); ++group) {
+        for (uint8_t byte : Group(block, group)) {
+            ++frequencies[selectors[group]][byte];
+        }
+    }
+
+    std::vector<HuffmanCode> codes;
+    for (const ByteFrequencies& table_frequencies : frequencies) {
+        codes.push_back(HuffmanCode::FromFrequencies(table_frequencies, HuffmanCode::MAX_COMPACT_LENGTH));
+    }
+    return codes;
+}
+
+/// @brief Начальные длины, как в bzip2: байты делятся на отрезки с равной суммой частот, и каждая таблица
+/// дешево кодирует только свой отрезок. Так группы с разным распределением сразу выбирают разные таблицы.
+std::vector<ByteLengths> InitialLengths(const ByteFrequencies& block_frequencies, size_t tables_count) {
+    std::vector<ByteLengths> lengths(tables_count);
+    size_t remaining = std::accumulate(block_frequencies.begin(), block_frequencies.end(), size_t{0});
+    size_t byte = 0;
+    for (size_t table = 0; table < tables_count; ++table) {
+        lengths[table].fill(1);
+        const size_t target = remaining / (tables_count - table);
+        size_t sum = 0;
+        for (; byte < MultiHuffmanEncoder::ALPHABET_SIZE && (sum < target || table + 1 == tables_count); ++byte) {
+            sum += block_frequencies[byte];
+            lengths[table][byte] = 0;
+        }
+        remaining -= sum;
+    }
+    return lengths;
+}
+
+std::vector<ByteLengths> CodeLengths(const std::vector<HuffmanCode>& codes) {
+    std::vector<ByteLengths> lengths(codes.size());
+    for (size_t table = 0; table < codes.size(); ++table) {
+        std::ranges::copy(codes[table].GetLengths(), lengths[table].begin());
+    }
+    return lengths;
+}
+
+/// @brief Выбрать для каждой группы таблицу с наименьшей длиной.
+void ChooseTables(std::span<const uint8_t> block, const std::vector<ByteLengths>& lengths,
+                  std::vector<uint8_t>& selectors) {
+    for (size_t group = 0; group < selectors.size(); ++group) {
+        size_t best_cost = std::numeric_limits<size_t>::max();
+        for (size_t table = 0; table < lengths.size(); ++table) {
+            size_t cost = 0;
+            for (uint8_t byte : Group(block, group)) {
+                cost += lengths[table][byte];
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                selectors[group] = static_cast<uint8_t>(table);
+            }
+        }
+    }
+}
+
+/// @brief Убрать коды, которые не выбрала ни одна группа, и перенумеровать селекторы.
+size_t RemoveUnusedTables(std::vector<uint8_t>& selectors, size_t tables_count) {
+    std::vector<uint8_t> renumbered(tables_count, MultiHuffmanEncoder::MAX_TABLES_COUNT);
+    size_t used_count = 0;
+    for (uint8_t& selector : selectors) {
+        if (renumbered[selector] == MultiHuffmanEncoder::MAX_TABLES_COUNT) {
+            renumbered[selector] = static_cast<uint8_t>(used_count++);
+        }
+        selector = renumbered[selector];
+    }
+    return used_count;
+}
+
+/// @brief Начальный список таблиц для move-to-front селекторов.
+std::vector<uint8_t> TableOrder(size_t tables_count) {
+    std::vector<uint8_t> order;
+    for (size_t table = 0; table < tables_count; ++table) {
+        order.push_back(static_cast<uint8_t>(table));
+    }
+    return order;
+}
+
+}  // namespace
+
+size_t MultiHuffmanEncoder::TablesCount(size_t block_size) {
+    // Пороги bzip2 в символах блока.
+    if (block_size < 200) {
+        return 2;
+    }
+    if (block_size < 600) {
+        return 3;
+    }
+    if (block_size < 1200) {
+        return 4;
+    }
+    if (block_size < 2400) {
+        return 5;
+    }
+    return MAX_TABLES_COUNT;
+}
+
+void MultiHuffmanEncoder::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const {
+    ByteFrequencies block_frequencies{};
+    for (uint8_t byte : block) {
+        ++block_frequencies[byte];
+    }
+
+    const size_t groups_count = GroupsCount(block.size());
+    size_t tables_count = std::min(TablesCount(block.size()), std::max<size_t>(1, groups_count));
+    std::vector<uint8_t> selectors(groups_count);
+    ChooseTables(block, InitialLengths(block_frequencies, tables_count), selectors);
+    for (size_t iteration = 0; iteration < REFINEMENT_COUNT; ++iteration) {
+        ChooseTables(block, CodeLengths(BuildCodes(block, selectors, tables_count, block_frequencies)), selectors);
+    }
+    tables_count = RemoveUnusedTables(selectors, tables_count);
+    const auto codes = BuildCodes(block, selectors, tables_count, block_frequencies);
+
+    bs.WriteInt(tables_count, TABLES_COUNT_BIT_COUNT);
+    for (const HuffmanCode& code : codes) {
+        code.WriteCompact(bs);
+    }
+
+    auto order = TableOrder(tables_count);
+    for (uint8_t selector : selectors) {
+        const auto position = std::ranges::find(order, selector);
+        for (auto it = order.begin(); it != position; ++it) {
+            bs.WriteBit(true);
+        }
+        bs.WriteBit(false);
+        std::rotate(order.begin(), position, position + 1);
+    }
+
+    for (size_t group = 0; group < groups_count; ++group) {
+        const HuffmanCode& code = codes[selectors[group]];
+        for (uint8_t byte : Group(block, group)) {
+            for (bool bit : code.GetCode(byte)) {
+                bs.WriteBit(bit);
+            }
+        }
+    }
+}
+
+void MultiHuffmanDecoder::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    const size_t tables_count = bs.ReadInt(MultiHuffmanEncoder::TABLES_COUNT_BIT_COUNT);
+    if (tables_count == 0 || tables_count > MultiHuffmanEncoder::MAX_TABLES_COUNT) {
+        throw MultiHuffmanFormatError("Invalid number of huffman tables.");
+    }
+    std::vector<HuffmanDecoder> decoders;
+    for (size_t table = 0; table < tables_count; ++table) {
+        decoders.emplace_back(HuffmanCode::ReadCompact(bs, MultiHuffmanEncoder::ALPHABET_SIZE));
+    }
+
+    auto order = TableOrder(tables_count);
+    std::vector<uint8_t> selectors(GroupsCount(block.size()));
+    for (uint8_t& selector : selectors) {
+        size_t position = 0;
+        while (bs.ReadBit()) {
+            if (++position == tables_count) {
+                throw MultiHuffmanFormatError("Invalid huffman table selector.");
+            }
+        }
+        selector = order[position];
+        std::rotate(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(position),
+                    order.begin() + static_cast<std::ptrdiff_t>(position) + 1);
+    }
+
+    for (size_t group = 0; group < selectors.size(); ++group) {
+        const HuffmanDecoder& decoder = decoders[selectors[group]];
+        const size_t begin = group * MultiHuffmanEncoder::GROUP_SIZE;
+        for (uint8_t& byte : block.subspan(begin, std::min(MultiHuffmanEncoder::GROUP_SIZE, block.size() - begin))) {
+            byte = static_cast<uint8_t>(decoder.ReadSymbol(bs));
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "huffman.hpp"
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class MultiHuffmanFormatError : public std::runtime_error {
+public:
+    inline MultiHuffmanFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Несколько кодов Хаффмана на блок, как в bzip2. Блок делится на группы по GROUP_SIZE байтов, и каждая
+ * группа кодируется тем кодом, который дает ей наименьшую длину, поэтому коды следуют за сменой распределения
+ * байтов внутри блока. Коды уточняются за REFINEMENT_COUNT проходов: группы выбирают лучший код, затем коды
+ * перестраиваются по частотам выбравших их групп.
+ *
+ * Формат блока: 3 бита - количество кодов, коды над байтами в сжатом виде (HuffmanCode::WriteCompact),
+ * селекторы групп - номера кодов после move-to-front, записанные унарно (k единиц и ноль), затем байты.
+ * Каждый код содержит все байты блока, поэтому любая группа может выбрать любой код.
+ */
+class MultiHuffmanEncoder {
+public:
+    static constexpr size_t ALPHABET_SIZE = 256;
+    static constexpr size_t GROUP_SIZE = 50;
+    static constexpr size_t MAX_TABLES_COUNT = 6;
+    static constexpr size_t TABLES_COUNT_BIT_COUNT = 3;
+    static constexpr size_t REFINEMENT_COUNT = 4;
+
+    /// @brief Количество кодов для блока: на коротких блоках таблицы не окупаются.
+    static size_t TablesCount(size_t block_size);
+
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) const;
+};
+
+class MultiHuffmanDecoder {
+public:
+    /// @brief Декодировать блок известного размера. Бросает MultiHuffmanFormatError, HuffmanFormatError или
+    /// BitReader::ReadException, если данные повреждены.
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const;
+};
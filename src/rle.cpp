@@ -0,0 +1,57 @@
+#include "rle.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+RunLengthDecoder::RunLengthDecoder(const HuffmanDecoder& decoder)
+    : decoder_(decoder), output_(OUTPUT_BUFFER_SIZE), output_size_(0) {
+}
+
+void RunLengthDecoder::Decode(BitReader& bs, std::ostream& os) {
+    output_size_ = 0;
+    bool has_last_byte = false;
+    char last_byte = 0;
+
+    while (true) {
+        const size_t symbol = decoder_.ReadSymbol(bs);
+        if (symbol < RunLengthSplitter::END_OF_DATA) {
+            last_byte = static_cast<char>(symbol);
+            has_last_byte = true;
+            if (output_size_ == output_.size()) {
+                Flush(os);
+            }
+            output_[output_size_++] = last_byte;
+        } else if (symbol == RunLengthSplitter::END_OF_DATA) {
+            break;
+        } else {
+            if (!has_last_byte) {
+                throw RunLengthFormatError("A run is not preceded by a byte.");
+            }
+            const size_t repeats =
+                RunLengthSplitter::MIN_RUN + ValueBucket::ReadValue(symbol - RunLengthSplitter::FIRST_RUN_SYMBOL, bs);
+            if (repeats > RunLengthSplitter::MAX_RUN) {
+                throw RunLengthFormatError("A run is too long.");
+            }
+            Fill(last_byte, repeats, os);
+        }
+    }
+
+    Flush(os);
+}
+
+void RunLengthDecoder::Fill(char byte, size_t count, std::ostream& os) {
+    while (count > 0) {
+        if (output_size_ == output_.size()) {
+            Flush(os);
+        }
+        const size_t chunk = std::min(count, output_.size() - output_size_);
+        std::memset(output_.data() + output_size_, byte, chunk);
+        output_size_ += chunk;
+        count -= chunk;
+    }
+}
+
+void RunLengthDecoder::Flush(std::ostream& os) {
+    os.write(output_.data(), static_cast<std::streamsize>(output_size_));
+    output_size_ = 0;
+}
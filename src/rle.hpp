@@ -0,0 +1,94 @@
+#pragma once
+
+#include "huffman.hpp"
+#include "bitstream_reader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class RunLengthFormatError : public std::runtime_error {
+public:
+    inline RunLengthFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief RLE-фильтр перед кодом Хаффмана. Алфавит расширяется символами повтора: байт записывается
+ * литералом, а MIN_RUN и более его повторений сразу после него - одним символом FIRST_RUN_SYMBOL + код
+ * группы ValueBucket с дополнительными битами. Данные заканчиваются символом END_OF_DATA.
+ */
+class RunLengthSplitter {
+public:
+    static constexpr size_t MIN_RUN = 3;
+    static constexpr size_t MAX_RUN = MIN_RUN + (size_t{1} << 32) - 1;
+    static constexpr size_t END_OF_DATA = 256;
+    static constexpr size_t FIRST_RUN_SYMBOL = END_OF_DATA + 1;
+    static constexpr size_t ALPHABET_SIZE = FIRST_RUN_SYMBOL + ValueBucket::Count(MAX_RUN - MIN_RUN);
+
+    /// @brief Разбить очередной фрагмент данных на символы. Серия может продолжаться в следующем фрагменте.
+    /// @param sink вызывается как sink(symbol, bucket), у литералов bucket не содержит дополнительных бит
+    template <typename Sink>
+    void Feed(std::span<const uint8_t> data, Sink&& sink) {
+        for (uint8_t byte : data) {
+            if (byte == last_byte_ && has_last_byte_ && repeats_ < MAX_RUN) {
+                ++repeats_;
+                continue;
+            }
+
+            FlushRepeats(sink);
+            sink(size_t{byte}, ValueBucket{});
+            last_byte_ = byte;
+            has_last_byte_ = true;
+        }
+    }
+
+    /// @brief Завершить последнюю серию и выдать END_OF_DATA.
+    template <typename Sink>
+    void Finish(Sink&& sink) {
+        FlushRepeats(sink);
+        sink(END_OF_DATA, ValueBucket{});
+        has_last_byte_ = false;
+    }
+
+private:
+    uint8_t last_byte_ = 0;
+    bool has_last_byte_ = false;
+    size_t repeats_ = 0;
+
+    template <typename Sink>
+    void FlushRepeats(Sink&& sink) {
+        if (repeats_ >= MIN_RUN) {
+            const auto bucket = ValueBucket::FromValue(repeats_ - MIN_RUN);
+            sink(FIRST_RUN_SYMBOL + bucket.code, bucket);
+        } else {
+            for (size_t i = 0; i < repeats_; ++i) {
+                sink(size_t{last_byte_}, ValueBucket{});
+            }
+        }
+        repeats_ = 0;
+    }
+};
+
+/**
+ * @brief Декодер RLE-фильтра. Серии разворачиваются заполнением буфера вывода, а не по одному байту.
+ */
+class RunLengthDecoder {
+public:
+    explicit RunLengthDecoder(const HuffmanDecoder& decoder);
+
+    void Decode(BitReader& bs, std::ostream& os);
+
+private:
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+    const HuffmanDecoder& decoder_;
+    std::vector<char> output_;
+    size_t output_size_;
+
+    void Fill(char byte, size_t count, std::ostream& os);
+    void Flush(std::ostream& os);
+};
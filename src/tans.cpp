@@ -0,0 +1,205 @@
+#include "tans.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+TansTable::TansTable() : table_log_(MIN_TABLE_LOG), counts_(ALPHABET_SIZE, 0) {
+}
+
+TansTable TansTable::FromFrequencies(std::span<const size_t> frequencies) {
+    TansTable table;
+    frequencies = frequencies.first(std::min(frequencies.size(), ALPHABET_SIZE));
+
+    const size_t total = std::accumulate(frequencies.begin(), frequencies.end(), size_t{0});
+    const size_t used_symbols = frequencies.size() - std::ranges::count(frequencies, 0);
+    if (used_symbols == 0) {
+        table.counts_[0] = size_t{1} << table.table_log_;
+        return table;
+    }
+
+    table.table_log_ = std::clamp<size_t>(std::bit_width(total), MIN_TABLE_LOG + 2, MAX_TABLE_LOG + 2) - 2;
+    table.table_log_ = std::max<size_t>(table.table_log_, std::bit_width(used_symbols - 1) + 1);
+    const size_t states_count = size_t{1} << table.table_log_;
+
+    size_t sum = 0;
+    for (size_t i = 0; i < frequencies.size(); ++i) {
+        if (frequencies[i] != 0) {
+            const auto scaled = static_cast<size_t>((static_cast<unsigned __int128>(frequencies[i]) * states_count +
+                                                     total / 2) / total);
+            table.counts_[i] = std::max<size_t>(scaled, 1);
+            sum += table.counts_[i];
+        }
+    }
+
+    // Округление могло сдвинуть сумму. Недостающие состояния получает самый частый символ, лишние
+    // по одному отнимаются у самых частых символов, чтобы не испортить редкие.
+    auto largest = std::ranges::max_element(table.counts_);
+    if (sum < states_count) {
+        *largest += states_count - sum;
+    }
+    while (sum > states_count) {
+        largest = std::ranges::max_element(table.counts_);
+        --*largest;
+        --sum;
+    }
+
+    return table;
+}
+
+void TansTable::Write(BitWriter& bs) const {
+    bs.WriteInt(table_log_, TABLE_LOG_BIT_COUNT);
+
+    // Редкие символы выгоднее перечислить, чем записывать бит присутствия для каждого байта.
+    const size_t used_symbols = ALPHABET_SIZE - std::ranges::count(counts_, 0);
+    const bool as_list = used_symbols * SYMBOL_BIT_COUNT + USED_SYMBOLS_BIT_COUNT < ALPHABET_SIZE;
+    bs.WriteBit(as_list);
+    if (as_list) {
+        bs.WriteInt(used_symbols, USED_SYMBOLS_BIT_COUNT);
+    }
+
+    for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+        if (as_list) {
+            if (counts_[symbol] != 0) {
+                bs.WriteInt(symbol, SYMBOL_BIT_COUNT);
+                bs.WriteInt(counts_[symbol] - 1, table_log_);
+            }
+        } else {
+            bs.WriteBit(counts_[symbol] != 0);
+            if (counts_[symbol] != 0) {
+                bs.WriteInt(counts_[symbol] - 1, table_log_);
+            }
+        }
+    }
+}
+
+TansTable TansTable::Read(BitReader& bs) {
+    TansTable table;
+    table.table_log_ = bs.ReadInt(TABLE_LOG_BIT_COUNT);
+    if (table.table_log_ < MIN_TABLE_LOG || table.table_log_ > MAX_TABLE_LOG) {
+        throw TansFormatError("Invalid tANS table size.");
+    }
+
+    if (bs.ReadBit()) {
+        const size_t used_symbols = bs.ReadInt(USED_SYMBOLS_BIT_COUNT);
+        for (size_t i = 0; i < used_symbols; ++i) {
+            const size_t symbol = bs.ReadInt(SYMBOL_BIT_COUNT);
+            if (table.counts_[symbol] != 0) {
+                throw TansFormatError("Invalid tANS symbol frequencies.");
+            }
+            table.counts_[symbol] = bs.ReadInt(table.table_log_) + 1;
+        }
+    } else {
+        for (size_t& count : table.counts_) {
+            if (bs.ReadBit()) {
+                count = bs.ReadInt(table.table_log_) + 1;
+            }
+        }
+    }
+
+    if (std::accumulate(table.counts_.begin(), table.counts_.end(), size_t{0}) != size_t{1} << table.table_log_) {
+        throw TansFormatError("Invalid tANS symbol frequencies.");
+    }
+    return table;
+}
+
+size_t TansTable::TableLog() const {
+    return table_log_;
+}
+
+const std::vector<size_t>& TansTable::GetCounts() const {
+    return counts_;
+}
+
+std::vector<uint8_t> TansTable::Spread() const {
+    // Шаг нечетный, поэтому за 2^table_log_ шагов обходятся все состояния, а состояния одного
+    // символа оказываются разбросаны по всей таблице.
+    const size_t states_count = size_t{1} << table_log_;
+    const size_t step = (states_count >> 1) + (states_count >> 3) + 3;
+
+    std::vector<uint8_t> spread(states_count);
+    size_t position = 0;
+    for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+        for (size_t i = 0; i < counts_[symbol]; ++i) {
+            spread[position] = static_cast<uint8_t>(symbol);
+            position = (position + step) & (states_count - 1);
+        }
+    }
+    return spread;
+}
+
+TansEncoder::TansEncoder(const TansTable& table)
+    : table_log_(table.TableLog()), transforms_(TansTable::ALPHABET_SIZE), next_state_(), chunks_() {
+    const size_t states_count = size_t{1} << table_log_;
+    const auto& counts = table.GetCounts();
+
+    size_t first_state = 0;
+    for (size_t symbol = 0; symbol < TansTable::ALPHABET_SIZE; ++symbol) {
+        const size_t count = counts[symbol];
+        transforms_[symbol] = SymbolTransform{
+            .first_state = first_state,
+            .count = count,
+            .max_bit_count = count == 0 ? 0 : table_log_ + 1 - std::bit_width(count),
+        };
+        first_state += count;
+    }
+
+    // Состояния символа нумеруются от count до 2 * count - 1 в порядке их появления в таблице.
+    next_state_.resize(states_count);
+    std::vector<size_t> occurrences(TansTable::ALPHABET_SIZE, 0);
+    const auto spread = table.Spread();
+    for (size_t state = 0; state < states_count; ++state) {
+        const auto& transform = transforms_[spread[state]];
+        next_state_[transform.first_state + occurrences[spread[state]]++] = static_cast<uint32_t>(states_count + state);
+    }
+}
+
+void TansEncoder::EncodeBlock(std::span<const uint8_t> block, BitWriter& bs) {
+    const size_t states_count = size_t{1} << table_log_;
+    chunks_.clear();
+    chunks_.reserve(block.size());
+
+    size_t state = states_count;
+    for (auto it = block.rbegin(); it != block.rend(); ++it) {
+        const auto& transform = transforms_[*it];
+        const size_t bit_count =
+            transform.max_bit_count - static_cast<size_t>(state < (transform.count << transform.max_bit_count));
+        chunks_.push_back(Chunk{.bits = static_cast<uint32_t>(state & ((size_t{1} << bit_count) - 1)),
+                                .bit_count = static_cast<uint32_t>(bit_count)});
+        state = next_state_[transform.first_state + (state >> bit_count) - transform.count];
+    }
+
+    // Декодер идет от начала блока, поэтому биты записываются в порядке, обратном порядку кодирования.
+    bs.WriteInt(state - states_count, table_log_);
+    for (auto it = chunks_.rbegin(); it != chunks_.rend(); ++it) {
+        bs.WriteInt(it->bits, it->bit_count);
+    }
+}
+
+TansDecoder::TansDecoder() : table_log_(0), entries_() {
+}
+
+TansDecoder::TansDecoder(const TansTable& table) : table_log_(table.TableLog()), entries_() {
+    const size_t states_count = size_t{1} << table_log_;
+    std::vector<size_t> next = table.GetCounts();
+
+    entries_.resize(states_count);
+    const auto spread = table.Spread();
+    for (size_t state = 0; state < states_count; ++state) {
+        const uint8_t symbol = spread[state];
+        const size_t symbol_state = next[symbol]++;
+        const size_t bit_count = table_log_ + 1 - std::bit_width(symbol_state);
+        entries_[state] = Entry{.base = static_cast<uint32_t>((symbol_state << bit_count) - states_count),
+                                .symbol = symbol,
+                                .bit_count = static_cast<uint8_t>(bit_count)};
+    }
+}
+
+void TansDecoder::DecodeBlock(BitReader& bs, std::span<uint8_t> block) const {
+    size_t state = bs.ReadInt(table_log_);
+    for (uint8_t& byte : block) {
+        const Entry& entry = entries_[state];
+        byte = entry.symbol;
+        state = entry.base + bs.ReadInt(entry.bit_count);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "bitstream_reader.hpp"
+#include "bitstream_writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+class TansFormatError : public std::runtime_error {
+public:
+    inline TansFormatError(const char* message) : std::runtime_error(message) {
+    }
+};
+
+/**
+ * @brief Нормированные частоты байтов для tANS: сумма частот равна 2^TableLog(), каждый встречающийся
+ * байт получает хотя бы одно состояние. В отличие от кода Хаффмана, символ может стоить дробное число бит.
+ */
+class TansTable {
+public:
+    static constexpr size_t ALPHABET_SIZE = 256;
+    static constexpr size_t MIN_TABLE_LOG = 5;
+    static constexpr size_t MAX_TABLE_LOG = 12;
+    static constexpr size_t TABLE_LOG_BIT_COUNT = 4;
+    static constexpr size_t USED_SYMBOLS_BIT_COUNT = 9;
+    static constexpr size_t SYMBOL_BIT_COUNT = 8;
+
+    TansTable();
+
+    /// @brief Нормировать частоты. Размер таблицы выбирается по количеству символов: для коротких
+    /// файлов большая таблица не окупает заголовок.
+    /// @param frequencies частоты байтов, используются первые ALPHABET_SIZE значений
+    static TansTable FromFrequencies(std::span<const size_t> frequencies);
+
+    /// @brief Записать таблицу: 4 бита - TableLog(), 1 бит - способ записи. Если он равен `0`, то для
+    /// каждого байта записывается бит присутствия, если `1` - 9 бит количество встречающихся байтов и
+    /// их значения по 8 бит. За каждым встречающимся байтом следует его частота минус один в TableLog() битах.
+    void Write(BitWriter& bs) const;
+    static TansTable Read(BitReader& bs);
+
+    size_t TableLog() const;
+    const std::vector<size_t>& GetCounts() const;
+
+    /// @brief Порядок символов в состояниях: i-е состояние соответствует символу Spread()[i].
+    std::vector<uint8_t> Spread() const;
+
+private:
+    size_t table_log_;
+    std::vector<size_t> counts_;
+};
+
+/**
+ * @brief Кодировщик tANS. Символы блока кодируются с конца, поэтому блок целиком держится в памяти.
+ * Формат блока: TableLog() бит - начальное состояние декодера, затем биты символов в прямом порядке.
+ */
+class TansEncoder {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    explicit TansEncoder(const TansTable& table);
+
+    void EncodeBlock(std::span<const uint8_t> block, BitWriter& bs);
+
+private:
+    struct SymbolTransform {
+        size_t first_state;
+        size_t count;
+        size_t max_bit_count;
+    };
+
+    struct Chunk {
+        uint32_t bits;
+        uint32_t bit_count;
+    };
+
+    size_t table_log_;
+    std::vector<SymbolTransform> transforms_;
+    std::vector<uint32_t> next_state_;
+    std::vector<Chunk> chunks_;
+};
+
+class TansDecoder {
+public:
+    TansDecoder();
+    explicit TansDecoder(const TansTable& table);
+
+    /// @brief Декодировать блок, размер которого известен заранее. Цикл не содержит ветвлений по
+    /// символам: состояние определяет и символ, и количество читаемых бит.
+    void DecodeBlock(BitReader& bs, std::span<uint8_t> block) const;
+
+private:
+    struct Entry {
+        uint32_t base;
+        uint8_t symbol;
+        uint8_t bit_count;
+    };
+
+    size_t table_log_;
+    std::vector<Entry> entries_;
+};
@@ -136,6 +136,15 @@ TEST_CASE("CLIArgumentParser exceptions") {
         REQUIRE(parsed.GetValue("create") == "legends.zip");
         REQUIRE(parsed.GetValueArray() == std::vector<std::string>{"main.cpp", "args.hpp", "args.cpp"});
     }
+
+    {
+        auto args = GetArguments("./archiver -c - main.cpp - args.cpp");
+        auto args_rav = GetRavArguments(args);
+        auto parsed = parser_archiver.Parse(args_rav.size(), args_rav.data());
+
+        REQUIRE(parsed.GetValue("create") == "-");
+        REQUIRE(parsed.GetValueArray() == std::vector<std::string>{"main.cpp", "-", "args.cpp"});
+    }
 }
 
 TEST_CASE("CLIArgumentParser exceptions constructor") {
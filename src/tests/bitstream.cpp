@@ -5,9 +5,22 @@
 #include "../decode.hpp"
 #include "../bitstream_writer.hpp"
 #include "../bitstream_reader.hpp"
+#include "../async_io.hpp"
 
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <sstream>
 #include <memory>
+#include <map>
+#include <numeric>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 TEST_CASE("BitStreamWriter") {
     BitWriterString bws;
@@ -32,6 +45,230 @@ TEST_CASE("BitStreamReader") {
     REQUIRE(bru8.ReadInt(holder, 9));
     REQUIRE(holder == 259);
     REQUIRE(!bru8.ReadInt(holder, 9));
+
+    BitReaderU8 peek_reader(std::vector<uint8_t>{0b10110011, 0b01000000});
+    REQUIRE(peek_reader.ReadBit());
+    REQUIRE(peek_reader.PeekBits(8) == 0b01100110);
+    REQUIRE(peek_reader.PeekBits(3) == 0b011);
+    peek_reader.SkipBits(3);
+    REQUIRE(peek_reader.ReadInt(5) == 0b00110);
+    // За концом потока PeekBits дополняет биты нулями, а SkipBits не пропускает их.
+    REQUIRE(peek_reader.PeekBits(8) == 0b10000000);
+    REQUIRE_THROWS_AS(peek_reader.SkipBits(8), BitReader::ReadException);
+}
+
+TEST_CASE("BitStream LSB first") {
+    BitWriterU8 writer;
+    writer.WriteBit(true);
+    // Смена порядка дописывает текущий байт нулями.
+    writer.SetBitOrder(BitOrder::LSB_FIRST);
+    writer.WriteInt(257, 9);
+    writer.WriteBit(true);
+    writer.WriteInt(0x0123456789ABCDEF, 64);
+    writer.Close();
+    REQUIRE(writer.Data() == std::vector<uint8_t>{0b10000000, 0b00000001, 0b10111111, 0b00110111, 0b10101111,
+                                                  0b00100110, 0b10011110, 0b00010101, 0b10001101, 0b00000100,
+                                                  0b00000000});
+
+    BitReaderU8 reader(writer.Data());
+    REQUIRE(reader.ReadBit());
+    // Байт, уже считанный в буфер просмотром, при смене порядка не теряется.
+    REQUIRE(reader.PeekBits(8) == 0);
+    reader.SetBitOrder(BitOrder::LSB_FIRST);
+    REQUIRE(reader.PeekBits(3) == 0b001);
+    REQUIRE(reader.ReadInt(9) == 257);
+    REQUIRE(reader.ReadBit());
+    REQUIRE(reader.ReadInt(64) == 0x0123456789ABCDEF);
+    REQUIRE(reader.ReadInt(6) == 0);
+    REQUIRE(reader.PeekBits(8) == 0);
+    REQUIRE_THROWS_AS(reader.SkipBits(8), BitReader::ReadException);
+
+    auto stream = std::make_unique<std::istringstream>(
+        std::string(reinterpret_cast<const char*>(writer.Data().data()), writer.Data().size()));
+    BitReaderStream stream_reader(std::move(stream));
+    REQUIRE(stream_reader.ReadInt(8) == 0b10000000);
+    stream_reader.SetBitOrder(BitOrder::LSB_FIRST);
+    REQUIRE(stream_reader.ReadInt(9) == 257);
+    REQUIRE(stream_reader.ReadBit());
+    REQUIRE(stream_reader.ReadInt(64) == 0x0123456789ABCDEF);
+    size_t holder = 0;
+    REQUIRE(stream_reader.ReadInt(holder, 6));
+    REQUIRE(!stream_reader.ReadInt(holder, 8));
+}
+
+TEST_CASE("BitStream bytes") {
+    const std::vector<uint8_t> bytes{0x01, 0x80, 0xFF, 0x5A, 0x00, 0x7E, 0xC3, 0x3C, 0x99, 0x42};
+    for (BitOrder order : {BitOrder::MSB_FIRST, BitOrder::LSB_FIRST}) {
+        BitWriterU8 writer;
+        writer.SetBitOrder(order);
+        writer.WriteInt(0b101, 3);
+        writer.WriteBytes(bytes);
+        writer.WriteBit(true);
+        writer.Close();
+        // Байты начинаются с границы байта и записаны как есть.
+        REQUIRE(std::vector<uint8_t>(writer.Data().begin() + 1, writer.Data().end() - 1) == bytes);
+
+        BitReaderU8 reader(writer.Data());
+        reader.SetBitOrder(order);
+        REQUIRE(reader.ReadInt(3) == 0b101);
+        // Часть байтов уже в буфере битов после просмотра.
+        reader.PeekBits(8);
+        std::vector<uint8_t> read(bytes.size());
+        reader.ReadBytes(read);
+        REQUIRE(read == bytes);
+        REQUIRE(reader.ReadBit());
+        REQUIRE_THROWS_AS(reader.ReadBytes(read), BitReader::ReadException);
+    }
+}
+
+TEST_CASE("BitWriterStream buffered") {
+    const auto path = (std::filesystem::temp_directory_path() / "archiver_bitwriter_stream_test").string();
+    std::vector<uint8_t> bytes(5000);
+    std::iota(bytes.begin(), bytes.end(), uint8_t{0});
+    BitWriterU8 expected;
+    expected.WriteInt(0b101, 3);
+    expected.WriteBytes(bytes);
+    expected.WriteInt(0x1234, 16);
+    expected.WriteBit(true);
+    expected.Close();
+    const auto read_file = [&] {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    // Буфер меньше WriteBytes, больше и по одному байту.
+    for (size_t buffer_size : {size_t{1}, size_t{64}, BitWriterStream::DEFAULT_BUFFER_SIZE}) {
+        {
+            BitWriterStream writer(path, buffer_size);
+            writer.WriteInt(0b101, 3);
+            writer.WriteBytes(bytes);
+            writer.Flush();
+            // Незаконченный байт остается в писателе.
+            REQUIRE(read_file().size() == bytes.size() + 1);
+            writer.WriteInt(0x1234, 16);
+            writer.Sync();
+            REQUIRE(read_file().size() == bytes.size() + 3);
+            writer.WriteBit(true);
+        }
+        REQUIRE(read_file() == expected.Data());
+
+        auto os = std::make_unique<std::ostringstream>();
+        auto& stream = *os;
+        BitWriterStream stream_writer(std::move(os), buffer_size);
+        stream_writer.WriteInt(0b101, 3);
+        stream_writer.WriteBytes(bytes);
+        stream_writer.WriteInt(0x1234, 16);
+        stream_writer.WriteBit(true);
+        stream_writer.Close();
+        REQUIRE(stream.str() == std::string(expected.Data().begin(), expected.Data().end()));
+    }
+    std::filesystem::remove(path);
+
+    REQUIRE_THROWS_AS(BitWriterStream(std::filesystem::temp_directory_path().string()), std::ios_base::failure);
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    close(pipe_fds[0]);
+    // Запись в канал без читателя: ошибку видит Close, а не деструктор.
+    std::signal(SIGPIPE, SIG_IGN);
+    BitWriterStream broken(pipe_fds[1]);
+    broken.WriteBytes(bytes);
+    REQUIRE_THROWS_AS(broken.Close(), std::ios_base::failure);
+    close(pipe_fds[1]);
+}
+
+TEST_CASE("Async file io") {
+    const auto path = (std::filesystem::temp_directory_path() / "archiver_async_io_test").string();
+    std::mt19937 generator(3);
+    std::vector<uint8_t> content(AsyncFileWriter::CHUNK_SIZE * 3 + 12345);
+    for (uint8_t& byte : content) {
+        byte = static_cast<uint8_t>(generator());
+    }
+
+    std::vector<IoOptions> variants;
+    for (bool use_io_uring : {true, false}) {
+        for (CachePolicy cache :
+             {CachePolicy::NORMAL, CachePolicy::SEQUENTIAL, CachePolicy::DROP_BEHIND, CachePolicy::DIRECT}) {
+            variants.push_back(IoOptions{.use_io_uring = use_io_uring, .cache = cache});
+        }
+    }
+
+    for (const IoOptions& options : variants) {
+        {
+            BitWriterFile writer(path, options);
+            for (uint8_t byte : content) {
+                writer.WriteInt(byte, 8);
+            }
+            writer.WriteInt(0b101, 3);
+            writer.Close();
+        }
+        REQUIRE(std::filesystem::file_size(path) == content.size() + 1);
+
+        BitReaderFile reader(path, options);
+        reader.SetBitOrder(BitOrder::LSB_FIRST);
+        for (size_t i = 0; i < content.size(); i += 8) {
+            const size_t count = std::min<size_t>(8, content.size() - i);
+            size_t expected = 0;
+            for (size_t j = 0; j < count; ++j) {
+                expected |= size_t{content[i + j]} << (8 * j);
+            }
+            REQUIRE(reader.ReadInt(8 * count) == expected);
+        }
+        REQUIRE(reader.ReadInt(8) == 0b10100000);
+        size_t holder = 0;
+        REQUIRE(!reader.ReadInt(holder, 1));
+
+        // Поток поверх AsyncFileReader перемещается внутри фрагмента и за его пределы.
+        AsyncInputFile input(path, IoOptions{.depth = 2, .use_io_uring = options.use_io_uring, .cache = options.cache});
+        input.seekg(0, std::ios::end);
+        REQUIRE(static_cast<size_t>(input.tellg()) == content.size() + 1);
+        for (size_t position : {size_t{5}, AsyncFileReader::CHUNK_SIZE * 2 + 7, size_t{100}, size_t{0}}) {
+            input.seekg(static_cast<std::streamoff>(position));
+            REQUIRE(static_cast<uint8_t>(input.get()) == content[position]);
+            REQUIRE(static_cast<size_t>(input.tellg()) == position + 1);
+        }
+        input.seekg(static_cast<std::streamoff>(AsyncFileReader::CHUNK_SIZE - 1));
+        std::string chunk(3, 0);
+        REQUIRE(input.read(chunk.data(), 3));
+        REQUIRE(std::equal(chunk.begin(), chunk.end(), content.begin() + AsyncFileReader::CHUNK_SIZE - 1,
+                           [](char lhs, uint8_t rhs) { return static_cast<uint8_t>(lhs) == rhs; }));
+    }
+    std::filesystem::remove(path);
+
+    REQUIRE_THROWS_AS(BitReaderFile(path), std::ios_base::failure);
+    REQUIRE_THROWS_AS(AsyncInputFile(std::filesystem::temp_directory_path().string()), std::ios_base::failure);
+}
+
+TEST_CASE("Mapped output file") {
+    const auto path = (std::filesystem::temp_directory_path() / "archiver_mapped_output_test").string();
+    std::mt19937 generator(5);
+    std::string content(MappedOutputFile::MIN_WINDOW_SIZE * 5 + 321, 0);
+    for (char& byte : content) {
+        byte = static_cast<char>(generator());
+    }
+
+    // Ожидаемый размер точный, меньше настоящего, больше настоящего и неизвестен.
+    for (uint64_t size : {uint64_t{content.size()}, uint64_t{1000}, uint64_t{1} << 30, uint64_t{0}}) {
+        {
+            MappedOutputFile output(path, size);
+            output.write(content.data(), 100);
+            for (size_t i = 100; i < 200; ++i) {
+                output << content[i];
+            }
+            output.write(content.data() + 200, static_cast<std::streamsize>(content.size() - 200));
+            output.Close();
+        }
+        REQUIRE(std::filesystem::file_size(path) == content.size());
+        std::ifstream input(path, std::ios::binary);
+        REQUIRE(std::string(std::istreambuf_iterator<char>(input), {}) == content);
+    }
+
+    {
+        MappedOutputFile output(path, 12345);
+    }
+    REQUIRE(std::filesystem::file_size(path) == 0);
+    std::filesystem::remove(path);
+
+    REQUIRE_THROWS_AS(MappedOutputFile(std::filesystem::temp_directory_path().string()), std::ios_base::failure);
 }
 
 TEST_CASE("ArchiveEncoder") {
@@ -60,4 +297,641 @@ TEST_CASE("ArchiveDecoder") {
     REQUIRE(filename == "a");
     REQUIRE(output.str() == "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
     REQUIRE(decoder.Done());
-}
\ No newline at end of file
+}
+
+TEST_CASE("ArchiveDecoder duplicates") {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto source = (directory / "archiver_duplicate_source").string();
+    const auto copy = (directory / "archiver_duplicate_copy").string();
+
+    const auto open = [](const std::string&) -> std::unique_ptr<std::istream> {
+        return std::make_unique<std::istringstream>("same content");
+    };
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer);
+        encoder.Encode(source, open);
+        encoder.Encode(copy, open);
+        encoder.Encode("last", open);
+        encoder.Close();
+    }
+
+    // Файл с именем исходной записи не имеет к архиву отношения и не должен попасть в вывод.
+    std::ofstream(source) << "WRONG";
+    BitReaderU8 reader(writer.Data());
+    ArchiveDecoder decoder(reader);
+    for (const auto& name : {source, copy}) {
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == name);
+        REQUIRE(output.str() == "same content");
+    }
+    // Содержимое записи, распакованной в поток, достается и дубликату, распакованному в файл.
+    REQUIRE(decoder.DecodeFile() == "last");
+    REQUIRE(decoder.Done());
+    std::ifstream input("last", std::ios::binary);
+    REQUIRE(std::string(std::istreambuf_iterator<char>(input), {}) == "same content");
+    input.close();
+    std::filesystem::remove("last");
+    std::filesystem::remove(source);
+}
+
+TEST_CASE("ArchiveEncoder duplicates compare content") {
+    std::mt19937 generator(3);
+    std::string content;
+    for (size_t i = 0; i < 4096; ++i) {
+        content.push_back(static_cast<char>(generator() % 256));
+    }
+
+    // Одного совпадения отпечатка мало: если первый файл при повторном открытии отличается, второй
+    // записывается целиком, а не ссылкой.
+    const auto encode = [&](const std::string& reopened) {
+        std::map<std::string, std::string> files{{"first", content}, {"second", content}};
+        const auto open = [&](const std::string& name) -> std::unique_ptr<std::istream> {
+            return std::make_unique<std::istringstream>(files.at(name));
+        };
+        BitWriterU8 writer;
+        {
+            ArchiveEncoder encoder(writer);
+            encoder.Encode("first", open);
+            files["first"] = reopened;
+            encoder.Encode("second", open);
+            encoder.Close();
+        }
+
+        BitReaderU8 reader(writer.Data());
+        ArchiveDecoder decoder(reader);
+        for (const auto& name : {"first", "second"}) {
+            std::stringstream output;
+            REQUIRE(decoder.Decode(output) == name);
+            REQUIRE(output.str() == content);
+        }
+        REQUIRE(decoder.Done());
+        return writer.Data().size();
+    };
+
+    std::string changed = content;
+    changed.back() ^= 1;
+    REQUIRE(encode(content) + content.size() / 2 < encode(changed));
+}
+
+TEST_CASE("ArchiveEncoder solid") {
+    const std::map<std::string, std::string> files{
+        {"a.conf", "key=value\nname=archiver\n"},
+        {"b.conf", "key=other\n"},
+        {"empty", ""},
+    };
+    const std::vector<std::string> names{"a.conf", "b.conf", "empty"};
+
+    for (auto format_version : {archive::FormatVersion::V1, archive::FormatVersion::V3}) {
+        BitWriterU8 writer;
+        {
+            ArchiveEncoder encoder(writer, EncoderOptions{.format_version = format_version});
+            encoder.EncodeSolid(names, [&](const std::string& name) -> std::unique_ptr<std::istream> {
+                return std::make_unique<std::istringstream>(files.at(name));
+            });
+            encoder.Encode("tail", std::make_unique<std::istringstream>("not in the group"));
+            encoder.Close();
+        }
+
+        BitReaderU8 reader(writer.Data());
+        ArchiveDecoder decoder(reader);
+        for (const auto& name : names) {
+            std::stringstream output;
+            REQUIRE(!decoder.Done());
+            REQUIRE(decoder.Decode(output) == name);
+            REQUIRE(output.str() == files.at(name));
+        }
+
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == "tail");
+        REQUIRE(output.str() == "not in the group");
+        REQUIRE(decoder.Done());
+    }
+}
+
+TEST_CASE("ArchiveEncoder solid duplicates") {
+    const std::map<std::string, std::string> files{
+        {"x", "solid content"}, {"y", "solid content"}, {"z", "later content"}, {"w", "later content"}};
+    const auto open = [&](const std::string& name) -> std::unique_ptr<std::istream> {
+        return std::make_unique<std::istringstream>(files.at(name));
+    };
+
+    for (auto format_version : {archive::FormatVersion::V1, archive::FormatVersion::V3}) {
+        // Ссылка y записывается после группы, и номера следующих записей должны это учитывать.
+        BitWriterU8 writer;
+        {
+            ArchiveEncoder encoder(writer, EncoderOptions{.format_version = format_version});
+            encoder.EncodeSolid({"x", "y"}, open);
+            encoder.Encode("z", open);
+            encoder.Encode("w", open);
+            encoder.Close();
+        }
+
+        BitReaderU8 reader(writer.Data());
+        ArchiveDecoder decoder(reader);
+        for (const auto& name : {"x", "y", "z", "w"}) {
+            std::stringstream output;
+            REQUIRE(decoder.Decode(output) == name);
+            REQUIRE(output.str() == files.at(name));
+        }
+        REQUIRE(decoder.Done());
+    }
+}
+
+namespace {
+
+void CheckRoundTrip(const EncoderOptions& options) {
+    const std::vector<std::pair<std::string, std::string>> files{
+        {"a", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+        {"new_lines", "\n\n\nline\n"},
+        {"empty", ""},
+        {"text", "Рукописи не горят. Рукописи не горят. Рукописи не горят."},
+    };
+
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer, options);
+        for (const auto& [name, content] : files) {
+            encoder.Encode(name, std::make_unique<std::istringstream>(content));
+        }
+        encoder.Close();
+    }
+
+    BitReaderU8 reader(writer.Data());
+    ArchiveDecoder decoder(reader);
+    for (const auto& [name, content] : files) {
+        std::stringstream output;
+        REQUIRE(!decoder.Done());
+        REQUIRE(decoder.Decode(output) == name);
+        REQUIRE(output.str() == content);
+    }
+    REQUIRE(decoder.Done());
+}
+
+}  // namespace
+
+TEST_CASE("ArchiveEncoder format v2") {
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2});
+}
+
+TEST_CASE("ArchiveEncoder LSB first") {
+    for (auto options : {EncoderOptions{}, EncoderOptions::FromLevel(1), EncoderOptions::FromLevel(5),
+                         EncoderOptions::FromLevel(8), EncoderOptions::FromLevel(9),
+                         EncoderOptions{.method = EncodingMethod::CONTEXT_HUFFMAN},
+                         EncoderOptions{.method = EncodingMethod::TANS},
+                         EncoderOptions{.method = EncodingMethod::CONTEXT_MIXING},
+                         EncoderOptions{.method = EncodingMethod::LZ77}, EncoderOptions{.method = EncodingMethod::BWT},
+                         EncoderOptions{.method = EncodingMethod::STORED}, EncoderOptions{.run_length_filter = true},
+                         EncoderOptions{.model = HuffmanModel::Default()}}) {
+        for (auto version : {archive::FormatVersion::V2, archive::FormatVersion::V3}) {
+            options.format_version = version;
+            options.bit_order = BitOrder::LSB_FIRST;
+            CheckRoundTrip(options);
+        }
+    }
+
+    BitWriterU8 writer;
+    REQUIRE_THROWS_AS(ArchiveEncoder(writer, EncoderOptions{.bit_order = BitOrder::LSB_FIRST}), std::invalid_argument);
+}
+
+TEST_CASE("ArchiveEncoder format v3") {
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V3});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V3, .method = EncodingMethod::LZ77});
+
+    // Данные записи кончаются раньше, чем объявленный размер содержимого.
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer, EncoderOptions{.format_version = archive::FormatVersion::V3});
+        encoder.Encode("a", std::make_unique<std::istringstream>(std::string(1000, 'a') + "b"));
+        encoder.Close();
+    }
+    auto truncated = writer.Data();
+    truncated.resize(truncated.size() - 100);
+    BitReaderU8 reader(std::move(truncated));
+    ArchiveDecoder decoder(reader);
+    std::stringstream output;
+    REQUIRE_THROWS_AS(decoder.Decode(output), ArchiveDecoder::ProcessError);
+}
+
+TEST_CASE("ArchiveEncoder order-1 context model") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::CONTEXT_HUFFMAN});
+    CheckRoundTrip(
+        EncoderOptions{.format_version = archive::FormatVersion::V2, .method = EncodingMethod::CONTEXT_HUFFMAN});
+}
+
+TEST_CASE("ArchiveEncoder tans") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::TANS});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2, .method = EncodingMethod::TANS});
+}
+
+TEST_CASE("ArchiveEncoder context mixing") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::CONTEXT_MIXING});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2,
+                                  .method = EncodingMethod::CONTEXT_MIXING,
+                                  .context_mixing_order = 1});
+}
+
+TEST_CASE("ArchiveEncoder bwt") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::BWT});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2, .method = EncodingMethod::BWT});
+}
+
+TEST_CASE("ArchiveEncoder run length") {
+    CheckRoundTrip(EncoderOptions{.run_length_filter = true});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2, .run_length_filter = true});
+}
+
+TEST_CASE("ArchiveEncoder stored") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::STORED});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2, .method = EncodingMethod::STORED});
+}
+
+TEST_CASE("ArchiveEncoder raw") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::RAW});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2, .method = EncodingMethod::RAW});
+
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto path = (directory / "archiver_raw_test").string();
+    const auto archive_path = (directory / "archiver_raw_test.arc").string();
+    std::mt19937 generator(11);
+    std::string content(AsyncFileReader::CHUNK_SIZE * 3 + 17, 0);
+    for (char& byte : content) {
+        byte = static_cast<char>(generator());
+    }
+    std::ofstream(path, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+
+    for (BitOrder order : {BitOrder::MSB_FIRST, BitOrder::LSB_FIRST}) {
+        const EncoderOptions options{
+            .format_version = archive::FormatVersion::V2, .bit_order = order, .method = EncodingMethod::RAW};
+        // Короткая запись перед файлом сдвигает его содержимое с границы слова.
+        BitWriterU8 writer;
+        ArchiveEncoder encoder(writer, options);
+        encoder.Encode("short", std::make_unique<std::istringstream>("abc"));
+        encoder.Encode(path, std::make_unique<std::istringstream>(content));
+        encoder.Close();
+
+        // Файл в файл архива передает ядро, архив при этом тот же.
+        {
+            BitWriterFile file_writer(archive_path);
+            ArchiveEncoder file_encoder(file_writer, options);
+            file_encoder.Encode("short", std::make_unique<std::istringstream>("abc"));
+            file_encoder.EncodeFile(path);
+            file_encoder.Close();
+        }
+        std::ifstream archive_input(archive_path, std::ios::binary);
+        REQUIRE(std::vector<uint8_t>(std::istreambuf_iterator<char>(archive_input), {}) == writer.Data());
+
+        std::filesystem::remove(path);
+        BitReaderFile reader(archive_path);
+        ArchiveDecoder decoder(reader);
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == "short");
+        REQUIRE(output.str() == "abc");
+        REQUIRE(decoder.DecodeFile() == path);
+        REQUIRE(decoder.Done());
+        std::ifstream input(path, std::ios::binary);
+        REQUIRE(std::string(std::istreambuf_iterator<char>(input), {}) == content);
+    }
+
+    // Пустая запись тоже выровнена: ее записывает один путь, а читает другой, и за ней следует еще одна запись.
+    const auto empty_path = (directory / "archiver_raw_empty_test").string();
+    std::ofstream(empty_path, std::ios::binary).close();
+    {
+        BitWriterFile file_writer(archive_path);
+        ArchiveEncoder encoder(file_writer, EncoderOptions{.method = EncodingMethod::RAW});
+        encoder.EncodeFile(empty_path);
+        encoder.Encode("x", std::make_unique<std::istringstream>("abc"));
+        encoder.Close();
+    }
+    {
+        BitReaderFile reader(archive_path);
+        ArchiveDecoder decoder(reader);
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == empty_path);
+        REQUIRE(output.str().empty());
+        REQUIRE(decoder.Decode(output) == "x");
+        REQUIRE(output.str() == "abc");
+        REQUIRE(decoder.Done());
+    }
+
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer, EncoderOptions{.method = EncodingMethod::RAW});
+        encoder.Encode(empty_path, std::make_unique<std::istringstream>(""));
+        encoder.Encode(path, std::make_unique<std::istringstream>("abc"));
+        encoder.Close();
+    }
+    std::filesystem::remove(empty_path);
+    {
+        BitReaderU8 reader(writer.Data());
+        ArchiveDecoder decoder(reader);
+        REQUIRE(decoder.DecodeFile() == empty_path);
+        REQUIRE(decoder.DecodeFile() == path);
+        REQUIRE(decoder.Done());
+    }
+    REQUIRE(std::filesystem::file_size(empty_path) == 0);
+    std::ifstream input(path, std::ios::binary);
+    REQUIRE(std::string(std::istreambuf_iterator<char>(input), {}) == "abc");
+    input.close();
+
+    std::filesystem::remove(empty_path);
+    std::filesystem::remove(path);
+    std::filesystem::remove(archive_path);
+
+    // Поток без размера отвергается до заголовка записи, а не после записи размера 2^64 - 1.
+    BitWriterU8 unsized_writer;
+    ArchiveEncoder unsized_encoder(unsized_writer, EncoderOptions{.method = EncodingMethod::RAW});
+    REQUIRE_THROWS_WITH(unsized_encoder.Encode("unsized", std::make_unique<std::istream>(nullptr)),
+                        Catch::Contains("Cannot determine the size of the file."));
+}
+
+TEST_CASE("ArchiveEncoder auto") {
+    std::vector<EncodingMethod> selected;
+    const auto listener = [&](std::string_view, const SampleEstimate&, EncodingMethod method) {
+        selected.push_back(method);
+    };
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::AUTO, .selection_listener = listener});
+    REQUIRE(selected.size() == 4);
+    REQUIRE(selected[0] == EncodingMethod::TANS);
+    REQUIRE(selected[2] == EncodingMethod::STORED);
+}
+
+TEST_CASE("ArchiveEncoder blocks") {
+    CheckRoundTrip(EncoderOptions{.block_mode = true});
+    CheckRoundTrip(EncoderOptions{.block_mode = true, .block_codec = archive::CodecId::TANS});
+    CheckRoundTrip(EncoderOptions{.block_mode = true, .block_codec = archive::CodecId::MULTI_HUFFMAN});
+    CheckRoundTrip(EncoderOptions{
+        .format_version = archive::FormatVersion::V2, .block_mode = true, .block_codec = std::nullopt});
+}
+
+TEST_CASE("ArchiveEncoder stream") {
+    std::mt19937 generator(7);
+    std::string content;
+    for (size_t i = 0; i < Codec::BLOCK_SIZE * 2 + 1000; ++i) {
+        content.push_back(static_cast<char>('a' + generator() % 8));
+    }
+
+    // Содержимое приходит по каналу и не перематывается, поэтому сравнить с ним второй файл с тем же
+    // содержимым нельзя, и тот записывается целиком.
+    const auto encode = [&](bool with_copy) {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        std::thread producer([&] {
+            AsyncFileWriter pipe_writer(fds[1]);
+            pipe_writer.Write(std::span(reinterpret_cast<const uint8_t*>(content.data()), content.size()));
+            pipe_writer.Close();
+            close(fds[1]);
+        });
+
+        BitWriterU8 writer;
+        ArchiveEncoder encoder(writer);
+        auto input = std::make_unique<AsyncInputFile>(fds[0]);
+        input->exceptions(std::ios_base::badbit);
+        encoder.EncodeStream("piped", std::move(input));
+        producer.join();
+        close(fds[0]);
+        if (with_copy) {
+            encoder.Encode("copy", std::make_unique<std::istringstream>(content));
+        }
+        encoder.Close();
+        return writer.Data();
+    };
+
+    const auto archive = encode(false);
+    BitReaderU8 reader(archive);
+    ArchiveDecoder decoder(reader);
+    std::stringstream output;
+    REQUIRE(decoder.Decode(output) == "piped");
+    REQUIRE(output.str() == content);
+    REQUIRE(decoder.Done());
+    const auto with_copy = encode(true);
+    BitReaderU8 copy_reader(with_copy);
+    ArchiveDecoder copy_decoder(copy_reader);
+    for (const auto& name : {"piped", "copy"}) {
+        std::stringstream copy_output;
+        REQUIRE(copy_decoder.Decode(copy_output) == name);
+        REQUIRE(copy_output.str() == content);
+    }
+    REQUIRE(copy_decoder.Done());
+
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    close(fds[1]);
+    {
+        AsyncFileReader pipe_reader(fds[0]);
+        REQUIRE(pipe_reader.Next().empty());
+        REQUIRE_THROWS_AS(pipe_reader.Seek(0), std::ios_base::failure);
+    }
+    close(fds[0]);
+
+    // Из каталога читать нельзя: ошибка обнаруживается до заголовка, и архив после нее не дописывается.
+    const int directory = open(std::filesystem::temp_directory_path().c_str(), O_RDONLY | O_DIRECTORY);
+    REQUIRE(directory >= 0);
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer);
+        auto input = std::make_unique<AsyncInputFile>(directory);
+        input->exceptions(std::ios_base::badbit);
+        REQUIRE_THROWS_AS(encoder.EncodeStream("directory", std::move(input)), std::ios_base::failure);
+    }
+    close(directory);
+    REQUIRE(writer.Data().empty());
+}
+
+TEST_CASE("ArchiveEncoder sparse") {
+    const auto path = (std::filesystem::temp_directory_path() / "archiver_sparse_test").string();
+    std::mt19937 generator(9);
+    std::string content(size_t{8} << 20, 0);
+    // Данные в начале, посреди файла не с границы блока и в последнем блоке, между ними - дыры.
+    for (auto [offset, size] : {std::pair<size_t, size_t>{0, 1000}, {(size_t{3} << 20) + 77, Codec::BLOCK_SIZE + 5},
+                                {content.size() - 10, 10}}) {
+        for (size_t i = offset; i < offset + size; ++i) {
+            content[i] = static_cast<char>('a' + generator() % 4);
+        }
+    }
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        for (size_t offset = 0; offset < content.size(); offset += 4096) {
+            const std::string_view page(content.data() + offset, 4096);
+            if (page.find_first_not_of('\0') != std::string_view::npos) {
+                output.seekp(static_cast<std::streamoff>(offset));
+                output.write(page.data(), static_cast<std::streamsize>(page.size()));
+            }
+        }
+    }
+    std::filesystem::resize_file(path, content.size());
+
+    const auto layout = ReadFileLayout(path);
+    REQUIRE(layout.size == content.size());
+    REQUIRE(!layout.data.empty());
+    for (const FileRange& range : layout.data) {
+        REQUIRE(range.offset + range.size <= layout.size);
+    }
+
+    EncoderOptions options;
+    options.sparse_files = true;
+    BitWriterU8 writer;
+    ArchiveEncoder encoder(writer, options);
+    encoder.EncodeFile(path);
+    encoder.Close();
+    const auto archive = writer.Data();
+    // Если файловая система дыры не различает, файл записывается как обычно.
+    if (layout.DataSize() < layout.size) {
+        REQUIRE(archive.size() < Codec::BLOCK_SIZE * 2);
+    }
+
+    {
+        BitReaderU8 reader(archive);
+        ArchiveDecoder decoder(reader);
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == path);
+        REQUIRE(output.str() == content);
+        REQUIRE(decoder.Done());
+    }
+
+    std::filesystem::remove(path);
+    BitReaderU8 reader(archive);
+    ArchiveDecoder decoder(reader);
+    REQUIRE(decoder.DecodeFile() == path);
+    REQUIRE(decoder.Done());
+    std::ifstream input(path, std::ios::binary);
+    REQUIRE(std::string(std::istreambuf_iterator<char>(input), {}) == content);
+    if (layout.DataSize() < layout.size) {
+        struct stat status {};
+        REQUIRE(stat(path.c_str(), &status) == 0);
+        REQUIRE(static_cast<uint64_t>(status.st_blocks) * 512 < content.size() / 2);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("ArchiveEncoder levels") {
+    for (size_t level = EncoderOptions::MIN_LEVEL; level <= EncoderOptions::MAX_LEVEL; ++level) {
+        CheckRoundTrip(EncoderOptions::FromLevel(level));
+    }
+    REQUIRE_THROWS_AS(EncoderOptions::FromLevel(0), std::invalid_argument);
+    REQUIRE_THROWS_AS(EncoderOptions::FromLevel(10), std::invalid_argument);
+}
+
+TEST_CASE("ArchiveEncoder model") {
+    CheckRoundTrip(EncoderOptions{.model = HuffmanModel::Default()});
+
+    std::vector<size_t> frequencies(HuffmanModel::ALPHABET_SIZE, 1);
+    frequencies['a'] = 1000;
+    const auto model = HuffmanModel::Train(frequencies);
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer, EncoderOptions{.model = model});
+        const auto open = [](const std::string&) -> std::unique_ptr<std::istream> {
+            return std::make_unique<std::istringstream>("aaaa");
+        };
+        encoder.Encode("a", open);
+        encoder.Encode("b", open);
+        encoder.Close();
+    }
+
+    BitReaderU8 unknown_model_reader(writer.Data());
+    ArchiveDecoder unknown_model_decoder(unknown_model_reader);
+    std::stringstream output;
+    REQUIRE_THROWS_AS(unknown_model_decoder.Decode(output), ArchiveDecoder::ProcessError);
+
+    BitReaderU8 reader(writer.Data());
+    ArchiveDecoder decoder(reader);
+    decoder.AddModel(model);
+    REQUIRE(decoder.Decode(output) == "a");
+    REQUIRE(output.str() == "aaaa");
+
+    // Непрочитанный файл обнаруживается до заголовка записи, а деструктор не дописывает архив после ошибки.
+    for (auto format_version : {archive::FormatVersion::V1, archive::FormatVersion::V3}) {
+        BitWriterU8 failed_writer;
+        ArchiveEncoder encoder(failed_writer, EncoderOptions{.format_version = format_version, .model = model});
+        REQUIRE_THROWS_AS(encoder.EncodeFile("archiver_missing_input"), std::ios_base::failure);
+    }
+}
+
+TEST_CASE("ArchiveEncoder dictionary") {
+    const std::string dictionary_text = "The quick brown fox jumps over the lazy dog. ";
+    const auto dictionary = LzDictionary::FromContent({dictionary_text.begin(), dictionary_text.end()});
+
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer, EncoderOptions{.method = EncodingMethod::LZ77, .dictionary = dictionary});
+        encoder.Encode("a", std::make_unique<std::istringstream>("The lazy dog jumps over the quick brown fox."));
+        encoder.Close();
+    }
+
+    BitReaderU8 unknown_dictionary_reader(writer.Data());
+    ArchiveDecoder unknown_dictionary_decoder(unknown_dictionary_reader);
+    std::stringstream output;
+    REQUIRE_THROWS_AS(unknown_dictionary_decoder.Decode(output), ArchiveDecoder::ProcessError);
+
+    BitReaderU8 reader(writer.Data());
+    ArchiveDecoder decoder(reader);
+    decoder.AddDictionary(dictionary);
+    REQUIRE(decoder.Decode(output) == "a");
+    REQUIRE(output.str() == "The lazy dog jumps over the quick brown fox.");
+}
+
+TEST_CASE("ChooseEncodingMethod") {
+    const auto choose = [](const std::string& content) {
+        std::istringstream input(content);
+        return ChooseEncodingMethod(SampleEstimate::FromStream(input));
+    };
+
+    std::mt19937 generator(3);
+    std::string random(100000, 0);
+    for (char& byte : random) {
+        byte = static_cast<char>(generator());
+    }
+    REQUIRE(choose(random) == EncodingMethod::STORED);
+
+    std::string digits(100000, 0);
+    for (char& byte : digits) {
+        byte = static_cast<char>('0' + generator() % 10);
+    }
+    REQUIRE(choose(digits) == EncodingMethod::HUFFMAN);
+
+    std::string repeated;
+    while (repeated.size() < 100000) {
+        repeated += random.substr(0, 1000);
+    }
+    REQUIRE(choose(repeated) == EncodingMethod::LZ77);
+    std::istringstream repeated_input(repeated);
+    REQUIRE(ChooseEncodingMethod(SampleEstimate::FromStream(repeated_input),
+                                 SelectionPolicy{.repetitive_method = EncodingMethod::HUFFMAN}) !=
+            EncodingMethod::LZ77);
+    // Без размера нельзя выбрать места фрагментов, и оценка не делается по пустой выборке.
+    std::istream unsized(nullptr);
+    REQUIRE_THROWS_AS(SampleEstimate::FromStream(unsized), std::ios_base::failure);
+
+    const SampleEstimate skewed{
+        .content_size = 100000, .sampled_size = 16384, .used_symbols = 5, .entropy = 1.12, .huffman_bits = 1.4};
+    REQUIRE(ChooseEncodingMethod(skewed) == EncodingMethod::TANS);
+}
+
+TEST_CASE("ArchiveEncoder lz77") {
+    CheckRoundTrip(EncoderOptions{.method = EncodingMethod::LZ77});
+    CheckRoundTrip(EncoderOptions{.format_version = archive::FormatVersion::V2,
+                                  .method = EncodingMethod::LZ77,
+                                  .lz77 = {.window_bits = 8, .chain_depth = 1}});
+
+    BitWriterU8 writer;
+    {
+        ArchiveEncoder encoder(writer);
+        encoder.Encode("first", std::make_unique<std::istringstream>("abcabcabcabc"));
+        encoder.SetMethod(EncodingMethod::LZ77);
+        encoder.Encode("second", std::make_unique<std::istringstream>("xyzxyzxyzxyz"));
+        encoder.SetMethod(EncodingMethod::HUFFMAN);
+        encoder.Encode("third", std::make_unique<std::istringstream>("abc"));
+        encoder.Close();
+    }
+
+    BitReaderU8 reader(writer.Data());
+    ArchiveDecoder decoder(reader);
+    for (const auto& [name, content] :
+         std::map<std::string, std::string>{{"first", "abcabcabcabc"}, {"second", "xyzxyzxyzxyz"}, {"third", "abc"}}) {
+        std::stringstream output;
+        REQUIRE(decoder.Decode(output) == name);
+        REQUIRE(output.str() == content);
+    }
+    REQUIRE(decoder.Done());
+}
@@ -0,0 +1,35 @@
+#include <catch.hpp>
+
+#include "../hash.hpp"
+
+#include <string>
+
+namespace {
+
+Digest128 HashOf(std::string_view data) {
+    Hasher128 hasher;
+    hasher.Update(data);
+    return hasher.Finish();
+}
+
+}  // namespace
+
+TEST_CASE("Hasher128 reference values") {
+    REQUIRE(HashOf("") == Digest128{.low = 0, .high = 0});
+    REQUIRE(HashOf("hello") == Digest128{.low = 0xcbd8a7b341bd9b02ULL, .high = 0x5b1e906a48ae1d19ULL});
+    REQUIRE(HashOf("The quick brown fox jumps over the lazy dog") ==
+            Digest128{.low = 0xe34bbc7bbc071b6cULL, .high = 0x7a433ca9c49a9347ULL});
+}
+
+TEST_CASE("Hasher128 streaming") {
+    const std::string data = "Однажды весною, в час небывало жаркого заката, в Москве, на Патриарших прудах...";
+
+    Hasher128 by_byte;
+    for (uint8_t byte : data) {
+        by_byte.Update(byte);
+    }
+    REQUIRE(by_byte.Finish() == HashOf(data));
+
+    REQUIRE(HashOf(data) != HashOf(data.substr(1)));
+    REQUIRE(HashOf("aaaaaaaaaaaaaaaa") != HashOf("aaaaaaaaaaaaaaaaa"));
+}
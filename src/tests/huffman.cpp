@@ -0,0 +1,545 @@
+#include <catch.hpp>
+
+#include "../huffman.hpp"
+#include "../context_model.hpp"
+#include "../lz77.hpp"
+#include "../tans.hpp"
+#include "../context_mixing.hpp"
+#include "../bwt.hpp"
+#include "../rle.hpp"
+#include "../codec.hpp"
+#include "../model.hpp"
+#include "../dictionary.hpp"
+#include "../multi_huffman.hpp"
+#include "../bitstream_writer.hpp"
+#include "../bitstream_reader.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST_CASE("HuffmanCode canonical") {
+    const std::vector<size_t> frequencies{5, 1, 1, 2, 0};
+    const auto code = HuffmanCode::FromFrequencies(frequencies);
+
+    REQUIRE(code.GetLengths() == std::vector<size_t>{1, 3, 3, 2, 0});
+    REQUIRE(code.GetOrder() == std::vector<size_t>{0, 3, 1, 2});
+    REQUIRE(code.GetCode(0) == std::vector<bool>{0});
+    REQUIRE(code.GetCode(3) == std::vector<bool>{1, 0});
+    REQUIRE(code.GetCode(1) == std::vector<bool>{1, 1, 0});
+    REQUIRE(code.GetCode(2) == std::vector<bool>{1, 1, 1});
+    REQUIRE(code.MaxLength() == 3);
+
+    const auto single = HuffmanCode::FromFrequencies(std::vector<size_t>{0, 7, 0});
+    REQUIRE(single.GetOrder().size() == 2);
+}
+
+TEST_CASE("HuffmanCode length limit") {
+    std::vector<size_t> fibonacci{1, 1};
+    while (fibonacci.size() < 40) {
+        fibonacci.push_back(fibonacci[fibonacci.size() - 1] + fibonacci[fibonacci.size() - 2]);
+    }
+
+    REQUIRE(HuffmanCode::FromFrequencies(fibonacci).MaxLength() == 39);
+    const auto limited = HuffmanCode::FromFrequencies(fibonacci, HuffmanCode::MAX_COMPACT_LENGTH);
+    REQUIRE(limited.MaxLength() <= HuffmanCode::MAX_COMPACT_LENGTH);
+    REQUIRE(limited.GetOrder().size() == fibonacci.size());
+}
+
+TEST_CASE("HuffmanCode compact header") {
+    std::mt19937 rng(1337228);
+    for (size_t test = 0; test < 100; ++test) {
+        std::vector<size_t> frequencies(259, 0);
+        const size_t used = 2 + rng() % 257;
+        for (size_t i = 0; i < used; ++i) {
+            frequencies[rng() % frequencies.size()] = 1 + rng() % (test % 2 == 0 ? 10 : 100000);
+        }
+
+        const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+
+        BitWriterU8 writer;
+        code.WriteCompact(writer);
+        writer.Close();
+
+        BitReaderU8 reader(writer.Data());
+        const auto decoded = HuffmanCode::ReadCompact(reader, frequencies.size());
+        REQUIRE(decoded.GetLengths() == code.GetLengths());
+    }
+}
+
+TEST_CASE("HuffmanDecoder") {
+    const std::vector<size_t> frequencies{10, 3, 3, 1, 1, 20, 0, 2};
+    const auto code = HuffmanCode::FromFrequencies(frequencies);
+    const std::vector<size_t> message{5, 0, 7, 3, 4, 1, 2, 5, 5, 0};
+
+    BitWriterU8 writer;
+    for (size_t symbol : message) {
+        for (bool bit : code.GetCode(symbol)) {
+            writer.WriteBit(bit);
+        }
+    }
+    writer.Close();
+
+    BitReaderU8 reader(writer.Data());
+    const HuffmanDecoder decoder(code);
+    for (size_t symbol : message) {
+        REQUIRE(decoder.ReadSymbol(reader) == symbol);
+    }
+
+    // Коды длиннее таблицы декодера (частоты Фибоначчи дают длины до 14 бит).
+    std::vector<size_t> fibonacci{1, 1};
+    while (fibonacci.size() < 15) {
+        fibonacci.push_back(fibonacci[fibonacci.size() - 1] + fibonacci[fibonacci.size() - 2]);
+    }
+    const auto long_code = HuffmanCode::FromFrequencies(fibonacci);
+    REQUIRE(long_code.MaxLength() > BitReader::MAX_PEEK_BIT_COUNT);
+    const HuffmanDecoder long_decoder(long_code);
+    for (BitOrder order : {BitOrder::MSB_FIRST, BitOrder::LSB_FIRST}) {
+        BitWriterU8 long_writer;
+        long_writer.SetBitOrder(order);
+        for (size_t symbol = 0; symbol < fibonacci.size(); ++symbol) {
+            for (bool bit : long_code.GetCode(symbol)) {
+                long_writer.WriteBit(bit);
+            }
+        }
+        long_writer.Close();
+        BitReaderU8 long_reader(long_writer.Data());
+        long_reader.SetBitOrder(order);
+        for (size_t symbol = 0; symbol < fibonacci.size(); ++symbol) {
+            REQUIRE(long_decoder.ReadSymbol(long_reader) == symbol);
+        }
+    }
+
+    REQUIRE_THROWS_AS(HuffmanDecoder(std::vector<size_t>{0, 1, 2}, std::vector<size_t>{1, 1}), HuffmanFormatError);
+    REQUIRE_THROWS_AS(HuffmanDecoder(std::vector<size_t>{0, 1, 2}, std::vector<size_t>{0, 3}), HuffmanFormatError);
+    REQUIRE_NOTHROW(HuffmanDecoder(std::vector<size_t>{0, 1, 2}, std::vector<size_t>{1, 2}));
+}
+
+TEST_CASE("ContextHuffmanModel") {
+    std::string text;
+    for (size_t i = 0; i < 2000; ++i) {
+        text += "abracadabra, qu";
+        text += static_cast<char>('a' + i % 7);
+    }
+
+    ContextHuffmanModel model;
+    for (uint8_t byte : text) {
+        model.Count(byte);
+    }
+    model.Build();
+    REQUIRE(model.TablesCount() > 1);
+
+    BitWriterU8 writer;
+    model.WriteTables(writer);
+    for (uint8_t byte : text) {
+        model.Encode(writer, byte);
+    }
+    writer.Close();
+    REQUIRE(writer.Data().size() < text.size() / 4);
+
+    BitReaderU8 reader(writer.Data());
+    ContextHuffmanModel decoder;
+    decoder.ReadTables(reader);
+    std::string decoded;
+    for (size_t i = 0; i < text.size(); ++i) {
+        decoded.push_back(static_cast<char>(decoder.Decode(reader)));
+    }
+    REQUIRE(decoded == text);
+}
+
+namespace {
+
+void CheckLz77RoundTrip(const std::string& text, Lz77Parameters parameters) {
+    BitWriterU8 writer;
+    std::istringstream input(text);
+    Lz77Encoder(parameters).Encode(input, writer);
+    writer.Close();
+
+    BitReaderU8 reader(writer.Data());
+    std::ostringstream output;
+    Lz77Decoder(parameters.window_bits).Decode(reader, output);
+    REQUIRE(output.str() == text);
+}
+
+}  // namespace
+
+TEST_CASE("Lz77") {
+    CheckLz77RoundTrip("", {});
+    CheckLz77RoundTrip("a", {});
+    CheckLz77RoundTrip("abcabcabcabcabcabcabcabcabc", {});
+
+    std::mt19937 generator(17);
+    std::vector<std::string> words;
+    for (size_t i = 0; i < 500; ++i) {
+        std::string word;
+        for (size_t j = 0, length = 2 + generator() % 8; j < length; ++j) {
+            word.push_back(static_cast<char>('a' + generator() % 26));
+        }
+        words.push_back(word);
+    }
+
+    // Текст длиннее блока: совпадения должны находиться и через границу блоков.
+    std::string text;
+    while (text.size() < Lz77Encoder::BLOCK_SIZE * 3 / 2) {
+        text += words[generator() % words.size()];
+        text.push_back(generator() % 10 == 0 ? '\n' : ' ');
+    }
+
+    CheckLz77RoundTrip(text, {.window_bits = Lz77Parameters::MIN_WINDOW_BITS, .chain_depth = 4});
+    CheckLz77RoundTrip(text, {.window_bits = Lz77Parameters::MAX_WINDOW_BITS, .chain_depth = 64});
+
+    BitWriterU8 writer;
+    std::istringstream input(text);
+    Lz77Encoder({}).Encode(input, writer);
+    writer.Close();
+    REQUIRE(writer.Data().size() < text.size() / 2);
+
+    REQUIRE_THROWS_AS(Lz77Decoder(Lz77Parameters::MAX_WINDOW_BITS + 1), Lz77FormatError);
+}
+
+TEST_CASE("TansTable") {
+    std::vector<size_t> frequencies(TansTable::ALPHABET_SIZE, 0);
+    frequencies['a'] = 1000000;
+    frequencies['b'] = 1;
+    frequencies['c'] = 3;
+
+    auto table = TansTable::FromFrequencies(frequencies);
+    const auto& counts = table.GetCounts();
+    REQUIRE(counts['a'] + counts['b'] + counts['c'] == size_t{1} << table.TableLog());
+    REQUIRE(counts['b'] == 1);
+    REQUIRE(counts['d'] == 0);
+
+    BitWriterU8 writer;
+    table.Write(writer);
+    writer.Close();
+    BitReaderU8 reader(writer.Data());
+    REQUIRE(TansTable::Read(reader).GetCounts() == counts);
+}
+
+TEST_CASE("Tans") {
+    std::mt19937 generator(3);
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < 100000; ++i) {
+        // Сильно перекошенное распределение: Хаффман тратит на 'x' целый бит.
+        data.push_back(generator() % 16 == 0 ? static_cast<uint8_t>('a' + generator() % 4) : 'x');
+    }
+
+    std::vector<size_t> frequencies(TansTable::ALPHABET_SIZE, 0);
+    for (uint8_t byte : data) {
+        ++frequencies[byte];
+    }
+    const auto table = TansTable::FromFrequencies(frequencies);
+
+    BitWriterU8 writer;
+    TansEncoder encoder(table);
+    encoder.EncodeBlock(data, writer);
+    encoder.EncodeBlock(std::span(data).first(10), writer);
+    writer.Close();
+    REQUIRE(writer.Data().size() < data.size() / 16);
+
+    BitReaderU8 reader(writer.Data());
+    const TansDecoder decoder(table);
+    std::vector<uint8_t> decoded(data.size());
+    decoder.DecodeBlock(reader, decoded);
+    REQUIRE(decoded == data);
+    decoded.resize(10);
+    decoder.DecodeBlock(reader, decoded);
+    REQUIRE(std::equal(decoded.begin(), decoded.end(), data.begin()));
+}
+
+TEST_CASE("ContextMixing") {
+    std::string text;
+    for (size_t i = 0; i < 3000; ++i) {
+        text += "the quick brown fox jumps over the lazy dog ";
+        text += std::to_string(i % 17);
+    }
+
+    for (size_t order = 0; order <= ContextMixingModel::MAX_ORDER; order += 3) {
+        BitWriterU8 writer;
+        ContextMixingEncoder encoder(writer, order, text.size());
+        for (uint8_t byte : text) {
+            encoder.Encode(byte);
+        }
+        encoder.Flush();
+        writer.Close();
+        if (order != 0) {
+            REQUIRE(writer.Data().size() < text.size() / 20);
+        }
+
+        BitReaderU8 reader(writer.Data());
+        ContextMixingDecoder decoder(reader, order, text.size());
+        std::string decoded;
+        for (size_t i = 0; i < text.size(); ++i) {
+            decoded.push_back(static_cast<char>(decoder.Decode()));
+        }
+        REQUIRE(decoded == text);
+    }
+}
+
+TEST_CASE("BuildSuffixArray") {
+    std::mt19937 generator(5);
+    for (size_t test = 0; test < 200; ++test) {
+        std::vector<uint8_t> text(generator() % 200);
+        const size_t alphabet = 1 + generator() % 4;
+        for (uint8_t& byte : text) {
+            byte = static_cast<uint8_t>('a' + generator() % alphabet);
+        }
+
+        std::vector<uint32_t> expected(text.size() + 1);
+        std::iota(expected.begin(), expected.end(), 0);
+        std::ranges::sort(expected, [&](uint32_t lhs, uint32_t rhs) {
+            return std::lexicographical_compare(text.begin() + lhs, text.end(), text.begin() + rhs, text.end());
+        });
+        REQUIRE(BuildSuffixArray(text) == expected);
+    }
+}
+
+TEST_CASE("Bwt") {
+    const auto check = [](const std::string& text) {
+        BitWriterU8 writer;
+        std::istringstream input(text);
+        BwtEncoder().Encode(input, writer);
+        writer.Close();
+
+        BitReaderU8 reader(writer.Data());
+        std::ostringstream output;
+        BwtDecoder().Decode(reader, output);
+        REQUIRE(output.str() == text);
+        return writer.Data().size();
+    };
+
+    check("");
+    check("a");
+    check("banana");
+    check(std::string(5000, 'z'));
+
+    std::mt19937 generator(11);
+    std::string text;
+    while (text.size() < BwtEncoder::BLOCK_SIZE + 1000) {
+        text += "Рукописи не горят. ";
+        text += std::to_string(generator() % 100);
+    }
+    REQUIRE(check(text) < text.size() / 10);
+}
+
+TEST_CASE("ValueBucket") {
+    for (size_t value : {0, 1, 2, 3, 4, 7, 8, 100, 65535, 1 << 20}) {
+        const auto bucket = ValueBucket::FromValue(value);
+        REQUIRE(bucket.code < ValueBucket::Count(value));
+        REQUIRE(bucket.extra >> bucket.extra_bit_count == 0);
+
+        BitWriterU8 writer;
+        writer.WriteInt(bucket.extra, bucket.extra_bit_count);
+        writer.Close();
+        BitReaderU8 reader(writer.Data());
+        REQUIRE(ValueBucket::ReadValue(bucket.code, reader) == value);
+    }
+}
+
+TEST_CASE("RunLength") {
+    const auto check = [](const std::string& text) {
+        std::vector<size_t> frequencies(RunLengthSplitter::ALPHABET_SIZE, 0);
+        std::vector<std::pair<size_t, ValueBucket>> symbols;
+        RunLengthSplitter splitter;
+        const auto sink = [&](size_t symbol, const ValueBucket& bucket) {
+            ++frequencies[symbol];
+            symbols.emplace_back(symbol, bucket);
+        };
+        // Серии не должны обрываться на границе фрагментов.
+        const std::span data(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+        splitter.Feed(data.first(data.size() / 2), sink);
+        splitter.Feed(data.subspan(data.size() / 2), sink);
+        splitter.Finish(sink);
+
+        const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+        BitWriterU8 writer;
+        for (const auto& [symbol, bucket] : symbols) {
+            for (bool bit : code.GetCode(symbol)) {
+                writer.WriteBit(bit);
+            }
+            writer.WriteInt(bucket.extra, bucket.extra_bit_count);
+        }
+        writer.Close();
+
+        BitReaderU8 reader(writer.Data());
+        const HuffmanDecoder decoder(code);
+        std::ostringstream output;
+        RunLengthDecoder(decoder).Decode(reader, output);
+        REQUIRE(output.str() == text);
+        return symbols.size();
+    };
+
+    REQUIRE(check("") == 1);
+    REQUIRE(check("aaab") == 5);
+    REQUIRE(check("aaaab") == 4);
+    REQUIRE(check(std::string(100000, 'x')) == 3);
+    check(std::string(70000, '\0') + "abc" + std::string(3, 'c') + std::string(1000, '\xff'));
+
+    SECTION("Run without a byte") {
+        std::vector<size_t> frequencies(RunLengthSplitter::ALPHABET_SIZE, 0);
+        frequencies[RunLengthSplitter::FIRST_RUN_SYMBOL] = 1;
+        frequencies[RunLengthSplitter::END_OF_DATA] = 1;
+        const auto code = HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH);
+        BitWriterU8 writer;
+        for (bool bit : code.GetCode(RunLengthSplitter::FIRST_RUN_SYMBOL)) {
+            writer.WriteBit(bit);
+        }
+        writer.Close();
+
+        BitReaderU8 reader(writer.Data());
+        const HuffmanDecoder decoder(code);
+        std::ostringstream output;
+        REQUIRE_THROWS_AS(RunLengthDecoder(decoder).Decode(reader, output), RunLengthFormatError);
+    }
+}
+
+TEST_CASE("CodecRegistry") {
+    const auto& registry = CodecRegistry::Default();
+    REQUIRE(registry.Find("huffman")->Id() == archive::CodecId::HUFFMAN);
+    REQUIRE(registry.Find(archive::CodecId::TANS)->Name() == "tans");
+    REQUIRE(registry.Find("lz77") == nullptr);
+
+    CodecRegistry custom;
+    custom.Register(std::make_unique<StoredCodec>());
+    REQUIRE_THROWS_AS(custom.Register(std::make_unique<StoredCodec>()), std::invalid_argument);
+
+    std::mt19937 generator(5);
+    std::vector<uint8_t> random(10000);
+    for (uint8_t& byte : random) {
+        byte = static_cast<uint8_t>(generator());
+    }
+    const std::string text = "Рукописи не горят. Рукописи не горят.";
+    const std::vector<std::vector<uint8_t>> blocks{{'a'}, std::vector<uint8_t>(text.begin(), text.end()), random};
+
+    for (const auto& codec : registry.Codecs()) {
+        for (const auto& block : blocks) {
+            BitWriterU8 writer;
+            codec->EncodeBlock(block, writer);
+            writer.Close();
+
+            BitReaderU8 reader(writer.Data());
+            std::vector<uint8_t> decoded(block.size());
+            codec->DecodeBlock(reader, decoded);
+            REQUIRE(decoded == block);
+        }
+    }
+
+    REQUIRE(registry.Choose(SampleEstimate::FromBlock(random)).Id() == archive::CodecId::STORED);
+}
+
+TEST_CASE("MultiHuffman") {
+    // Распределение байтов меняется каждые 500 байт: один код на блок его не отслеживает.
+    std::mt19937 generator(7);
+    std::vector<uint8_t> block;
+    for (size_t part = 0; part < 40; ++part) {
+        const uint8_t first = part % 2 == 0 ? 'a' : 'p';
+        for (size_t i = 0; i < 500; ++i) {
+            block.push_back(static_cast<uint8_t>(first + generator() % 8));
+        }
+    }
+
+    BitWriterU8 writer;
+    MultiHuffmanEncoder().EncodeBlock(block, writer);
+    writer.Close();
+    BitWriterU8 single_writer;
+    HuffmanCodec().EncodeBlock(block, single_writer);
+    single_writer.Close();
+    REQUIRE(writer.Data().size() * 5 < single_writer.Data().size() * 4);
+
+    BitReaderU8 reader(writer.Data());
+    std::vector<uint8_t> decoded(block.size());
+    MultiHuffmanDecoder().DecodeBlock(reader, decoded);
+    REQUIRE(decoded == block);
+
+    // Селектор указывает за последний код.
+    BitWriterU8 corrupted;
+    corrupted.WriteInt(1, MultiHuffmanEncoder::TABLES_COUNT_BIT_COUNT);
+    HuffmanCode::FromFrequencies(std::vector<size_t>(MultiHuffmanEncoder::ALPHABET_SIZE, 1)).WriteCompact(corrupted);
+    corrupted.WriteBit(true);
+    corrupted.Close();
+    BitReaderU8 corrupted_reader(corrupted.Data());
+    std::vector<uint8_t> small(10);
+    REQUIRE_THROWS_AS(MultiHuffmanDecoder().DecodeBlock(corrupted_reader, small), MultiHuffmanFormatError);
+}
+
+TEST_CASE("HuffmanModel") {
+    const auto& builtin = HuffmanModel::Default();
+    REQUIRE(std::ranges::count(builtin.GetCode().GetLengths(), 0) == 0);
+    REQUIRE(builtin.GetCode().MaxLength() <= HuffmanCode::MAX_COMPACT_LENGTH);
+
+    std::vector<size_t> frequencies(HuffmanModel::ALPHABET_SIZE, 0);
+    frequencies['a'] = 100;
+    frequencies['b'] = 10;
+    const auto model = HuffmanModel::Train(frequencies);
+    REQUIRE(model.GetCode().GetLength('a') < model.GetCode().GetLength('b'));
+    REQUIRE(model.GetCode().GetLength(0) > 0);
+    REQUIRE(model.Id() != builtin.Id());
+
+    BitWriterU8 writer;
+    model.Write(writer);
+    writer.Close();
+    BitReaderU8 reader(writer.Data());
+    REQUIRE(HuffmanModel::Read(reader).Id() == model.Id());
+
+    // Модель, не покрывающая все байты, не принимается.
+    BitWriterU8 partial_writer;
+    HuffmanCode::FromFrequencies(frequencies, HuffmanCode::MAX_COMPACT_LENGTH).WriteCompact(partial_writer);
+    partial_writer.Close();
+    BitReaderU8 partial_reader(partial_writer.Data());
+    REQUIRE_THROWS_AS(HuffmanModel::Read(partial_reader), ModelFormatError);
+}
+
+TEST_CASE("LzDictionary") {
+    std::vector<std::vector<uint8_t>> samples;
+    for (size_t i = 0; i < 20; ++i) {
+        const std::string sample = "{\"id\": " + std::to_string(i * 7919) + ", \"status\": \"active\", \"tags\": []}";
+        samples.emplace_back(sample.begin(), sample.end());
+    }
+    const auto dictionary = LzDictionary::Train(samples, 256);
+    const auto content = dictionary.Content();
+    REQUIRE(!content.empty());
+    REQUIRE(content.size() <= 256);
+    const std::string text(content.begin(), content.end());
+    REQUIRE(text.find("\"status\": \"active\"") != std::string::npos);
+
+    const auto copy = LzDictionary::FromContent({content.begin(), content.end()});
+    REQUIRE(copy.Id() == dictionary.Id());
+    REQUIRE_THROWS_AS(LzDictionary::FromContent({}), DictionaryFormatError);
+    REQUIRE_THROWS_AS(LzDictionary::FromContent(std::vector<uint8_t>(LzDictionary::MAX_SIZE + 1)),
+                      DictionaryFormatError);
+    // Подстроки, встречающиеся только в одном образце, в словарь не попадают.
+    REQUIRE_THROWS_AS(LzDictionary::Train(std::span(samples).first(1)), std::invalid_argument);
+
+    // Файл, похожий на образцы, со словарем сжимается лучше, а декодируется только с тем же словарем.
+    const std::string file = "{\"id\": 12345, \"status\": \"active\", \"tags\": []}";
+    const auto encode = [&](std::span<const uint8_t> primed) {
+        BitWriterU8 writer;
+        std::istringstream input(file);
+        Lz77Encoder({}).Encode(input, writer, primed);
+        writer.Close();
+        return writer.Data();
+    };
+    const auto plain = encode({});
+    const auto primed = encode(content);
+    REQUIRE(primed.size() < plain.size());
+
+    BitReaderU8 reader(primed);
+    std::ostringstream output;
+    Lz77Decoder(Lz77Parameters{}.window_bits).Decode(reader, output, content);
+    REQUIRE(output.str() == file);
+
+    // Из словаря длиннее окна используется только его конец.
+    std::vector<uint8_t> long_dictionary(1 << 10, '#');
+    long_dictionary.insert(long_dictionary.end(), file.begin(), file.end());
+    BitWriterU8 writer;
+    std::istringstream input(file);
+    Lz77Encoder({.window_bits = Lz77Parameters::MIN_WINDOW_BITS}).Encode(input, writer, long_dictionary);
+    writer.Close();
+    BitReaderU8 long_reader(writer.Data());
+    std::ostringstream long_output;
+    Lz77Decoder(Lz77Parameters::MIN_WINDOW_BITS).Decode(long_reader, long_output, long_dictionary);
+    REQUIRE(long_output.str() == file);
+}
@@ -50,6 +50,7 @@ class ArchiverTester:
             if os.path.isdir(self.get_test_case_data_dir(name)):
                 try:
                     tester.test_compression_decompression(name)
+                    tester.test_print(name)
                 except ArchiverTester.TestCaseFailedException:
                     all_ok = False
         return all_ok
@@ -76,6 +77,38 @@ class ArchiverTester:
         except subprocess.CalledProcessError:
             self.fail_test_case(name, "archiver finished with non-zero exit code")
 
+    def test_print(self, name):
+        # -p does not extract files, so duplicate entries must not be served from the current directory.
+        try:
+            test_case_data_dir = self.get_test_case_data_dir(name)
+            input_files = sorted(os.listdir(test_case_data_dir))
+            expected = b""
+            for input_file in input_files:
+                with open(os.path.join(test_case_data_dir, input_file), "rb") as f:
+                    expected += f.read()
+
+            with tempfile.NamedTemporaryFile() as output_file:
+                subprocess.check_call([self.archiver_executable, "-c", output_file.name] + input_files,
+                                      cwd=test_case_data_dir, stderr=subprocess.DEVNULL)
+
+                with tempfile.TemporaryDirectory() as output_dir:
+                    printed = subprocess.check_output([self.archiver_executable, "-d", output_file.name, "-p"],
+                                                      cwd=output_dir, stderr=subprocess.DEVNULL)
+                    if printed != expected:
+                        self.fail_test_case(name, "printed content differs from expected")
+
+                    for input_file in input_files:
+                        with open(os.path.join(output_dir, input_file), "wb") as f:
+                            f.write(b"WRONG")
+                    printed = subprocess.check_output([self.archiver_executable, "-d", output_file.name, "-p"],
+                                                      cwd=output_dir, stderr=subprocess.DEVNULL)
+                    if printed != expected:
+                        self.fail_test_case(name, "printed content depends on files in the current directory")
+
+            self.succeed_test_case(name + " -p")
+        except subprocess.CalledProcessError:
+            self.fail_test_case(name, "archiver -p finished with non-zero exit code")
+
 
 if __name__ == "__main__":
     tester = ArchiverTester(archiver_executable=sys.argv[1], test_data_dir=sys.argv[2])